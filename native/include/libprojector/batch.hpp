@@ -0,0 +1,127 @@
+#ifndef LIBPROJECTOR_BATCH_HPP_
+#define LIBPROJECTOR_BATCH_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <libprojector/convertor.hpp>
+#include <libprojector/image_io.hpp>
+#include <libprojector/projections.hpp>
+#include <libprojector/thread_pool.hpp>
+
+namespace libprojector {
+
+    struct BatchResult {
+        std::string input;
+        std::string output;
+        bool success;
+        std::string error;
+    };
+
+    /**
+     Converts many images within a single process.
+
+     Every job is split into a decode, a convert and an encode task, all run by
+     the same work-stealing pool. The maps are shared through a cache keyed on
+     the geometry, so each one is built once whatever the number of images
+     sharing it. Inputs are decoded at a reduced scale when the output is
+     less dense than them (8 bits only). Both the pool and the cache outlive a run, so new jobs can be
+     added and run with the maps already built, and the convertors of other
+     settings can share them.
+
+     For a strip cubemap output, the six sides are written next to the output
+     path, suffixed with their name (`output+x.jpg`, `output-x.jpg`...) as the
+     cli does. The other layouts, and the stereo outputs, are written as a
+     single image.
+     */
+    class BatchConvertor {
+    public:
+        typedef std::function<void(const BatchResult&)> ResultCallback;
+
+        BatchConvertor(const ProjectionSpec& inSpec, const ProjectionSpec& outSpec, int outputWidth, int threads = 0);
+
+        // Convertor with settings of its own, sharing the thread pool and the map cache of `shared`
+        BatchConvertor(const ProjectionSpec& inSpec, const ProjectionSpec& outSpec, int outputWidth, BatchConvertor& shared);
+
+        void setRotation(const Rotation& _rotation) {
+            rotation = _rotation;
+        }
+
+        void setInterpolation(int _interpolation) {
+            interpolation = _interpolation;
+        }
+
+        // encoding quality in [0,100], negative for the codec default
+        void setQuality(int _quality) {
+            quality = _quality;
+        }
+
+        void setDepth(ImageDepth _depth) {
+            depth = _depth;
+        }
+
+        // memory kept for the maps of the geometries met so far (see MapCache)
+        void setMapCacheCapacity(size_t capacity) {
+            cache->setCapacity(capacity);
+        }
+
+        size_t getMapCacheBytes() {
+            return cache->getBytes();
+        }
+
+        void addJob(const std::string& input, const std::string& output);
+
+        size_t size() const {
+            return jobs.size();
+        }
+
+        // Runs the jobs added so far, `onResult` is called from the calling
+        // thread as soon as a job finishes (successfully or not)
+        void run(const ResultCallback& onResult);
+
+        /**
+         Convert an image already decoded (e.g. shared by another process)
+         on the calling thread, with the maps of the cache, at `_rotation`
+         rather than the one of the jobs.
+         */
+        cv::Mat convertImage(const cv::Mat& image, const Rotation& _rotation);
+
+        static std::vector<std::string> cubemapSidePaths(const std::string& output);
+
+    private:
+        struct Job {
+            std::string input;
+            std::string output;
+        };
+
+        ProjectionSpec inSpec;
+        ProjectionSpec outSpec;
+        int outputWidth;
+        Rotation rotation;
+        int interpolation;
+        int quality;
+        ImageDepth depth;
+
+        std::vector<Job> jobs;
+        boost::shared_ptr<ThreadPool> pool;
+        boost::shared_ptr<MapCache> cache;
+
+        std::mutex resultsMutex;
+        std::condition_variable resultsReady;
+        std::deque<BatchResult> results;
+
+        void decode(size_t index);
+        void convert(size_t index, cv::Mat image, int scale);
+        void encode(size_t index, cv::Mat image);
+        void finish(size_t index, bool success, const std::string& error = std::string());
+    };
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_BATCH_HPP_ */
@@ -0,0 +1,1263 @@
+#ifndef LIBPROJECTOR_CONVERTOR_HPP_
+#define LIBPROJECTOR_CONVERTOR_HPP_
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <libprojector/half.hpp>
+#include <libprojector/projections.hpp>
+#include <libprojector/ray_field.hpp>
+#include <libprojector/sampler.hpp>
+#include <libprojector/stereo.hpp>
+#include <libprojector/tiled_source.hpp>
+#include <libprojector/tiling.hpp>
+#include <libprojector/yuv.hpp>
+
+namespace libprojector {
+
+    /**
+     Rotation applied to the rays between the output and the input projection,
+     so that `inRay = R * outRay`.
+
+     Euler angles are given in degrees:
+        - yaw around +z (positive brings the content on the right to the center)
+        - pitch around +y (positive tilts the view up)
+        - roll around +x
+     */
+    struct Rotation {
+        cv::Matx33d m;
+
+        Rotation() : m(cv::Matx33d::eye()) {}
+        Rotation(const cv::Matx33d& _m) : m(_m) {}
+
+        static Rotation fromEuler(double yaw, double pitch, double roll) {
+            double a = yaw * M_PI / 180.0;
+            double b = -pitch * M_PI / 180.0;
+            double c = roll * M_PI / 180.0;
+
+            cv::Matx33d rz(cos(a), -sin(a), 0,
+                           sin(a),  cos(a), 0,
+                           0,       0,      1);
+            cv::Matx33d ry(cos(b),  0, sin(b),
+                           0,       1, 0,
+                          -sin(b),  0, cos(b));
+            cv::Matx33d rx(1, 0,       0,
+                           0, cos(c), -sin(c),
+                           0, sin(c),  cos(c));
+            return Rotation(rz * ry * rx);
+        }
+
+        static Rotation fromQuaternion(double w, double x, double y, double z) {
+            double n = sqrt(w*w + x*x + y*y + z*z);
+            if (n == 0) {
+                throw std::invalid_argument("the rotation quaternion can't be null");
+            }
+            w /= n; x /= n; y /= n; z /= n;
+            return Rotation(cv::Matx33d(
+                1 - 2*(y*y + z*z),     2*(x*y - w*z),     2*(x*z + w*y),
+                    2*(x*y + w*z), 1 - 2*(x*x + z*z),     2*(y*z - w*x),
+                    2*(x*z - w*y),     2*(y*z + w*x), 1 - 2*(x*x + y*y)));
+        }
+
+        bool isIdentity(double eps = 1e-12) const {
+            cv::Matx33d id = cv::Matx33d::eye();
+            for (int i = 0; i < 9; ++i) {
+                if (fabs(m.val[i] - id.val[i]) > eps) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Snap to a signed permutation matrix (multiple of 90 degrees around
+        // the axes), returns false if the rotation is not axis-aligned
+        bool toAxisAligned(cv::Matx33d& snapped, double eps = 1e-9) const {
+            for (int i = 0; i < 9; ++i) {
+                double v = round(m.val[i]);
+                if (fabs(m.val[i] - v) > eps) {
+                    return false;
+                }
+                snapped.val[i] = v;
+            }
+            return true;
+        }
+
+        // If `this = Rz(angle) * other`, returns true and the angle (radians)
+        bool yawDeltaFrom(const Rotation& other, double& angle, double eps = 1e-9) const {
+            cv::Matx33d d = m * other.m.t();
+            if (fabs(d(0,2)) > eps || fabs(d(1,2)) > eps ||
+                fabs(d(2,0)) > eps || fabs(d(2,1)) > eps || fabs(d(2,2) - 1.0) > eps) {
+                return false;
+            }
+            angle = atan2(d(1,0), d(0,0));
+            return true;
+        }
+
+        std::string getKey() const {
+            std::ostringstream key;
+            key.precision(17);
+            for (int i = 0; i < 9; ++i) {
+                key << (i ? "," : "") << m.val[i];
+            }
+            return key.str();
+        }
+
+        void apply(Ray& r) const {
+            double x = m(0,0) * r.x + m(0,1) * r.y + m(0,2) * r.z;
+            double y = m(1,0) * r.x + m(1,1) * r.y + m(1,2) * r.z;
+            double z = m(2,0) * r.x + m(2,1) * r.y + m(2,2) * r.z;
+            r.x = x;
+            r.y = y;
+            r.z = z;
+        }
+    };
+
+    /**
+     Builds the remaping maps of the tiles of a grid from the ray field of
+     the output (see RayField), each row of a tile being written sequentially.
+     */
+    class MapBuilder: public cv::ParallelLoopBody {
+    private:
+        const Projection& inProj;
+        const cv::Mat& rays;
+        const Rotation& rotation;
+        const TileGrid& grid;
+        cv::Mat& mapX;
+        cv::Mat& mapY;
+        bool rotate;
+
+    public:
+        MapBuilder(const Projection& _inProj, const cv::Mat& _rays, const Rotation& _rotation,
+                   const TileGrid& _grid, cv::Mat& _mapX, cv::Mat& _mapY) :
+            inProj(_inProj),
+            rays(_rays),
+            rotation(_rotation),
+            grid(_grid),
+            mapX(_mapX),
+            mapY(_mapY),
+            rotate(!_rotation.isIdentity()) {}
+
+        void operator()(const cv::Range& range) const {
+            for (int i = range.start; i < range.end; ++i) {
+                const cv::Rect& tile = grid[i];
+                for (int y = tile.y; y < tile.y + tile.height; ++y) {
+                    const cv::Vec2f* rowRays = rays.ptr<cv::Vec2f>(y);
+                    float* rowX = mapX.ptr<float>(y);
+                    float* rowY = mapY.ptr<float>(y);
+                    for (int x = tile.x; x < tile.x + tile.width; ++x) {
+                        Ray r;
+                        decodeRay(rowRays[x], r);
+
+                        if (rotate) {
+                            rotation.apply(r);
+                        }
+
+                        TexCoords t;
+                        inProj.toTexCoords(r, t);
+
+                        rowX[x] = static_cast<float>(t.u);
+                        rowY[x] = static_cast<float>(t.v);
+                    }
+                }
+            }
+        }
+    };
+
+    /**
+     Builds the maps of the given tiles of the output only, from the rays of
+     each tile (see ProjectionConvertor::interpolateMaps).
+     */
+    class TileMapBuilder: public cv::ParallelLoopBody {
+    private:
+        const Projection& inProj;
+        ProjectionPtr outProj;
+        const Rotation& rotation;
+        const std::vector<cv::Rect>& tiles;
+        cv::Mat& mapX;
+        cv::Mat& mapY;
+
+    public:
+        TileMapBuilder(const Projection& _inProj, ProjectionPtr _outProj, const Rotation& _rotation,
+                       const std::vector<cv::Rect>& _tiles, cv::Mat& _mapX, cv::Mat& _mapY) :
+            inProj(_inProj),
+            outProj(_outProj),
+            rotation(_rotation),
+            tiles(_tiles),
+            mapX(_mapX),
+            mapY(_mapY) {}
+
+        void operator()(const cv::Range& range) const {
+            for (int i = range.start; i < range.end; ++i) {
+                const cv::Rect& tile = tiles[i];
+                RegionProjection region(outProj, tile);
+                RayField rays(region);
+                cv::Mat tileX = mapX(tile);
+                cv::Mat tileY = mapY(tile);
+                TileGrid grid(tile.width, tile.height, std::max(tile.width, tile.height));
+                MapBuilder builder(inProj, rays.getRays(), rotation, grid, tileX, tileY);
+                builder(cv::Range(0, grid.size()));
+            }
+        }
+    };
+
+    /**
+     Builds the maps of each view of an input with view weights (see
+     Projection::hasViewWeights), and the weights of the views normalized
+     to sum to 1 wherever a view sees the ray.
+     */
+    class ViewMapBuilder: public cv::ParallelLoopBody {
+    private:
+        const Projection& inProj;
+        const cv::Mat& rays;
+        const Rotation& rotation;
+        const TileGrid& grid;
+        std::vector<cv::Mat>& mapsX;
+        std::vector<cv::Mat>& mapsY;
+        std::vector<cv::Mat>& weights;
+
+    public:
+        ViewMapBuilder(const Projection& _inProj, const cv::Mat& _rays, const Rotation& _rotation,
+                       const TileGrid& _grid, std::vector<cv::Mat>& _mapsX, std::vector<cv::Mat>& _mapsY,
+                       std::vector<cv::Mat>& _weights) :
+            inProj(_inProj),
+            rays(_rays),
+            rotation(_rotation),
+            grid(_grid),
+            mapsX(_mapsX),
+            mapsY(_mapsY),
+            weights(_weights) {}
+
+        void operator()(const cv::Range& range) const {
+            int views = static_cast<int>(mapsX.size());
+            std::vector<double> viewWeights(views);
+            for (int i = range.start; i < range.end; ++i) {
+                const cv::Rect& tile = grid[i];
+                for (int y = tile.y; y < tile.y + tile.height; ++y) {
+                    for (int x = tile.x; x < tile.x + tile.width; ++x) {
+                        Ray r;
+                        decodeRay(rays.at<cv::Vec2f>(y, x), r);
+                        rotation.apply(r);
+
+                        double total = 0;
+                        for (int view = 0; view < views; ++view) {
+                            TexCoords t;
+                            viewWeights[view] = inProj.toViewTexCoords(view, r, t);
+                            total += viewWeights[view];
+                            mapsX[view].at<float>(y, x) = static_cast<float>(t.u);
+                            mapsY[view].at<float>(y, x) = static_cast<float>(t.v);
+                        }
+                        for (int view = 0; view < views; ++view) {
+                            weights[view].at<float>(y, x) = static_cast<float>((total > 0) ? viewWeights[view] / total : 0);
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    class TiledRemap: public cv::ParallelLoopBody {
+    private:
+        const cv::Mat& src;
+        cv::Mat dst;
+        const cv::Mat& mapX;
+        const cv::Mat& mapY;
+        const TileGrid& grid;
+        int interpolation;
+
+    public:
+        TiledRemap(const cv::Mat& _src, cv::Mat _dst, const cv::Mat& _mapX, const cv::Mat& _mapY,
+                   const TileGrid& _grid, int _interpolation) :
+            src(_src),
+            dst(_dst),
+            mapX(_mapX),
+            mapY(_mapY),
+            grid(_grid),
+            interpolation(_interpolation) {}
+
+        void operator()(const cv::Range& range) const {
+            for (int i = range.start; i < range.end; ++i) {
+                const cv::Rect& tile = grid[i];
+                cv::Mat dstTile = dst(tile);
+                cv::remap(src, dstTile, mapX(tile), mapY(tile), interpolation, cv::BORDER_WRAP);
+            }
+        }
+    };
+
+    class ProjectionConvertor {
+    private:
+        ProjectionPtr inProj;
+        ProjectionPtr outProj;
+        cv::Mat mapX;
+        cv::Mat mapY;
+        cv::Mat lodMap;  // level of detail of the mipmap sampling, built on demand
+        cv::Mat fixedCoords;  // integer source pixels of the kernel sampling, built on demand
+        cv::Mat fixedPositions;  // quantized subpixel positions of the kernel sampling
+        cv::Mat chromaMapX;  // half-size maps of the YUV 4:2:0 chroma planes, built on demand
+        cv::Mat chromaMapY;
+        std::vector<cv::Mat> viewMapsX;  // maps and weights of the views of the input, if it has view weights
+        std::vector<cv::Mat> viewMapsY;
+        std::vector<cv::Mat> viewWeights;
+
+        Rotation rotation;
+        Rotation mapRotation;  // rotation used to build the current maps
+
+        // Shift the cached maps for a rotation around the z-axis of the input
+        // space, only valid when the input projection is spherical.
+        bool shiftYaw(double angle) {
+            const SphericalProjection* sphericalProj = dynamic_cast<const SphericalProjection*>(inProj.get());
+            if (sphericalProj == NULL) {
+                return false;
+            }
+
+            const float width = static_cast<float>(sphericalProj->getWidth());
+            const float offset = static_cast<float>(angle * sphericalProj->getScale());
+
+            for (int y = 0; y < mapX.rows; ++y) {
+                float* row = mapX.ptr<float>(y);
+                for (int x = 0; x < mapX.cols; ++x) {
+                    float u = row[x] + offset;
+                    if (u < 0 || u >= width) {
+                        u -= width * floorf(u / width);
+                    }
+                    row[x] = u;
+                }
+            }
+            fixedCoords.release();
+            fixedPositions.release();
+            chromaMapX.release();
+            chromaMapY.release();
+            return true;
+        }
+
+        // Fill the areas outside of the output projection, `dst` being
+        // downscaled by `scale` (e.g. chroma planes)
+        void clearEmptyAreas(cv::Mat& dst, int scale = 1, double value = 0) const {
+            std::vector<cv::Rect> areas = outProj->getEmptyAreas();
+            for (size_t i = 0; i < areas.size(); ++i) {
+                const cv::Rect& area = areas[i];
+                dst(cv::Rect(area.x / scale, area.y / scale, area.width / scale, area.height / scale)).setTo(cv::Scalar::all(value));
+            }
+        }
+
+        // Drop what the samplings built on top of the maps (see prepare)
+        void releaseSamplingMaps() {
+            lodMap.release();
+            fixedCoords.release();
+            fixedPositions.release();
+            chromaMapX.release();
+            chromaMapY.release();
+        }
+
+        /**
+         Pixels of the maps around which their linear interpolation, scaled
+         by (scaleX, scaleY), may be off by more than a quarter of a pixel:
+         the error is about an eighth of the second differences. The borders
+         are rough too, the interpolation extrapolating past them.
+         */
+        static cv::Mat findRoughPixels(const cv::Mat& mapX, const cv::Mat& mapY, double scaleX, double scaleY) {
+            const float limit = 2;
+            cv::Mat rough(mapX.rows, mapX.cols, CV_8UC1, cv::Scalar(1));
+            for (int y = 1; y + 1 < mapX.rows; ++y) {
+                const float* rowX[3] = {mapX.ptr<float>(y - 1), mapX.ptr<float>(y), mapX.ptr<float>(y + 1)};
+                const float* rowY[3] = {mapY.ptr<float>(y - 1), mapY.ptr<float>(y), mapY.ptr<float>(y + 1)};
+                uchar* out = rough.ptr<uchar>(y);
+                for (int x = 1; x + 1 < mapX.cols; ++x) {
+                    float dx = std::max(fabsf(rowX[1][x - 1] - 2 * rowX[1][x] + rowX[1][x + 1]),
+                                        fabsf(rowX[0][x] - 2 * rowX[1][x] + rowX[2][x]));
+                    float dy = std::max(fabsf(rowY[1][x - 1] - 2 * rowY[1][x] + rowY[1][x + 1]),
+                                        fabsf(rowY[0][x] - 2 * rowY[1][x] + rowY[2][x]));
+                    // NaNs are rough
+                    out[x] = !(dx * scaleX <= limit && dy * scaleY <= limit);
+                }
+            }
+            return rough;
+        }
+
+        /**
+         Resample `src` into `dst` (allocated, e.g. a side of the output) at
+         src(m * (x, y, 1)), with the pixel conventions and the wrap of the
+         remap path: the texels sampled are the ones its maps would give,
+         without building them.
+         */
+        static void warpLikeRemap(const cv::Mat& src, cv::Mat dst, const cv::Matx23d& m, int interpolation) {
+            cv::warpAffine(src, dst, cv::Mat(m), dst.size(), interpolation | cv::WARP_INVERSE_MAP, cv::BORDER_WRAP);
+        }
+
+        // equirectangular to equirectangular, with a rotation around the
+        // vertical axis only, by a whole number of input pixels
+        bool convertSphericalFast(const cv::Mat& src, cv::Mat& dst, int interpolation) const {
+            const SphericalProjection* in = static_cast<const SphericalProjection*>(inProj.get());
+
+            double angle = 0;
+            if (!rotation.yawDeltaFrom(Rotation(), angle)) {
+                return false;
+            }
+            double offset = angle * in->getScale();
+            int shift = static_cast<int>(round(offset));
+            if (fabs(offset - shift) > 1e-6) {
+                return false;
+            }
+
+            int width = src.cols;
+            shift %= width;
+            if (shift < 0) {
+                shift += width;
+            }
+
+            cv::Size outSize(outProj->getWidth(), outProj->getHeight());
+            if (src.size() != outSize) {
+                // the native samplers only go through maps
+                if (isNativeInterpolation(interpolation)) {
+                    return false;
+                }
+                // u = x * scale + shift, v from the middle row, the scale of
+                // both axes being the one of the longitudes
+                double scale = static_cast<double>(width) / outSize.width;
+                dst.create(outSize, src.type());
+                warpLikeRemap(src, dst, cv::Matx23d(scale, 0, shift, 0, scale, (src.rows - outSize.height * scale) / 2),
+                              toCvInterpolation(interpolation));
+                return true;
+            }
+
+            // column roll: out(x) = in(x + shift)
+            if (shift == 0) {
+                dst = src.clone();
+            } else {
+                dst.create(src.rows, src.cols, src.type());
+                src.colRange(shift, width).copyTo(dst.colRange(0, width - shift));
+                src.colRange(0, shift).copyTo(dst.colRange(width - shift, width));
+            }
+            return true;
+        }
+
+        // cubemap to cubemap, with a rotation by multiples of 90 degrees: the
+        // sides are permuted, transposed and flipped
+        bool convertCubemapFast(const cv::Mat& src, cv::Mat& dst, int interpolation) const {
+            const CubemapProjection* in = static_cast<const CubemapProjection*>(inProj.get());
+            const CubemapProjection* out = static_cast<const CubemapProjection*>(outProj.get());
+
+            cv::Matx33d r;
+            if (in->getSideBorderPadding() != 0 || out->getSideBorderPadding() != 0 || !rotation.toAxisAligned(r)) {
+                return false;
+            }
+
+            int inSide = in->getSideWidth();
+            int outSide = out->getSideWidth();
+            // the native samplers only go through maps
+            if (inSide != outSide && isNativeInterpolation(interpolation)) {
+                return false;
+            }
+            dst.create(out->getHeight(), out->getWidth(), src.type());
+            clearEmptyAreas(dst);
+
+            for (int outFace = 0; outFace < 6; ++outFace) {
+                cv::Vec3d n, a, b;
+                out->getLayoutSideAxes(outFace, n, a, b);
+                cv::Vec3d rn = r * n, ra = r * a, rb = r * b;
+
+                // find the input side facing the rotated normal, and express
+                // the rotated side axes in its own axes
+                int inFace = -1;
+                cv::Vec3d inA, inB;
+                for (int face = 0; face < 6; ++face) {
+                    cv::Vec3d fn;
+                    in->getLayoutSideAxes(face, fn, inA, inB);
+                    if (fn.dot(rn) > 0.5) {
+                        inFace = face;
+                        break;
+                    }
+                }
+                if (inFace < 0) {
+                    return false;
+                }
+
+                // (uIn, vIn) = [[p, q], [t, s]] * (uOut, vOut), over [-1, 1]
+                double p = ra.dot(inA), q = rb.dot(inA);
+                double t = ra.dot(inB), s = rb.dot(inB);
+
+                cv::Rect inRect = in->getSideRect(inFace);
+                cv::Mat outSideImage = dst(out->getSideRect(outFace));
+                if (inSide == outSide && p >= 0 && q >= 0 && t >= 0 && s >= 0) {
+                    // the same texels, possibly transposed
+                    if (p != 0) {
+                        src(inRect).copyTo(outSideImage);
+                    } else {
+                        cv::transpose(src(inRect), outSideImage);
+                    }
+                    continue;
+                }
+
+                // the texels of the remap path, the pixels of a side being
+                // at [0, side) over [-1, 1): a flipped axis is shifted by a
+                // pixel, and its first pixel falls on the edge of the next side
+                double f = static_cast<double>(inSide) / outSide;
+                cv::Matx23d m(f * p, f * q, inRect.x + inSide / 2.0 * (1 - p - q),
+                              f * t, f * s, inRect.y + inSide / 2.0 * (1 - t - s));
+                // whole texels at the same size, for any interpolation
+                warpLikeRemap(src, outSideImage, m, inSide == outSide ? cv::INTER_NEAREST : toCvInterpolation(interpolation));
+            }
+            return true;
+        }
+
+    public:
+        /**
+         Conversions which don't need any resampling map: they are carried out
+         with memory operations, or affine warps when the sizes differ (or a
+         cubemap side is flipped), giving the pixels of the remap path.
+         */
+        bool convertFast(const cv::Mat& src, cv::Mat& dst, int interpolation) const {
+            if (inProj->getType() != outProj->getType()) {
+                return false;
+            }
+            if (src.cols != inProj->getWidth() || src.rows != inProj->getHeight()) {
+                return false;
+            }
+            // the resizes of OpenCV don't handle half floats
+            if (src.depth() == DEPTH_HALF) {
+                return false;
+            }
+
+            switch (inProj->getType()) {
+                case ProjectionTypeSpherical:
+                    return convertSphericalFast(src, dst, interpolation);
+                case ProjectionTypeCubemap:
+                // the warp of the equi-angular cubemaps is the same along
+                // both axes, and symmetric, so the sides are permuted the same
+                case ProjectionTypeEquiAngularCubemap:
+                    return convertCubemapFast(src, dst, interpolation);
+                default:
+                    return false;
+            }
+        }
+
+        ProjectionConvertor(ProjectionPtr _inProj, ProjectionPtr _outProj) : 
+            inProj(_inProj),
+            outProj(_outProj) {}
+
+        ProjectionPtr getInProjection() const { return inProj; }
+        ProjectionPtr getOutProjection() const { return outProj; }
+
+        cv::Mat get_map_x() const { return mapX; }
+        cv::Mat get_map_y() const { return mapY; }
+
+        // Memory held by the maps and the tables built from them
+        size_t getMapBytes() const {
+            const cv::Mat* maps[] = {&mapX, &mapY, &lodMap, &fixedCoords, &fixedPositions, &chromaMapX, &chromaMapY};
+            size_t bytes = 0;
+            for (size_t i = 0; i < sizeof(maps) / sizeof(maps[0]); ++i) {
+                bytes += maps[i]->total() * maps[i]->elemSize();
+            }
+            for (size_t i = 0; i < viewWeights.size(); ++i) {
+                bytes += (viewMapsX[i].total() + viewMapsY[i].total() + viewWeights[i].total()) * sizeof(float);
+            }
+            return bytes;
+        }
+
+        void setRotation(const Rotation& _rotation) {
+            rotation = _rotation;
+        }
+
+        void set_rotation(double yaw, double pitch, double roll) {
+            setRotation(Rotation::fromEuler(yaw, pitch, roll));
+        }
+
+        void set_rotation_quaternion(double w, double x, double y, double z) {
+            setRotation(Rotation::fromQuaternion(w, x, y, z));
+        }
+
+        void set_rotation_matrix(cv::Mat m) {
+            if (m.rows != 3 || m.cols != 3 || m.channels() != 1) {
+                throw std::invalid_argument("the rotation matrix must be 3x3");
+            }
+            cv::Mat md;
+            m.convertTo(md, CV_64F);
+            cv::Matx33d r;
+            for (int i = 0; i < 3; ++i) {
+                for (int j = 0; j < 3; ++j) {
+                    r(i,j) = md.at<double>(i,j);
+                }
+            }
+            setRotation(Rotation(r));
+        }
+
+        void convert() {
+            // the rays of the output are shared by the inputs converted to it
+            RayFieldPtr rays = getRayFieldCache().get(outProj);
+            convertRays(rays->getRays());
+        }
+
+        /**
+         Same as convert, from the given rays of the output (see RayField)
+         rather than the ones of the cache, e.g. a region of the rays of a
+         bigger output.
+         */
+        void convertRays(const cv::Mat& rays) {
+            int width = outProj->getWidth();
+            int height = outProj->getHeight();
+            if (rays.size() != cv::Size(width, height) || rays.type() != CV_32FC2) {
+                throw std::invalid_argument("the rays must be the ones of the output");
+            }
+
+            mapX = cv::Mat(height, width, CV_32FC1);
+            mapY = cv::Mat(height, width, CV_32FC1);
+
+            // small tiles, so that the rows read and written stay in L1
+            TileGrid grid(width, height, TileGrid::tileSizeFor(getCacheSize(1), 4 * sizeof(float)));
+            MapBuilder builder(*inProj, rays, rotation, grid, mapX, mapY);
+            cv::parallel_for_(cv::Range(0, grid.size()), builder);
+
+            viewMapsX.clear();
+            viewMapsY.clear();
+            viewWeights.clear();
+            if (inProj->hasViewWeights()) {
+                for (int view = 0; view < inProj->getViewCount(); ++view) {
+                    viewMapsX.push_back(cv::Mat(height, width, CV_32FC1));
+                    viewMapsY.push_back(cv::Mat(height, width, CV_32FC1));
+                    viewWeights.push_back(cv::Mat(height, width, CV_32FC1));
+                }
+                ViewMapBuilder viewBuilder(*inProj, rays, rotation, grid, viewMapsX, viewMapsY, viewWeights);
+                cv::parallel_for_(cv::Range(0, grid.size()), viewBuilder);
+            }
+
+            mapRotation = rotation;
+            releaseSamplingMaps();
+        }
+
+        /**
+         Build the maps by interpolating the ones of `coarse`, a convertor of
+         a lower resolution of the same conversion (scaled projections of the
+         same input and output, e.g. a stage of a ProgressiveConvertor) whose
+         maps are up to date. The tiles around which the interpolation may be
+         off by more than a quarter of an input pixel (the seams of a cubemap,
+         the wrap of a spherical input, the poles, the borders) are built
+         exactly, from their rays only.
+
+         Returns false, leaving the maps as they are, when the maps of
+         `coarse` can't be used.
+         */
+        bool interpolateMaps(const ProjectionConvertor& coarse) {
+            if (coarse.mapX.empty() || coarse.mapRotation.getKey() != rotation.getKey() || inProj->hasViewWeights()) {
+                return false;
+            }
+            int width = outProj->getWidth();
+            int height = outProj->getHeight();
+            // input pixels of this conversion per input pixel of the coarse one,
+            // the pixel centers being aligned as ScaledProjection and cv::resize do
+            double scaleX = static_cast<double>(inProj->getWidth()) / coarse.inProj->getWidth();
+            double scaleY = static_cast<double>(inProj->getHeight()) / coarse.inProj->getHeight();
+
+            cv::resize(coarse.mapX, mapX, cv::Size(width, height), 0, 0, cv::INTER_LINEAR);
+            cv::resize(coarse.mapY, mapY, cv::Size(width, height), 0, 0, cv::INTER_LINEAR);
+            mapX.convertTo(mapX, CV_32F, scaleX, 0.5 * scaleX - 0.5);
+            mapY.convertTo(mapY, CV_32F, scaleY, 0.5 * scaleY - 0.5);
+
+            cv::Mat rough = findRoughPixels(coarse.mapX, coarse.mapY, scaleX, scaleY);
+            double ratioX = static_cast<double>(coarse.mapX.cols) / width;
+            double ratioY = static_cast<double>(coarse.mapX.rows) / height;
+            TileGrid grid(width, height, TileGrid::tileSizeFor(getCacheSize(1), 4 * sizeof(float)));
+            std::vector<cv::Rect> exactTiles;
+            for (int i = 0; i < grid.size(); ++i) {
+                const cv::Rect& tile = grid[i];
+                // coarse pixels the tile is interpolated from
+                int x0 = std::max(0, cvFloor((tile.x + 0.5) * ratioX - 0.5));
+                int x1 = std::min(coarse.mapX.cols - 1, cvFloor((tile.x + tile.width - 0.5) * ratioX - 0.5) + 1);
+                int y0 = std::max(0, cvFloor((tile.y + 0.5) * ratioY - 0.5));
+                int y1 = std::min(coarse.mapX.rows - 1, cvFloor((tile.y + tile.height - 0.5) * ratioY - 0.5) + 1);
+                if (cv::countNonZero(rough(cv::Range(y0, y1 + 1), cv::Range(x0, x1 + 1))) > 0) {
+                    exactTiles.push_back(tile);
+                }
+            }
+            TileMapBuilder builder(*inProj, outProj, rotation, exactTiles, mapX, mapY);
+            cv::parallel_for_(cv::Range(0, static_cast<int>(exactTiles.size())), builder);
+
+            viewMapsX.clear();
+            viewMapsY.clear();
+            viewWeights.clear();
+            mapRotation = rotation;
+            releaseSamplingMaps();
+            return true;
+        }
+
+        /**
+         Same as update, the maps being interpolated from the ones of
+         `coarse` (see interpolateMaps) rather than built when they can't be
+         shifted.
+         */
+        void updateFrom(const ProjectionConvertor& coarse) {
+            double angle;
+            if (!mapX.empty() && rotation.yawDeltaFrom(mapRotation, angle)) {
+                if (angle == 0 || shiftYaw(angle)) {
+                    mapRotation = rotation;
+                    return;
+                }
+            }
+            if (!interpolateMaps(coarse)) {
+                convert();
+            }
+        }
+
+        /**
+         Build what the sampling with `interpolation` needs on top of the maps.
+         A yaw shift of the maps keeps their derivatives, hence the lod map,
+         but moves the fixed maps of the kernel sampling.
+         */
+        void prepare(int interpolation) {
+            if (interpolation == INTER_NATIVE_MIPMAP && lodMap.empty()) {
+                float wrapWidth = 0;
+                if (inProj->getType() == ProjectionTypeSpherical) {
+                    wrapWidth = static_cast<float>(inProj->getWidth());
+                }
+                lodMap = computeLodMap(mapX, mapY, wrapWidth);
+            }
+            if (isKernelInterpolation(interpolation) && fixedCoords.empty()) {
+                computeFixedMaps(mapX, mapY, fixedCoords, fixedPositions);
+            }
+        }
+
+        /**
+         Bring the maps up to date with the current rotation.
+
+         When the maps have already been built and the rotation only changed
+         around the vertical axis of a spherical input, the cached maps are
+         shifted horizontally (with wrap) instead of being recomputed.
+
+         Returns true when the incremental path has been used.
+         */
+        bool update() {
+            double angle;
+            if (!mapX.empty() && rotation.yawDeltaFrom(mapRotation, angle)) {
+                if (angle == 0 || shiftYaw(angle)) {
+                    mapRotation = rotation;
+                    return true;
+                }
+            }
+            convert();
+            return false;
+        }
+
+        /**
+         Convert an image from the input to the output projection, going
+         through a remap-free path whenever the conversion allows it.
+         */
+        cv::Mat convert_image(cv::Mat src, int interpolation) {
+            return convertImage(src, interpolation, NULL);
+        }
+
+        /**
+         Same as convert_image, the mipmap sampling reading the `pyramid` of
+         `src` when given, instead of building one: the conversions of a
+         source to several outputs (or regions) share it.
+         */
+        cv::Mat convertImage(const cv::Mat& src, int interpolation, const MipPyramid* pyramid) {
+            cv::Mat dst;
+            if (convertFast(src, dst, interpolation)) {
+                return dst;
+            }
+
+            update();
+            prepare(interpolation);
+            return remapImage(src, interpolation, pyramid);
+        }
+
+        /**
+         Convertor of the `roi` of the output image only, with the same
+         rotation: its maps, and the images it converts, cover the region
+         alone, so that the work scales with the area of the region.
+
+         The maps already built for the current rotation are cut instead of
+         being built again.
+         */
+        ProjectionConvertor region(const cv::Rect& roi) const {
+            ProjectionConvertor convertor(inProj, ProjectionPtr(new RegionProjection(outProj, roi)));
+            convertor.setRotation(rotation);
+            if (!mapX.empty() && mapRotation.getKey() == rotation.getKey()) {
+                // copies, as a yaw shift of these maps happens in place
+                convertor.mapX = mapX(roi).clone();
+                convertor.mapY = mapY(roi).clone();
+                convertor.mapRotation = mapRotation;
+                if (!lodMap.empty()) {
+                    convertor.lodMap = lodMap(roi).clone();
+                }
+                if (!fixedCoords.empty()) {
+                    convertor.fixedCoords = fixedCoords(roi).clone();
+                    convertor.fixedPositions = fixedPositions(roi).clone();
+                }
+                for (size_t view = 0; view < viewWeights.size(); ++view) {
+                    convertor.viewMapsX.push_back(viewMapsX[view](roi).clone());
+                    convertor.viewMapsY.push_back(viewMapsY[view](roi).clone());
+                    convertor.viewWeights.push_back(viewWeights[view](roi).clone());
+                }
+            }
+            return convertor;
+        }
+
+        // Same as convert_image for the `roi` of the output image only
+        cv::Mat convert_region(cv::Mat src, int x, int y, int width, int height, int interpolation) const {
+            return region(cv::Rect(x, y, width, height)).convert_image(src, interpolation);
+        }
+
+        /**
+         Convert the given sides of a cubemap output only, each one into an
+         image of its own (with its border padding).
+         */
+        std::vector<cv::Mat> convertSides(const cv::Mat& src, const std::vector<int>& sides, int interpolation) const {
+            const CubemapProjection* out = dynamic_cast<const CubemapProjection*>(outProj.get());
+            if (out == NULL) {
+                throw std::invalid_argument("the sides can only be converted to a cubemap");
+            }
+            // the sides sample the same source
+            boost::shared_ptr<MipPyramid> pyramid;
+            if (interpolation == INTER_NATIVE_MIPMAP) {
+                pyramid.reset(new MipPyramid(src));
+            }
+            std::vector<cv::Mat> images;
+            for (size_t i = 0; i < sides.size(); ++i) {
+                if (sides[i] < 0 || sides[i] >= 6) {
+                    throw std::invalid_argument("the cubemap sides are numbered from 0 to 5");
+                }
+                images.push_back(region(out->getSideRect(sides[i])).convertImage(src, interpolation, pyramid.get()));
+            }
+            return images;
+        }
+
+        /**
+         Convert a tiled source (of the size of the input projection), each
+         output tile reading only the source tiles under it. The level read is
+         the smallest one staying at least as dense as the output, sampled
+         with the closest OpenCV interpolation.
+         */
+        cv::Mat convert_tiled(TiledSource& source, int interpolation) {
+            if (source.getSize() != cv::Size(inProj->getWidth(), inProj->getHeight())) {
+                throw std::invalid_argument("the tiled source must have the size of the input projection");
+            }
+            if (inProj->hasViewWeights()) {
+                throw std::invalid_argument("the tiled sources can't be blended from views");
+            }
+
+            int level = 0;
+            double inDensity = inProj->getMinDensity();
+            while (level + 1 < source.getLevelCount() && inDensity / (2 << level) >= outProj->getMaxDensity()) {
+                ++level;
+            }
+
+            cv::Mat dst;
+            if (level == 0) {
+                update();
+                remapTiledSource(source, 0, mapX, mapY, interpolation, dst);
+            } else {
+                cv::Size size = source.getSize(level);
+                ProjectionConvertor convertor(ProjectionPtr(new ScaledProjection(inProj, size.width, size.height)), outProj);
+                convertor.setRotation(rotation);
+                convertor.update();
+                remapTiledSource(source, level, convertor.mapX, convertor.mapY, interpolation, dst);
+            }
+            clearEmptyAreas(dst);
+            return dst;
+        }
+
+        /**
+         Stereo version of convertFast, the projections being the ones of an
+         eye. A mono input gives both eyes of a stereo output, and the left
+         eye of a stereo input gives a mono output.
+         */
+        bool convertStereoFast(const cv::Mat& src, cv::Mat& dst, StereoLayout inLayout, StereoLayout outLayout,
+                               int interpolation) const {
+            if (inLayout == StereoLayoutMono && outLayout == StereoLayoutMono) {
+                return convertFast(src, dst, interpolation);
+            }
+
+            std::vector<cv::Mat> srcEyes = getStereoEyes(src, inLayout);
+            cv::Mat eye;
+            if (!convertFast(srcEyes[0], eye, interpolation)) {
+                return false;
+            }
+
+            dst.create(getStereoImageSize(eye.size(), outLayout), src.type());
+            std::vector<cv::Mat> dstEyes = getStereoEyes(dst, outLayout);
+            for (size_t i = 0; i < dstEyes.size(); ++i) {
+                size_t srcEye = std::min(i, srcEyes.size() - 1);
+                if (srcEye > 0) {
+                    convertFast(srcEyes[srcEye], eye, interpolation);
+                }
+                eye.copyTo(dstEyes[i]);
+            }
+            return true;
+        }
+
+        /**
+         Convert a stereo image, both eyes going through the maps of one eye
+         (the projections of the convertor), straight into the eyes of the
+         output layout. See convertStereoFast for the mono to stereo cases.
+         */
+        cv::Mat convert_stereo(cv::Mat src, StereoLayout inLayout, StereoLayout outLayout, int interpolation) {
+            cv::Mat dst;
+            if (convertStereoFast(src, dst, inLayout, outLayout, interpolation)) {
+                return dst;
+            }
+
+            update();
+            prepare(interpolation);
+            return remapStereo(src, inLayout, outLayout, interpolation);
+        }
+
+        // Same as convert_stereo with the maps as they are (see remapImage)
+        cv::Mat remapStereo(const cv::Mat& src, StereoLayout inLayout, StereoLayout outLayout, int interpolation) const {
+            std::vector<cv::Mat> srcEyes = getStereoEyes(src, inLayout);
+            cv::Mat dst(getStereoImageSize(cv::Size(mapX.cols, mapX.rows), outLayout), src.type());
+            std::vector<cv::Mat> dstEyes = getStereoEyes(dst, outLayout);
+            for (size_t i = 0; i < dstEyes.size(); ++i) {
+                remapInto(srcEyes[std::min(i, srcEyes.size() - 1)], dstEyes[i], interpolation);
+            }
+            return dst;
+        }
+
+        /**
+         Remap an image with the maps as they are (see update and prepare),
+         which makes it safe to call from several threads once they are built.
+         */
+        cv::Mat remapImage(const cv::Mat& src, int interpolation, const MipPyramid* pyramid = NULL) const {
+            cv::Mat dst;
+            remapInto(src, dst, interpolation, pyramid);
+            return dst;
+        }
+
+        // Same as remapImage, writing to `dst` (which may be a view on a bigger image)
+        void remapInto(const cv::Mat& src, cv::Mat& dst, int interpolation, const MipPyramid* pyramid = NULL) const {
+            if (viewWeights.empty()) {
+                remapSamples(src, dst, interpolation, pyramid);
+            } else {
+                remapViews(src, dst, interpolation);
+            }
+            clearEmptyAreas(dst);
+        }
+
+        /**
+         Remap each view of the input, and blend them with their weights. The
+         views are sampled with the closest OpenCV interpolation, and blended
+         in float.
+         */
+        void remapViews(const cv::Mat& src, cv::Mat& dst, int interpolation) const {
+            cv::Mat values;
+            if (src.depth() == DEPTH_HALF) {
+                convertFromHalf(src, values);
+            } else {
+                src.convertTo(values, CV_32F);
+            }
+
+            size_t bytesPerPixel = 3 * sizeof(float) + 2 * values.elemSize();
+            TileGrid grid(mapX.cols, mapX.rows, TileGrid::tileSizeFor(getCacheSize(2), bytesPerPixel));
+            cv::Mat blended = cv::Mat::zeros(mapX.rows, mapX.cols, values.type());
+            cv::Mat view(mapX.rows, mapX.cols, values.type());
+            for (size_t i = 0; i < viewWeights.size(); ++i) {
+                TiledRemap remap(values, view, viewMapsX[i], viewMapsY[i], grid, toCvInterpolation(interpolation));
+                cv::parallel_for_(cv::Range(0, grid.size()), remap);
+
+                cv::Mat weights;
+                cv::merge(std::vector<cv::Mat>(values.channels(), viewWeights[i]), weights);
+                cv::multiply(view, weights, view);
+                cv::add(blended, view, blended);
+            }
+
+            if (src.depth() == DEPTH_HALF) {
+                convertToHalf(blended, dst);
+            } else {
+                blended.convertTo(dst, src.type());
+            }
+        }
+
+        /**
+         Remap the `tile` of the output alone into the same region of `dst`
+         (allocated to the output size), with the maps as they are (see
+         update and prepare). A tile of at most getRemapTileSize is sampled
+         on the calling thread, for the callers scheduling the tiles of
+         several conversions on a pool of their own. The inputs with view
+         weights aren't remapped tile by tile.
+         */
+        void remapTile(const cv::Mat& src, cv::Mat& dst, const cv::Rect& tile, int interpolation,
+                       const MipPyramid* pyramid = NULL) const {
+            if (!viewWeights.empty()) {
+                throw std::logic_error("the inputs with view weights aren't remapped tile by tile");
+            }
+            // a convertor over the maps of the tile, sharing them
+            ProjectionConvertor part(inProj, outProj);
+            part.mapX = mapX(tile);
+            part.mapY = mapY(tile);
+            if (!lodMap.empty()) {
+                part.lodMap = lodMap(tile);
+            }
+            if (!fixedCoords.empty()) {
+                part.fixedCoords = fixedCoords(tile);
+                part.fixedPositions = fixedPositions(tile);
+            }
+            cv::Mat dstTile = dst(tile);
+            part.remapSamples(src, dstTile, interpolation, pyramid);
+
+            std::vector<cv::Rect> areas = outProj->getEmptyAreas();
+            for (size_t i = 0; i < areas.size(); ++i) {
+                cv::Rect area = areas[i] & tile;
+                if (area.area() > 0) {
+                    dstTile(area - tile.tl()).setTo(cv::Scalar::all(0));
+                }
+            }
+        }
+
+        // Side of the tiles the output is remapped by: small enough for the
+        // maps, the output and the source footprint to stay in L2
+        static int getRemapTileSize(const cv::Mat& src) {
+            size_t bytesPerPixel = 2 * sizeof(float) + 2 * src.elemSize();
+            return TileGrid::tileSizeFor(getCacheSize(2), bytesPerPixel);
+        }
+
+        // `pyramid`: the mip pyramid of `src` if already built (see convertImage)
+        void remapSamples(const cv::Mat& src, cv::Mat& dst, int interpolation, const MipPyramid* pyramid = NULL) const {
+            dst.create(mapX.rows, mapX.cols, src.type());
+            TileGrid grid(mapX.cols, mapX.rows, getRemapTileSize(src));
+
+            if (interpolation == INTER_NATIVE_MIPMAP) {
+                if (lodMap.empty()) {
+                    throw std::logic_error("the convertor isn't prepared for the mipmap sampling");
+                }
+                if (pyramid == NULL) {
+                    remapMipmap(MipPyramid(src), dst, mapX, mapY, lodMap, grid);
+                    return;
+                }
+                if ((*pyramid)[0].size() != src.size() || (*pyramid)[0].type() != src.type()) {
+                    throw std::invalid_argument("the mip pyramid isn't the one of the source");
+                }
+                remapMipmap(*pyramid, dst, mapX, mapY, lodMap, grid);
+                return;
+            }
+            if (isKernelInterpolation(interpolation)) {
+                if (fixedCoords.empty()) {
+                    throw std::logic_error("the convertor isn't prepared for the kernel sampling");
+                }
+                remapKernel(src, dst, fixedCoords, fixedPositions, interpolation, grid);
+                return;
+            }
+
+            if (src.depth() == DEPTH_HALF) {
+                // cv::remap doesn't handle half floats, they go through a float copy
+                cv::Mat values, remapped;
+                convertFromHalf(src, values);
+                remapSamples(values, remapped, interpolation);
+                convertToHalf(remapped, dst);
+                return;
+            }
+
+            TiledRemap remap(src, dst, mapX, mapY, grid, interpolation);
+            cv::parallel_for_(cv::Range(0, grid.size()), remap);
+        }
+
+        // Build the chroma maps of the YUV 4:2:0 conversions on top of the maps
+        void prepareYUV() {
+            if (chromaMapX.empty()) {
+                float wrapWidth = 0;
+                if (inProj->getType() == ProjectionTypeSpherical) {
+                    wrapWidth = static_cast<float>(inProj->getWidth());
+                }
+                computeChromaMaps(mapX, mapY, wrapWidth, chromaMapX, chromaMapY);
+            }
+        }
+
+        /**
+         Convert a planar YUV 4:2:0 frame (see YUVFormat) to a frame of the
+         same format, without going through BGR: the luma plane is remapped
+         at full resolution, the chroma planes with the half-size maps.
+
+         The native samplers only apply to the luma, the chroma planes using
+         the closest OpenCV interpolation.
+         */
+        cv::Mat convert_yuv(cv::Mat src, YUVFormat format, int interpolation) {
+            update();
+            prepare(interpolation);
+            prepareYUV();
+            return remapYUV(src, format, interpolation);
+        }
+
+        // Same as convert_yuv with the maps as they are (see prepareYUV)
+        cv::Mat remapYUV(const cv::Mat& src, YUVFormat format, int interpolation) const {
+            if (chromaMapX.empty()) {
+                throw std::logic_error("the convertor isn't prepared for the YUV conversions");
+            }
+            YUVPlanes srcPlanes = getYUVPlanes(src, format);
+            cv::Mat dst = createYUVFrame(cv::Size(mapX.cols, mapX.rows));
+            YUVPlanes dstPlanes = getYUVPlanes(dst, format);
+
+            remapInto(srcPlanes.luma, dstPlanes.luma, interpolation);
+
+            int chromaInterpolation = toCvInterpolation(interpolation);
+            for (size_t i = 0; i < srcPlanes.chroma.size(); ++i) {
+                const cv::Mat& srcPlane = srcPlanes.chroma[i];
+                size_t bytesPerPixel = 2 * sizeof(float) + 2 * srcPlane.elemSize();
+                TileGrid grid(chromaMapX.cols, chromaMapX.rows, TileGrid::tileSizeFor(getCacheSize(2), bytesPerPixel));
+                TiledRemap remap(srcPlane, dstPlanes.chroma[i], chromaMapX, chromaMapY, grid, chromaInterpolation);
+                cv::parallel_for_(cv::Range(0, grid.size()), remap);
+                // black in YUV
+                clearEmptyAreas(dstPlanes.chroma[i], 2, 128);
+            }
+            return dst;
+        }
+    };
+
+    typedef boost::shared_ptr<ProjectionConvertor> ProjectionConvertorPtr;
+
+    /**
+     Largest power of two (up to `maxScale`) the input can be downscaled by
+     while staying at least as dense as the output everywhere, i.e. the scale
+     to decode the input at (e.g. with JPEG DCT scaling).
+     */
+    inline int getReducedDecodeScale(const Projection& inProj, const Projection& outProj, int maxScale = 8) {
+        double inDensity = inProj.getMinDensity();
+        double outDensity = outProj.getMaxDensity();
+
+        int scale = 1;
+        while (scale * 2 <= maxScale && inDensity / (scale * 2) >= outDensity) {
+            scale *= 2;
+        }
+        return scale;
+    }
+
+    /**
+     Convertors shared by the conversions with the same geometry (projections
+     and rotation), so that their maps are only built once. The least recently
+     used convertors are dropped past the capacity (in bytes of maps), or past
+     MAX_ENTRIES for the conversions without maps. Safe to use from several
+     threads, a convertor dropped while converting stays alive until it's done.
+     */
+    class MapCache {
+    public:
+        // default capacity, e.g. 8 geometries of 4096x2048 with bilinear maps
+        static const size_t DEFAULT_CAPACITY = size_t(512) << 20;
+        static const size_t MAX_ENTRIES = 256;
+
+    private:
+        struct Entry {
+            std::string key;
+            std::mutex mutex;
+            bool ready;
+            size_t bytes;  // counted in the cache once the maps are built
+            ProjectionConvertorPtr convertor;
+            std::list<std::string>::iterator recent;
+
+            Entry() : ready(false), bytes(0) {}
+        };
+
+        std::mutex mutex;
+        size_t capacity;
+        size_t bytes;
+        std::map<std::string, boost::shared_ptr<Entry> > entries;
+        std::list<std::string> recentKeys;  // the front being the most recent
+
+        boost::shared_ptr<Entry> getEntry(ProjectionPtr inProj, ProjectionPtr outProj, const Rotation& rotation) {
+            std::string key = inProj->getKey() + ">" + outProj->getKey() + "@" + rotation.getKey();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            boost::shared_ptr<Entry>& entry = entries[key];
+            if (entry) {
+                recentKeys.splice(recentKeys.begin(), recentKeys, entry->recent);
+                return entry;
+            }
+
+            entry.reset(new Entry());
+            entry->key = key;
+            entry->convertor.reset(new ProjectionConvertor(inProj, outProj));
+            entry->convertor->setRotation(rotation);
+            recentKeys.push_front(key);
+            entry->recent = recentKeys.begin();
+
+            boost::shared_ptr<Entry> added = entry;
+            evict();
+            return added;
+        }
+
+        // count the maps of `entry` (its mutex being held), unless it was dropped meanwhile
+        void addBytes(Entry& entry, size_t entryBytes) {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::map<std::string, boost::shared_ptr<Entry> >::iterator found = entries.find(entry.key);
+            if (found == entries.end() || found->second.get() != &entry) {
+                return;
+            }
+            bytes += entryBytes - entry.bytes;
+            entry.bytes = entryBytes;
+            evict();
+        }
+
+        // drop the least recently used entries, the mutex being held
+        void evict() {
+            while (!recentKeys.empty() && (bytes > capacity || entries.size() > MAX_ENTRIES)) {
+                std::map<std::string, boost::shared_ptr<Entry> >::iterator oldest = entries.find(recentKeys.back());
+                bytes -= oldest->second->bytes;
+                entries.erase(oldest);
+                recentKeys.pop_back();
+            }
+        }
+
+    public:
+        explicit MapCache(size_t _capacity = DEFAULT_CAPACITY) :
+            capacity(_capacity),
+            bytes(0) {}
+
+        // The projections are the ones of an eye for the stereo images
+        cv::Mat convert(ProjectionPtr inProj, ProjectionPtr outProj, const Rotation& rotation,
+                        const cv::Mat& src, int interpolation,
+                        StereoLayout inStereo = StereoLayoutMono, StereoLayout outStereo = StereoLayoutMono) {
+            boost::shared_ptr<Entry> entry = getEntry(inProj, outProj, rotation);
+
+            cv::Mat dst;
+            if (entry->convertor->convertStereoFast(src, dst, inStereo, outStereo, interpolation)) {
+                return dst;
+            }
+
+            {
+                // the first conversion builds the maps, the others wait for it
+                std::lock_guard<std::mutex> lock(entry->mutex);
+                if (!entry->ready) {
+                    entry->convertor->convert();
+                    entry->ready = true;
+                }
+                entry->convertor->prepare(interpolation);
+                // the tables of the interpolations add up as they're prepared
+                size_t entryBytes = entry->convertor->getMapBytes();
+                if (entryBytes != entry->bytes) {
+                    addBytes(*entry, entryBytes);
+                }
+            }
+            return entry->convertor->remapStereo(src, inStereo, outStereo, interpolation);
+        }
+
+        void setCapacity(size_t _capacity) {
+            std::lock_guard<std::mutex> lock(mutex);
+            capacity = _capacity;
+            evict();
+        }
+
+        size_t getBytes() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return bytes;
+        }
+
+        size_t size() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return entries.size();
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.clear();
+            recentKeys.clear();
+            bytes = 0;
+        }
+    };
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_CONVERTOR_HPP_ */
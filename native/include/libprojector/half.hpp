@@ -0,0 +1,32 @@
+#ifndef LIBPROJECTOR_HALF_HPP_
+#define LIBPROJECTOR_HALF_HPP_
+
+#include <opencv2/core/core.hpp>
+
+// the half float images (CV_16F) need the conversions of cv::Mat::convertTo
+// of OpenCV 4: with an older OpenCV they are refused, the other depths working
+#if CV_VERSION_MAJOR >= 4
+#define LIBPROJECTOR_HALF_FLOAT 1
+#endif
+
+namespace libprojector {
+
+    // Depth of the half float images, -1 (no image) when they aren't supported
+#ifdef LIBPROJECTOR_HALF_FLOAT
+    const int DEPTH_HALF = CV_16F;
+#else
+    const int DEPTH_HALF = -1;
+#endif
+
+    // Converts an image of any depth to half floats (CV_16F), values unchanged
+    void convertToHalf(const cv::Mat& src, cv::Mat& dst);
+
+    // Converts a half float image (CV_16F) to float (CV_32F)
+    void convertFromHalf(const cv::Mat& src, cv::Mat& dst);
+
+    // cv::resize, through float for the half float images it doesn't handle
+    void resizeImage(const cv::Mat& src, cv::Mat& dst, const cv::Size& size, int interpolation);
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_HALF_HPP_ */
@@ -0,0 +1,64 @@
+#ifndef LIBPROJECTOR_IMAGE_IO_HPP_
+#define LIBPROJECTOR_IMAGE_IO_HPP_
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include <libprojector/thread_pool.hpp>
+
+namespace libprojector {
+
+    /**
+     Reads the size of a JPEG or PNG image from its header, without decoding
+     it. Returns false for the other formats (or a broken header).
+     */
+    bool probeImageSize(const std::string& path, cv::Size& size);
+
+    // Size of an image, probed from the header when possible, decoded otherwise
+    cv::Size getImageSize(const std::string& path);
+
+    // imread flags decoding a color image downscaled by `scale` (1, 2, 4 or 8)
+    int getReducedDecodeFlags(int scale);
+
+    /**
+     Depth of the images along a conversion. The high depths keep what the
+     file holds (16 bits PNG or TIFF, float EXR or HDR), half floats halving
+     the memory of the float images; the samplers interpolate in float
+     whatever the storage.
+     */
+    enum ImageDepth {
+        ImageDepth8U,
+        ImageDepth16U,
+        ImageDepthHalf,
+        ImageDepthFloat,
+    };
+
+    // imread flags for `depth`, the reduced decoding (scale > 1) being for 8 bits only
+    int getDecodeFlags(ImageDepth depth, int scale);
+
+    // Converts a decoded image to `depth`, the integer ranges mapping to [0,1] in floats
+    cv::Mat toImageDepth(const cv::Mat& image, ImageDepth depth);
+
+    // The image itself, or its float version for the half floats which can't be encoded
+    cv::Mat toEncodable(const cv::Mat& image);
+
+    // Encoding parameters for the format of `path`, quality being in [0,100]
+    // (ignored for lossless formats, negative for the codec default)
+    std::vector<int> getEncodeParams(const std::string& path, int quality);
+
+    // Decodes the images in parallel, throws if one of them can't be read
+    std::vector<cv::Mat> readImages(ThreadPool& pool, const std::vector<std::string>& paths, int flags);
+
+    // Decodes the 6 sides in parallel, straight into a 6:1 cubemap strip
+    cv::Mat readCubemap(ThreadPool& pool, const std::vector<std::string>& paths, int flags);
+
+    // Encodes the images in parallel, throws if one of them can't be written
+    void writeImages(ThreadPool& pool, const std::vector<std::string>& paths, const std::vector<cv::Mat>& images, int quality);
+
+    // Pool shared by the I/O of the python module
+    ThreadPool& getIOPool();
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_IMAGE_IO_HPP_ */
@@ -0,0 +1,69 @@
+#ifndef LIBPROJECTOR_MULTI_TARGET_HPP_
+#define LIBPROJECTOR_MULTI_TARGET_HPP_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include <libprojector/convertor.hpp>
+#include <libprojector/projections.hpp>
+#include <libprojector/thread_pool.hpp>
+
+namespace libprojector {
+
+    /**
+     Converts one source into several outputs (e.g. a master, a cubemap, a
+     thumbnail and a viewport) in a single pass.
+
+     The source is decoded once, at the scale of the densest target (see
+     getDecodeScale). The less dense targets sample halvings of it, each
+     one computed once from the previous one and shared by the targets of
+     that scale. The tiles of all the targets are sampled as the tasks of
+     one pool, the largest targets first, each target keeping its maps for
+     the next sources with the same geometry. The targets with a fast path
+     (see ProjectionConvertor::convertFast), or any target of an input with
+     view weights, are converted as a whole beforehand.
+     */
+    class MultiTargetConvertor {
+    public:
+        explicit MultiTargetConvertor(ProjectionPtr inProj, int threads = 0);
+
+        // Returns the index of the target in the outputs of convert
+        int addTarget(ProjectionPtr outProj, int interpolation);
+
+        size_t size() const {
+            return targets.size();
+        }
+
+        void setRotation(const Rotation& rotation);
+
+        void set_rotation(double yaw, double pitch, double roll) {
+            setRotation(Rotation::fromEuler(yaw, pitch, roll));
+        }
+
+        // Downscale the source can be decoded at for every target (up to `maxScale`)
+        int getDecodeScale(int maxScale = 8) const;
+
+        /**
+         Convert `src`, the input at any power of two downscale (e.g. decoded
+         at getDecodeScale), into the outputs of all the targets, in the
+         order they were added.
+         */
+        std::vector<cv::Mat> convert(const cv::Mat& src);
+
+    private:
+        struct Target {
+            ProjectionPtr outProj;
+            int interpolation;
+            int scale;  // input downscale dense enough for the target
+            ProjectionConvertorPtr convertor;  // built for the size of the source level it samples
+        };
+
+        ProjectionPtr inProj;
+        std::vector<Target> targets;
+        Rotation rotation;
+        ThreadPool pool;
+    };
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_MULTI_TARGET_HPP_ */
@@ -0,0 +1,73 @@
+#ifndef LIBPROJECTOR_PROGRESSIVE_HPP_
+#define LIBPROJECTOR_PROGRESSIVE_HPP_
+
+#include <functional>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include <libprojector/convertor.hpp>
+#include <libprojector/projections.hpp>
+#include <libprojector/stereo.hpp>
+
+namespace libprojector {
+
+    /**
+     Conversion delivered in stages of increasing resolution, for previews.
+
+     The first stage is at most `previewWidth` wide, each of the next ones
+     `refinement` times as wide, up to the full output. Every stage samples
+     the source at the reduced scale still dense enough for it (the scale to
+     decode the input at, see getStageDecodeScale), but the last one which
+     samples the full input, and keeps its maps for the next images. The preview stages are sampled bilinearly, the last
+     one with the requested interpolation, as convert_image does.
+
+     The maps of the preview stages after the first are interpolated from
+     the ones of the previous stage where they are smooth enough (see
+     ProjectionConvertor::interpolateMaps); the last stage builds its own,
+     so that its output is the one of convert_image.
+     */
+    class ProgressiveConvertor {
+    public:
+        typedef std::function<void(int, const cv::Mat&)> StageCallback;
+
+        ProgressiveConvertor(ProjectionPtr inProj, ProjectionPtr outProj, int previewWidth = 512, int refinement = 4);
+
+        int getStageCount() const {
+            return static_cast<int>(stages.size());
+        }
+
+        // Output size of a stage
+        cv::Size getStageSize(int stage) const;
+
+        // Downscale of the input sampled by a stage
+        int getStageDecodeScale(int stage) const;
+
+        void setRotation(const Rotation& rotation);
+
+        void set_rotation(double yaw, double pitch, double roll) {
+            setRotation(Rotation::fromEuler(yaw, pitch, roll));
+        }
+
+        /**
+         Convert a stage, `src` being the input at any scale (e.g. the full
+         image, or a decode at the scale of the stage), resized when it doesn't
+         match the scale of the stage.
+         */
+        cv::Mat convertStage(const cv::Mat& src, int stage, int interpolation);
+
+        // Same as convertStage for stereo images, as ProjectionConvertor::convert_stereo
+        cv::Mat convertStereoStage(const cv::Mat& src, int stage, StereoLayout inLayout, StereoLayout outLayout,
+                                   int interpolation);
+
+        // Convert all the stages, from the coarsest, and return the last one
+        cv::Mat convert(const cv::Mat& src, int interpolation, const StageCallback& callback);
+
+    private:
+        ProjectionPtr inProj;
+        std::vector<int> decodeScales;
+        std::vector<ProjectionConvertor> stages;
+    };
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_PROGRESSIVE_HPP_ */
@@ -0,0 +1,1321 @@
+#ifndef LIBPROJECTOR_PROJECTIONS_HPP_
+#define LIBPROJECTOR_PROJECTIONS_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+
+#include <libprojector/stereo.hpp>
+
+namespace libprojector {
+
+    struct Ray {
+        double x;
+        double y;
+        double z;
+    };
+
+    struct TexCoords {
+        double u;
+        double v;
+    };
+
+    typedef enum ProjectionType {
+        ProjectionTypeSpherical,
+        ProjectionTypeCubemap,
+        ProjectionTypeEquiAngularCubemap,
+        ProjectionTypeBandedSpherical,
+        ProjectionTypeOctahedral,
+        ProjectionTypeFisheye,
+        ProjectionTypeDualFisheye,
+        ProjectionTypeRegion,
+        ProjectionTypeScaled,
+    } ProjectionType;
+
+    class Projection {
+    public:
+        // Empty virtual destructor for proper cleanup
+        virtual ~Projection() {}
+
+        virtual ProjectionType getType() const = 0;
+        // identifies the geometry, two projections with the same key map the same rays
+        virtual std::string getKey() const = 0;
+        virtual int getWidth() const = 0;
+        virtual int getHeight() const = 0;
+        // range of the sampling density, in pixels per radian
+        virtual double getMinDensity() const = 0;
+        virtual double getMaxDensity() const = 0;
+        virtual void toRay(double u, double v, Ray& r) const = 0;
+        virtual void toTexCoords(Ray r, TexCoords& point) const = 0;
+
+        // Areas of the image outside of the projection, kept black
+        virtual std::vector<cv::Rect> getEmptyAreas() const {
+            return std::vector<cv::Rect>();
+        }
+
+        /**
+         Inputs made of overlapping views which don't cover the whole sphere
+         on their own (e.g. the lenses of a camera) are sampled view by view,
+         and the samples blended with the weight of each view.
+         */
+        virtual bool hasViewWeights() const {
+            return false;
+        }
+
+        virtual int getViewCount() const {
+            return 1;
+        }
+
+        // Coordinates of the ray in a view, returns the weight of the view
+        // there (0 where it doesn't see the ray)
+        virtual double toViewTexCoords(int view, Ray r, TexCoords& point) const {
+            toTexCoords(r, point);
+            return 1;
+        }
+    };
+
+    typedef boost::shared_ptr<Projection> ProjectionPtr;
+
+    class SphericalProjection: public Projection {
+    private:
+        double imageMidWidth;
+        double imageMidHeight;
+        double scale;
+
+    public:
+        SphericalProjection(int _imageWidth, int _imageHeight) : 
+            imageMidWidth(static_cast<double>(_imageWidth)/2),
+            imageMidHeight(static_cast<double>(_imageHeight)/2) {
+                scale = imageMidWidth / M_PI;
+            }
+
+        ProjectionType getType() const {
+            return ProjectionTypeSpherical;
+        }
+
+        std::string getKey() const {
+            std::ostringstream key;
+            key << "spherical:" << getWidth() << "x" << getHeight();
+            return key.str();
+        }
+
+        int getWidth() const {
+            return static_cast<int>(2 * imageMidWidth);
+        }
+
+        int getHeight() const {
+            return static_cast<int>(2 * imageMidHeight);
+        }
+
+        // number of pixels per radian of longitude
+        double getScale() const {
+            return scale;
+        }
+
+        // NB: the rows get denser towards the poles, but that's oversampling
+        // of the same content, the density of the equator is used for both
+        double getMinDensity() const {
+            return scale;
+        }
+
+        double getMaxDensity() const {
+            return scale;
+        }
+
+        void toRay(double u, double v, Ray& r) const {
+            u -= imageMidWidth;
+            v -= imageMidHeight;
+
+            // ensure u-axis negative on the center left, positive on center right
+            // ensure v-axis negative on the center bottom, positive on center top
+            // u *= -1.0;
+            v *= -1.0;
+
+            u /= scale;
+            v /= scale;
+
+            double sinv = sinf(M_PI_2 - v);
+            r.x = sinv * cosf(u);
+            r.y = sinv * sinf(u);
+            r.z = cosf(M_PI_2 - v);
+        }
+
+        void toTexCoords(Ray r, TexCoords& point) const {
+            // NB: we take the asumption the the ray is on the unit sphere
+            double u = scale * atan2f(r.y, r.x);
+            double v = scale * (M_PI_2 - acosf(r.z));
+
+            v *= -1.0;
+
+            u += imageMidWidth;
+            v += imageMidHeight;
+
+            point.u = u;
+            point.v = v;
+        }
+    };
+
+    /**
+     Equirectangular projection whose rows get narrower towards the poles,
+     in bands of latitude, so that the pixels keep about the density of the
+     equator instead of oversampling the poles. For an equator `width`
+     pixels wide (and a sphere `width / 2` rows high):
+
+        latitude     row width    rows per hemisphere
+        0 - 60       width        height / 3
+        60 - 75      width / 2    height / 12
+        75 - 90      width / 4    height / 12
+
+     The 15 degrees bands get round(height / 12) rows, the main band taking
+     the remainder: their edges are within half a row of 60 and 75 degrees,
+     the densities being the ones of the actual edges.
+
+     The bands of each hemisphere are packed into 5/6 of the rows of the
+     equirectangular image, the north bands on top and the south ones at
+     the bottom, the narrower ones followed by a gutter column (g)
+     repeating their first column:
+
+        +-------------+-+------+-+--+
+        | 60N - 75N   |g| 75N+ |g|  |
+        +-------------+-+------+-+--+
+        |        60N - 60S          |
+        +-------------+-+------+-+--+
+        | 60S - 75S   |g| 75S+ |g|  |
+        +-------------+-+------+-+--+
+
+     Each band wraps around on its own: the main one through the wrap of
+     the image, the others through their gutter, so that the bilinear
+     sampling doesn't bleed the neighbouring bands into them.
+     */
+    class BandedSphericalProjection: public Projection {
+    private:
+        SphericalProjection sphere;  // equirectangular coordinates of the rays
+        int width;
+        int bandRows;  // rows of the 15 degrees bands
+
+        struct Band {
+            int x;
+            int y;  // first row in the image
+            int width;
+            int rows;
+            int sphereRow;  // first row in the equirectangular image
+        };
+
+        // the bands, from the north pole to the south pole
+        Band getBand(int index) const {
+            int mainRows = sphere.getHeight() - 4 * bandRows;
+            Band bands[5] = {
+                {width / 2 + 1, 0, width / 4, bandRows, 0},
+                {0, 0, width / 2, bandRows, bandRows},
+                {0, bandRows, width, mainRows, 2 * bandRows},
+                {0, bandRows + mainRows, width / 2, bandRows, 2 * bandRows + mainRows},
+                {width / 2 + 1, bandRows + mainRows, width / 4, bandRows, 3 * bandRows + mainRows},
+            };
+            return bands[index];
+        }
+
+        // density along the rows of a band `bandWidth` wide at the latitude
+        // of the sphere row `sphereRow` (the edge of a band)
+        double getRowDensity(int bandWidth, int sphereRow) const {
+            double latitude = M_PI_2 - sphereRow / sphere.getScale();
+            return sphere.getScale() * bandWidth / width / cos(latitude);
+        }
+
+        int findSphereBand(double sphereRow) const {
+            int mainRows = sphere.getHeight() - 4 * bandRows;
+            if (sphereRow < 2 * bandRows) {
+                return (sphereRow < bandRows) ? 0 : 1;
+            }
+            if (sphereRow < 2 * bandRows + mainRows) {
+                return 2;
+            }
+            return (sphereRow < 3 * bandRows + mainRows) ? 3 : 4;
+        }
+
+        int findImageBand(double u, double v) const {
+            int mainRows = sphere.getHeight() - 4 * bandRows;
+            if (v >= bandRows && v < bandRows + mainRows) {
+                return 2;
+            }
+            bool north = v < bandRows;
+            // the gutter column goes with its band
+            if (u < width / 2 + 1) {
+                return north ? 1 : 3;
+            }
+            return north ? 0 : 4;
+        }
+
+    public:
+        explicit BandedSphericalProjection(int _width) :
+            sphere(_width, _width / 2),
+            width(_width),
+            bandRows(static_cast<int>(round(_width / 24.0))) {
+                if (_width < 24 || _width % 4 != 0) {
+                    throw std::invalid_argument("the width of a banded equirectangular image must be a multiple of 4, from 24");
+                }
+            }
+
+        ProjectionType getType() const {
+            return ProjectionTypeBandedSpherical;
+        }
+
+        std::string getKey() const {
+            std::ostringstream key;
+            key << "banded:" << width;
+            return key.str();
+        }
+
+        int getWidth() const {
+            return width;
+        }
+
+        int getHeight() const {
+            return sphere.getHeight() - 2 * bandRows;
+        }
+
+        // the width of the band over the cosine of the latitude along the
+        // rows, the density of the equator along the columns: lowest at the
+        // equatorward edges of the bands (about 0.97 times the equator at 75
+        // degrees)
+        double getMinDensity() const {
+            return std::min(sphere.getScale(), std::min(getRowDensity(width / 2, 2 * bandRows),
+                                                         getRowDensity(width / 4, bandRows)));
+        }
+
+        // highest at the poleward edges of the main band and of the 60 degrees
+        // bands (about twice the equator), the rows of the pole bands then
+        // converging on the same content as the ones of SphericalProjection
+        double getMaxDensity() const {
+            return std::max(getRowDensity(width, 2 * bandRows), getRowDensity(width / 2, bandRows));
+        }
+
+        void toRay(double u, double v, Ray& r) const {
+            Band band = getBand(findImageBand(u, v));
+            double sphereU = (u - band.x) * width / band.width;
+            double sphereV = v - band.y + band.sphereRow;
+            sphere.toRay(sphereU, sphereV, r);
+        }
+
+        void toTexCoords(Ray r, TexCoords& point) const {
+            TexCoords t;
+            sphere.toTexCoords(r, t);
+            // the band of the closest row
+            Band band = getBand(findSphereBand(t.v + 0.5));
+
+            // wrapped around the band, past its last texel the sampling reads
+            // the first one through the wrap of the image or the gutter
+            double u = fmod(t.u * band.width / width, band.width);
+            if (u < 0) {
+                u += band.width;
+            }
+            double v = t.v - band.sphereRow;
+            point.u = band.x + u;
+            point.v = band.y + std::min(std::max(v, 0.0), band.rows - 1.0);
+        }
+
+        std::vector<cv::Rect> getEmptyAreas() const {
+            std::vector<cv::Rect> areas;
+            // after the pole bands and their gutters
+            int x = width / 2 + width / 4 + 2;
+            areas.push_back(cv::Rect(x, 0, width - x, bandRows));
+            areas.push_back(cv::Rect(x, getHeight() - bandRows, width - x, bandRows));
+            return areas;
+        }
+    };
+
+    typedef enum CubemapLayout {
+        CubemapLayoutStrip,
+        CubemapLayout3x2,
+        CubemapLayoutHorizontalCross,
+        CubemapLayoutVerticalCross,
+    } CubemapLayout;
+
+    /**
+     Cubemap projection, the sides being indexed +x, -x, +y, -y, +z, -z
+     (x forward, y right and z up) and placed along one of these layouts
+
+     Strip (6x1)
+
+      -------- -------- -------- -------- -------- --------
+     |   +x   |   -x   |   +y   |   -y   |   +z   |   -z   |
+     |  side  |  side  |  side  |  side  |  side  |  side  |
+      -------- -------- -------- -------- -------- --------
+
+     3x2                              Horizontal cross (4x3)
+
+      -------- -------- --------                -------- 
+     |   -y   |   +x   |   +y   |              |  +z  1 |
+     |        |        |        |      -------- -------- -------- --------
+      -------- -------- --------      |   -y   |   +x   |   +y   |   -x   |
+     |  -z  2 |  -x  1 |   +z   |      |        |        |        |        |
+     |        |        |        |      -------- -------- -------- --------
+      -------- -------- --------               |  -z  3 |
+                                                -------- 
+
+     Vertical cross (3x4): the horizontal cross, with -x below -z (2).
+
+     The sides of the strip are the reference orientation, the number next to
+     a side being the quarter turns (clockwise) of its content in the layout,
+     so that the content is continuous along the rows (and the columns of the
+     crosses).
+     The cells without side are left black.
+
+     With a border padding, the content of a side covers its cell minus the
+     padding on input. On output, the content covers the whole cell unless
+     the padding is rendered as `gutters`: the rays of the padding then go
+     on past the edges of the face, the gutters holding the neighbouring
+     sides as seen from the center of the cube rather than its edges
+     repeated, so that such an output is also a padded input.
+     */
+    class CubemapProjection: public Projection {
+    private:
+        double sideWidth;
+        // pixels around the content of each side: the interpolation can read
+        // them on input, and they are rendered as gutters on output if asked
+        double sideBorderPadding;
+        CubemapLayout layout;
+        bool gutters;
+
+        int columns;
+        int rows;
+        int cellSides[16];  // side of each cell of the layout, or -1
+        cv::Point sideCells[6];
+        // axes of the sides in the layout, see getSideAxes
+        cv::Vec3d sideNormals[6];
+        cv::Vec3d sideUAxes[6];
+        cv::Vec3d sideVAxes[6];
+
+        void setupLayout() {
+            // column, row and quarter turns of each side
+            static const int placements[4][6][3] = {
+                {{0, 0, 0}, {1, 0, 0}, {2, 0, 0}, {3, 0, 0}, {4, 0, 0}, {5, 0, 0}},  // strip
+                {{1, 0, 0}, {1, 1, 1}, {2, 0, 0}, {0, 0, 0}, {2, 1, 0}, {0, 1, 2}},  // 3x2
+                {{1, 1, 0}, {3, 1, 0}, {2, 1, 0}, {0, 1, 0}, {1, 0, 1}, {1, 2, 3}},  // horizontal cross
+                {{1, 1, 0}, {1, 3, 2}, {2, 1, 0}, {0, 1, 0}, {1, 0, 1}, {1, 2, 3}},  // vertical cross
+            };
+            static const int sizes[4][2] = {{6, 1}, {3, 2}, {4, 3}, {3, 4}};
+            if (layout < CubemapLayoutStrip || layout > CubemapLayoutVerticalCross) {
+                throw std::invalid_argument("unknown cubemap layout");
+            }
+
+            columns = sizes[layout][0];
+            rows = sizes[layout][1];
+            std::fill(cellSides, cellSides + 16, -1);
+
+            for (int side = 0; side < 6; ++side) {
+                const int* placement = placements[layout][side];
+                sideCells[side] = cv::Point(placement[0], placement[1]);
+                cellSides[placement[1] * columns + placement[0]] = side;
+
+                cv::Vec3d n, a, b;
+                getSideAxes(side, n, a, b);
+                sideNormals[side] = n;
+                // turning the content clockwise turns its axes the other way
+                switch (placement[2]) {
+                    case 0: sideUAxes[side] = a; sideVAxes[side] = b; break;
+                    case 1: sideUAxes[side] = -b; sideVAxes[side] = a; break;
+                    case 2: sideUAxes[side] = -a; sideVAxes[side] = -b; break;
+                    case 3: sideUAxes[side] = b; sideVAxes[side] = -a; break;
+                }
+            }
+        }
+
+    protected:
+        // Position in a side ([-1,1]) of a point of the face of the cube at
+        // `t` ([-1,1]), and back: the sides are the faces as they are here
+        virtual double toSideCoord(double t) const {
+            return t;
+        }
+
+        virtual double fromSideCoord(double c) const {
+            return c;
+        }
+
+    public:
+        CubemapProjection(int _sideWidth, int _sideBorderPadding, CubemapLayout _layout = CubemapLayoutStrip,
+                          bool _gutters = false) :
+            sideWidth(static_cast<double>(_sideWidth)),
+            sideBorderPadding(static_cast<double>(_sideBorderPadding)),
+            layout(_layout),
+            gutters(_gutters) {
+                if (2 * _sideBorderPadding >= _sideWidth) {
+                    throw std::invalid_argument("the border padding leaves no content in the cubemap sides");
+                }
+                setupLayout();
+            }
+
+        ProjectionType getType() const {
+            return ProjectionTypeCubemap;
+        }
+
+        std::string getKey() const {
+            std::ostringstream key;
+            key << "cubemap:" << getSideWidth() << ":" << getSideBorderPadding() << ":" << layout << ":" << gutters;
+            return key.str();
+        }
+
+        int getSideWidth() const {
+            return static_cast<int>(sideWidth);
+        }
+
+        int getSideBorderPadding() const {
+            return static_cast<int>(sideBorderPadding);
+        }
+
+        CubemapLayout getLayout() const {
+            return layout;
+        }
+
+        bool hasGutters() const {
+            return gutters;
+        }
+
+        static int getLayoutColumns(CubemapLayout layout) {
+            return (layout == CubemapLayoutStrip) ? 6 : (layout == CubemapLayoutHorizontalCross) ? 4 : 3;
+        }
+
+        // at the center of a side, half a side per radian
+        double getMinDensity() const {
+            return (sideWidth - 2 * sideBorderPadding) / 2;
+        }
+
+        // at the corners of the sides, 3/sqrt(2) times the density of the center
+        double getMaxDensity() const {
+            return (sideWidth - 2 * sideBorderPadding) / 2 * 3 / M_SQRT2;
+        }
+
+        // Axes of a side in the ray space, in the orientation of the strip:
+        // the normal, the direction of increasing u and the direction of
+        // increasing v (see toRay)
+        static void getSideAxes(int side, cv::Vec3d& normal, cv::Vec3d& uAxis, cv::Vec3d& vAxis) {
+            static const double axes[6][9] = {
+                { 1, 0, 0,    0, 1, 0,    0, 0,-1},  // +x
+                {-1, 0, 0,    0,-1, 0,    0, 0,-1},  // -x
+                { 0, 1, 0,   -1, 0, 0,    0, 0,-1},  // +y
+                { 0,-1, 0,    1, 0, 0,    0, 0,-1},  // -y
+                { 0, 0, 1,    1, 0, 0,    0,-1, 0},  // +z
+                { 0, 0,-1,    1, 0, 0,    0, 1, 0},  // -z
+            };
+            const double* a = axes[side];
+            normal = cv::Vec3d(a[0], a[1], a[2]);
+            uAxis = cv::Vec3d(a[3], a[4], a[5]);
+            vAxis = cv::Vec3d(a[6], a[7], a[8]);
+        }
+
+        // Axes of a side as placed in the layout
+        void getLayoutSideAxes(int side, cv::Vec3d& normal, cv::Vec3d& uAxis, cv::Vec3d& vAxis) const {
+            normal = sideNormals[side];
+            uAxis = sideUAxes[side];
+            vAxis = sideVAxes[side];
+        }
+
+        // Area of a side in the image
+        cv::Rect getSideRect(int side) const {
+            int width = getSideWidth();
+            return cv::Rect(sideCells[side].x * width, sideCells[side].y * width, width, width);
+        }
+
+        std::vector<cv::Rect> getEmptyAreas() const {
+            std::vector<cv::Rect> areas;
+            int width = getSideWidth();
+            for (int cell = 0; cell < columns * rows; ++cell) {
+                if (cellSides[cell] < 0) {
+                    areas.push_back(cv::Rect((cell % columns) * width, (cell / columns) * width, width, width));
+                }
+            }
+            return areas;
+        }
+
+        int getWidth() const {
+            return static_cast<int>(columns * sideWidth);
+        }
+
+        int getHeight() const {
+            return static_cast<int>(rows * sideWidth);
+        }
+
+        // Side facing the ray, and the coordinate of the ray along its normal
+        static int selectSide(const Ray& r, double& maxAxis) {
+            double absX = fabs(r.x);
+            double absY = fabs(r.y);
+            double absZ = fabs(r.z);
+
+            if (absX >= absY && absX >= absZ) {
+                maxAxis = absX;
+                return (r.x > 0) ? 0 : 1;
+            }
+            if (absY >= absZ) {
+                maxAxis = absY;
+                return (r.y > 0) ? 2 : 3;
+            }
+            maxAxis = absZ;
+            return (r.z > 0) ? 4 : 5;
+        }
+
+        void toRay(double u, double v, Ray& ray) const {
+            int column = floor(u / sideWidth);
+            int row = floor(v / sideWidth);
+
+            ray.x = 0;
+            ray.y = 0;
+            ray.z = 0;
+
+            // outside of the sides, the ray is left null
+            if (column < 0 || column >= columns || row < 0 || row >= rows) {
+                return;
+            }
+            int side = cellSides[row * columns + column];
+            if (side < 0) {
+                return;
+            }
+
+            // local (side) coords [-1,1] over the content (beyond in the
+            // gutters), then on the plane of the face of the cube
+            double padding = gutters ? sideBorderPadding : 0;
+            double contentWidth = sideWidth - 2 * padding;
+            double uu = fromSideCoord(2.0 * ((u - (column * sideWidth) - padding) / contentWidth) - 1.0);
+            double vv = fromSideCoord(2.0 * ((v - (row * sideWidth) - padding) / contentWidth) - 1.0);
+
+            double maxAxis = sqrt(1.0 / (1.0 + uu*uu + vv*vv));
+
+            cv::Vec3d direction = sideNormals[side] + uu * sideUAxes[side] + vv * sideVAxes[side];
+            ray.x = direction[0] * maxAxis;
+            ray.y = direction[1] * maxAxis;
+            ray.z = direction[2] * maxAxis;
+        }
+
+        void toTexCoords(Ray r, TexCoords& point) const {
+            double maxAxis;
+            int side = selectSide(r, maxAxis);
+            cv::Vec3d ray(r.x, r.y, r.z);
+
+            // convert range from [-1,1] to [0,1]
+            double u = 0.5 * (toSideCoord(ray.dot(sideUAxes[side]) / maxAxis) + 1.0);
+            double v = 0.5 * (toSideCoord(ray.dot(sideVAxes[side]) / maxAxis) + 1.0);
+
+            // convert the (u,v) to the cell of the side in the layout
+            point.u = sideCells[side].x * sideWidth + sideBorderPadding + u * (sideWidth - 2*sideBorderPadding);
+            point.v = sideCells[side].y * sideWidth + sideBorderPadding + v * (sideWidth - 2*sideBorderPadding);
+        }
+    };
+
+    /**
+     Equi-angular cubemap (EAC): the sides of the cubemap and its layouts,
+     with the positions on the faces of the cube warped so that the pixels
+     cover the same angle along the axes of the sides, instead of getting
+     denser towards the edges (c = 4/pi * atan(t)).
+     */
+    class EquiAngularCubemapProjection: public CubemapProjection {
+    protected:
+        double toSideCoord(double t) const {
+            return 4 / M_PI * atan(t);
+        }
+
+        double fromSideCoord(double c) const {
+            return tan(M_PI / 4 * c);
+        }
+
+    public:
+        EquiAngularCubemapProjection(int _sideWidth, int _sideBorderPadding, CubemapLayout _layout = CubemapLayoutStrip,
+                                     bool _gutters = false) :
+            CubemapProjection(_sideWidth, _sideBorderPadding, _layout, _gutters) {
+                // the gutters would go past a quarter turn from the center
+                if (_gutters && 4 * _sideBorderPadding >= _sideWidth) {
+                    throw std::invalid_argument("the border padding of an equi-angular cubemap must be under a quarter of the sides");
+                }
+            }
+
+        ProjectionType getType() const {
+            return ProjectionTypeEquiAngularCubemap;
+        }
+
+        std::string getKey() const {
+            std::ostringstream key;
+            key << "eac:" << getSideWidth() << ":" << getSideBorderPadding() << ":" << getLayout() << ":" << hasGutters();
+            return key.str();
+        }
+
+        // 4/pi times the half side per radian along the axes, down to
+        // sqrt(3)/2 of it across the corners
+        double getMinDensity() const {
+            return (getSideWidth() - 2 * getSideBorderPadding()) * sqrt(3.0) / M_PI;
+        }
+
+        // up to 3/2 of the center along the diagonals of the corners
+        double getMaxDensity() const {
+            return (getSideWidth() - 2 * getSideBorderPadding()) * 3 / M_PI;
+        }
+    };
+
+    /**
+     Octahedral map: the rays are projected on an octahedron (normalized by
+     |x| + |y| + |z|), whose upper half is the diamond at the center of a
+     square image and the lower half is folded over its corners. The zenith
+     (+z) is at the center, forward (+x) up and right (+y) on the right,
+     the nadir at the corners. Both ways only take absolute values and
+     divisions, without any trigonometry.
+
+     `borderPadding` pixels of the square are gutters around the content,
+     filled with the continuation of the map across the fold lines of its
+     edges (the edges of the square mirror around their middle), so that the
+     filtering of the clients doesn't need any care at the edges. Without
+     gutters, the sampling is clamped to the edges.
+     */
+    class OctahedralProjection: public Projection {
+    private:
+        int width;
+        int borderPadding;
+
+        static double sign(double a) {
+            return (a < 0) ? -1.0 : 1.0;
+        }
+
+        double getContentWidth() const {
+            return width - 2 * borderPadding;
+        }
+
+    public:
+        OctahedralProjection(int _width, int _borderPadding = 0) :
+            width(_width),
+            borderPadding(_borderPadding) {
+                if (_borderPadding < 0 || 4 * _borderPadding >= _width) {
+                    throw std::invalid_argument("the border padding of an octahedral map must be under a quarter of its width");
+                }
+            }
+
+        ProjectionType getType() const {
+            return ProjectionTypeOctahedral;
+        }
+
+        std::string getKey() const {
+            std::ostringstream key;
+            key << "octahedral:" << width << ":" << borderPadding;
+            return key.str();
+        }
+
+        int getWidth() const {
+            return width;
+        }
+
+        int getHeight() const {
+            return width;
+        }
+
+        int getBorderPadding() const {
+            return borderPadding;
+        }
+
+        // a sixth of the content per radian at the centers of the faces of
+        // the octahedron, up to about 0.82 of it across the folds
+        double getMinDensity() const {
+            return getContentWidth() / 6;
+        }
+
+        double getMaxDensity() const {
+            return getContentWidth() * 0.82;
+        }
+
+        void toRay(double u, double v, Ray& r) const {
+            // to [-1, 1] on the content
+            double content = getContentWidth();
+            double a = (u - borderPadding + 0.5) * 2 / content - 1;
+            double b = (v - borderPadding + 0.5) * 2 / content - 1;
+
+            // gutters: continuation across the edges
+            if (a > 1) {
+                a = 2 - a;
+                b = -b;
+            } else if (a < -1) {
+                a = -2 - a;
+                b = -b;
+            }
+            if (b > 1) {
+                a = -a;
+                b = 2 - b;
+            } else if (b < -1) {
+                a = -a;
+                b = -2 - b;
+            }
+
+            double c = 1 - fabs(a) - fabs(b);
+            if (c < 0) {
+                double unfoldedA = (1 - fabs(b)) * sign(a);
+                b = (1 - fabs(a)) * sign(b);
+                a = unfoldedA;
+            }
+
+            double n = sqrt(a * a + b * b + c * c);
+            r.x = -b / n;
+            r.y = a / n;
+            r.z = c / n;
+        }
+
+        void toTexCoords(Ray r, TexCoords& point) const {
+            double a = r.y;
+            double b = -r.x;
+            double s = fabs(a) + fabs(b) + fabs(r.z);
+            a /= s;
+            b /= s;
+            if (r.z < 0) {
+                double foldedA = (1 - fabs(b)) * sign(a);
+                b = (1 - fabs(a)) * sign(b);
+                a = foldedA;
+            }
+
+            double content = getContentWidth();
+            double u = (a + 1) / 2 * content - 0.5;
+            double v = (b + 1) / 2 * content - 0.5;
+            if (borderPadding == 0) {
+                u = std::min(std::max(u, 0.0), content - 1);
+                v = std::min(std::max(v, 0.0), content - 1);
+            }
+            point.u = u + borderPadding;
+            point.v = v + borderPadding;
+        }
+    };
+
+    typedef enum FisheyeModel {
+        FisheyeModelEquidistant,  // r = f * theta
+        FisheyeModelEquisolid,    // r = 2 * f * sin(theta / 2)
+    } FisheyeModel;
+
+    /**
+     Image of a fisheye lens, whose image circle of `radius` pixels around
+     (`centerX`, `centerY`) covers a field of view of `fov` radians. The lens
+     looks towards +x (its right towards +y, its top towards +z), turned by
+     its rotation, as given by a calibration.
+
+     The rays out of the field of view have no weight, the weight fading
+     out over the last `feather` radians when blending several lenses.
+     */
+    class FisheyeProjection: public Projection {
+    private:
+        int width;
+        int height;
+        FisheyeModel model;
+        double fov;
+        double centerX;
+        double centerY;
+        double radius;
+        double feather;
+        cv::Matx33d rotation;  // lens to ray space
+
+        // distance to the center for an angle from the axis, up to a scale
+        double toRadius(double theta) const {
+            return (model == FisheyeModelEquisolid) ? 2 * sin(theta / 2) : theta;
+        }
+
+        double fromRadius(double r) const {
+            return (model == FisheyeModelEquisolid) ? 2 * asin(std::min(r / 2, 1.0)) : r;
+        }
+
+        // pixels per unit of toRadius
+        double getFocal() const {
+            return radius / toRadius(fov / 2);
+        }
+
+    public:
+        FisheyeProjection(int _width, int _height, FisheyeModel _model, double _fov,
+                          double _centerX, double _centerY, double _radius, double _feather = 0) :
+            width(_width),
+            height(_height),
+            model(_model),
+            fov(_fov),
+            centerX(_centerX),
+            centerY(_centerY),
+            radius(_radius),
+            feather(_feather),
+            rotation(cv::Matx33d::eye()) {
+                if (fov <= 0 || fov > 2 * M_PI || radius <= 0 || feather < 0) {
+                    throw std::invalid_argument("the field of view must be in ]0, 360] degrees, with a positive radius");
+                }
+            }
+
+        // Lens centered in an image of `width` x `height`, its image circle fitting the image
+        static FisheyeProjection centered(int width, int height, FisheyeModel model, double fov, double feather = 0) {
+            return FisheyeProjection(width, height, model, fov, (width - 1) / 2.0, (height - 1) / 2.0,
+                                     std::min(width, height) / 2.0, feather);
+        }
+
+        void setRotation(const cv::Matx33d& _rotation) {
+            rotation = _rotation;
+        }
+
+        const cv::Matx33d& getRotation() const {
+            return rotation;
+        }
+
+        double getCenterX() const {
+            return centerX;
+        }
+
+        double getCenterY() const {
+            return centerY;
+        }
+
+        double getRadius() const {
+            return radius;
+        }
+
+        ProjectionType getType() const {
+            return ProjectionTypeFisheye;
+        }
+
+        std::string getKey() const {
+            std::ostringstream key;
+            key.precision(17);
+            key << "fisheye:" << width << "x" << height << ":" << model << ":" << fov << ":"
+                << centerX << "," << centerY << ":" << radius << ":" << feather;
+            for (int i = 0; i < 9; ++i) {
+                key << (i ? "," : ":") << rotation.val[i];
+            }
+            return key.str();
+        }
+
+        int getWidth() const {
+            return width;
+        }
+
+        int getHeight() const {
+            return height;
+        }
+
+        // radially f * cos(theta/2) for the equisolid lenses, f for the
+        // equidistant ones, less than tangentially
+        double getMinDensity() const {
+            return getFocal() * ((model == FisheyeModelEquisolid) ? cos(fov / 4) : 1.0);
+        }
+
+        // tangentially at the edge of the field of view (bounded near 360
+        // degrees, where the ring of the rays behind the lens gets tiny)
+        double getMaxDensity() const {
+            double theta = std::min(fov / 2, 0.9 * M_PI);
+            if (model == FisheyeModelEquisolid) {
+                return getFocal() / cos(theta / 2);
+            }
+            return getFocal() * theta / sin(theta);
+        }
+
+        double getWeight(const Ray& r) const {
+            double x = rotation(0,0) * r.x + rotation(1,0) * r.y + rotation(2,0) * r.z;
+            double y = rotation(0,1) * r.x + rotation(1,1) * r.y + rotation(2,1) * r.z;
+            double z = rotation(0,2) * r.x + rotation(1,2) * r.y + rotation(2,2) * r.z;
+            double margin = fov / 2 - atan2(sqrt(y * y + z * z), x);
+            if (feather == 0) {
+                return (margin >= 0) ? 1 : 0;
+            }
+            return std::min(std::max(margin / feather, 0.0), 1.0);
+        }
+
+        void toRay(double u, double v, Ray& r) const {
+            double dx = u - centerX;
+            double dy = v - centerY;
+            double d = sqrt(dx * dx + dy * dy);
+            double theta = fromRadius(d / getFocal());
+
+            // in the lens space
+            double x = cos(theta);
+            double y = 0;
+            double z = 0;
+            if (d > 0) {
+                y = sin(theta) * dx / d;
+                z = -sin(theta) * dy / d;
+            }
+
+            r.x = rotation(0,0) * x + rotation(0,1) * y + rotation(0,2) * z;
+            r.y = rotation(1,0) * x + rotation(1,1) * y + rotation(1,2) * z;
+            r.z = rotation(2,0) * x + rotation(2,1) * y + rotation(2,2) * z;
+        }
+
+        // the rays out of the field of view are clamped to the image circle
+        void toTexCoords(Ray r, TexCoords& point) const {
+            double x = rotation(0,0) * r.x + rotation(1,0) * r.y + rotation(2,0) * r.z;
+            double y = rotation(0,1) * r.x + rotation(1,1) * r.y + rotation(2,1) * r.z;
+            double z = rotation(0,2) * r.x + rotation(1,2) * r.y + rotation(2,2) * r.z;
+
+            double d = sqrt(y * y + z * z);
+            double theta = std::min(atan2(d, x), fov / 2);
+            double u = centerX;
+            double v = centerY;
+            if (d > 0) {
+                double distance = getFocal() * toRadius(theta);
+                u += distance * y / d;
+                v -= distance * z / d;
+            }
+            point.u = std::min(std::max(u, 0.0), width - 1.0);
+            point.v = std::min(std::max(v, 0.0), height - 1.0);
+        }
+
+        bool hasViewWeights() const {
+            return true;
+        }
+
+        double toViewTexCoords(int view, Ray r, TexCoords& point) const {
+            toTexCoords(r, point);
+            return getWeight(r);
+        }
+    };
+
+    /**
+     Frame of a camera with two fisheye lenses, blended with feathering in
+     the areas both lenses see. By default (see centered), the frame is 2:1,
+     with the image circle of the front lens (towards +x) in its left half
+     and the one of the back lens in the right half.
+     */
+    class DualFisheyeProjection: public Projection {
+    private:
+        FisheyeProjection front;
+        FisheyeProjection back;
+
+        // relative distance of a pixel to the center of the image circle of a lens
+        static double getCircleDistance(const FisheyeProjection& lens, double u, double v) {
+            double dx = u - lens.getCenterX();
+            double dy = v - lens.getCenterY();
+            return sqrt(dx * dx + dy * dy) / lens.getRadius();
+        }
+
+    public:
+        DualFisheyeProjection(const FisheyeProjection& _front, const FisheyeProjection& _back) :
+            front(_front),
+            back(_back) {
+                if (front.getWidth() != back.getWidth() || front.getHeight() != back.getHeight()) {
+                    throw std::invalid_argument("the lenses of a dual fisheye frame must share its size");
+                }
+            }
+
+        static DualFisheyeProjection centered(int width, int height, FisheyeModel model, double fov, double feather) {
+            double radius = std::min(width / 4.0, height / 2.0);
+            double centerY = (height - 1) / 2.0;
+            FisheyeProjection front(width, height, model, fov, (width / 2 - 1) / 2.0, centerY, radius, feather);
+            FisheyeProjection back(width, height, model, fov, (3 * width / 2 - 1) / 2.0, centerY, radius, feather);
+            // facing backwards, its right being the left of the front lens
+            back.setRotation(cv::Matx33d(-1, 0, 0,
+                                         0, -1, 0,
+                                         0, 0, 1));
+            return DualFisheyeProjection(front, back);
+        }
+
+        const FisheyeProjection& getLens(int lens) const {
+            if (lens < 0 || lens > 1) {
+                throw std::out_of_range("a dual fisheye has 2 lenses");
+            }
+            return (lens == 0) ? front : back;
+        }
+
+        void setLens(int lens, const FisheyeProjection& projection) {
+            *this = (lens == 0) ? DualFisheyeProjection(projection, back) : DualFisheyeProjection(front, projection);
+        }
+
+        ProjectionType getType() const {
+            return ProjectionTypeDualFisheye;
+        }
+
+        std::string getKey() const {
+            return "dual(" + front.getKey() + ";" + back.getKey() + ")";
+        }
+
+        int getWidth() const {
+            return front.getWidth();
+        }
+
+        int getHeight() const {
+            return front.getHeight();
+        }
+
+        double getMinDensity() const {
+            return std::min(front.getMinDensity(), back.getMinDensity());
+        }
+
+        double getMaxDensity() const {
+            return std::max(front.getMaxDensity(), back.getMaxDensity());
+        }
+
+        // the pixels of the frame belong to the lens of the closest image circle
+        void toRay(double u, double v, Ray& r) const {
+            bool isFront = getCircleDistance(front, u, v) <= getCircleDistance(back, u, v);
+            (isFront ? front : back).toRay(u, v, r);
+        }
+
+        // single sample, from the lens seeing the ray the best
+        void toTexCoords(Ray r, TexCoords& point) const {
+            bool isFront = front.getWeight(r) >= back.getWeight(r);
+            (isFront ? front : back).toTexCoords(r, point);
+        }
+
+        bool hasViewWeights() const {
+            return true;
+        }
+
+        int getViewCount() const {
+            return 2;
+        }
+
+        double toViewTexCoords(int view, Ray r, TexCoords& point) const {
+            return getLens(view).toViewTexCoords(0, r, point);
+        }
+    };
+
+    /**
+     Sub-rectangle of the image of another projection, in the coordinates
+     of that image, so that a convertor only builds the maps of the region
+     (e.g. a side of a cubemap, or a strip of an equirectangular image).
+     */
+    class RegionProjection: public Projection {
+    private:
+        ProjectionPtr base;
+        cv::Rect region;
+
+    public:
+        RegionProjection(ProjectionPtr _base, const cv::Rect& _region) :
+            base(_base),
+            region(_region) {
+                cv::Rect bounds(0, 0, base->getWidth(), base->getHeight());
+                if (region.area() <= 0 || (region & bounds) != region) {
+                    throw std::invalid_argument("the region must be a non empty rectangle within the image");
+                }
+            }
+
+        ProjectionType getType() const {
+            return ProjectionTypeRegion;
+        }
+
+        std::string getKey() const {
+            std::ostringstream key;
+            key << base->getKey() << "[" << region.x << "," << region.y << "," << region.width << "x" << region.height << "]";
+            return key.str();
+        }
+
+        ProjectionPtr getBase() const {
+            return base;
+        }
+
+        const cv::Rect& getRegion() const {
+            return region;
+        }
+
+        int getWidth() const {
+            return region.width;
+        }
+
+        int getHeight() const {
+            return region.height;
+        }
+
+        double getMinDensity() const {
+            return base->getMinDensity();
+        }
+
+        double getMaxDensity() const {
+            return base->getMaxDensity();
+        }
+
+        void toRay(double u, double v, Ray& r) const {
+            base->toRay(u + region.x, v + region.y, r);
+        }
+
+        void toTexCoords(Ray r, TexCoords& point) const {
+            base->toTexCoords(r, point);
+            point.u -= region.x;
+            point.v -= region.y;
+        }
+
+        bool hasViewWeights() const {
+            return base->hasViewWeights();
+        }
+
+        int getViewCount() const {
+            return base->getViewCount();
+        }
+
+        double toViewTexCoords(int view, Ray r, TexCoords& point) const {
+            double weight = base->toViewTexCoords(view, r, point);
+            point.u -= region.x;
+            point.v -= region.y;
+            return weight;
+        }
+
+        std::vector<cv::Rect> getEmptyAreas() const {
+            std::vector<cv::Rect> baseAreas = base->getEmptyAreas();
+            std::vector<cv::Rect> areas;
+            for (size_t i = 0; i < baseAreas.size(); ++i) {
+                cv::Rect area = baseAreas[i] & region;
+                if (area.area() > 0) {
+                    areas.push_back(area - region.tl());
+                }
+            }
+            return areas;
+        }
+    };
+
+    /**
+     Projection of the image of another projection resized to `width` x
+     `height`, the pixel centers being scaled as with cv::resize.
+     */
+    class ScaledProjection: public Projection {
+    private:
+        ProjectionPtr base;
+        int width;
+        int height;
+        double scaleX;  // base pixels per pixel
+        double scaleY;
+
+    public:
+        ScaledProjection(ProjectionPtr _base, int _width, int _height) :
+            base(_base),
+            width(_width),
+            height(_height) {
+                if (width <= 0 || height <= 0) {
+                    throw std::invalid_argument("the scaled size can't be empty");
+                }
+                scaleX = static_cast<double>(base->getWidth()) / width;
+                scaleY = static_cast<double>(base->getHeight()) / height;
+            }
+
+        ProjectionType getType() const {
+            return ProjectionTypeScaled;
+        }
+
+        std::string getKey() const {
+            std::ostringstream key;
+            key << base->getKey() << "/" << width << "x" << height;
+            return key.str();
+        }
+
+        ProjectionPtr getBase() const {
+            return base;
+        }
+
+        int getWidth() const {
+            return width;
+        }
+
+        int getHeight() const {
+            return height;
+        }
+
+        double getMinDensity() const {
+            return base->getMinDensity() / std::max(scaleX, scaleY);
+        }
+
+        double getMaxDensity() const {
+            return base->getMaxDensity() / std::min(scaleX, scaleY);
+        }
+
+        void toRay(double u, double v, Ray& r) const {
+            base->toRay((u + 0.5) * scaleX - 0.5, (v + 0.5) * scaleY - 0.5, r);
+        }
+
+        void toTexCoords(Ray r, TexCoords& point) const {
+            base->toTexCoords(r, point);
+            point.u = (point.u + 0.5) / scaleX - 0.5;
+            point.v = (point.v + 0.5) / scaleY - 0.5;
+        }
+
+        bool hasViewWeights() const {
+            return base->hasViewWeights();
+        }
+
+        int getViewCount() const {
+            return base->getViewCount();
+        }
+
+        double toViewTexCoords(int view, Ray r, TexCoords& point) const {
+            double weight = base->toViewTexCoords(view, r, point);
+            point.u = (point.u + 0.5) / scaleX - 0.5;
+            point.v = (point.v + 0.5) / scaleY - 0.5;
+            return weight;
+        }
+
+        // the pixels partly covered by an empty area are kept
+        std::vector<cv::Rect> getEmptyAreas() const {
+            std::vector<cv::Rect> baseAreas = base->getEmptyAreas();
+            std::vector<cv::Rect> areas;
+            for (size_t i = 0; i < baseAreas.size(); ++i) {
+                const cv::Rect& area = baseAreas[i];
+                int x0 = static_cast<int>(ceil(area.x / scaleX));
+                int y0 = static_cast<int>(ceil(area.y / scaleY));
+                int x1 = static_cast<int>(floor((area.x + area.width) / scaleX));
+                int y1 = static_cast<int>(floor((area.y + area.height) / scaleY));
+                if (x1 > x0 && y1 > y0) {
+                    areas.push_back(cv::Rect(x0, y0, x1 - x0, y1 - y0));
+                }
+            }
+            return areas;
+        }
+    };
+
+    /**
+     Projection described independently of the image size, to create the
+     projection matching an image once its size is known. The sizing rules
+     are the ones of the python classes in projections.py, the projection
+     created being the one of an eye for the stereo images.
+
+     The fisheye images are square, with the image circle fitting them, and
+     the dual fisheye frames 2:1 (see DualFisheyeProjection::centered).
+     */
+    struct ProjectionSpec {
+        ProjectionType type;
+        int borderPadding;
+        bool gutters;  // of the cubemaps, see CubemapProjection
+        CubemapLayout layout;
+        StereoLayout stereo;
+        FisheyeModel lensModel;
+        double lensFov;  // radians
+        double lensFeather;
+
+        ProjectionSpec(ProjectionType _type = ProjectionTypeSpherical, int _borderPadding = 0,
+                       CubemapLayout _layout = CubemapLayoutStrip, StereoLayout _stereo = StereoLayoutMono) :
+            type(_type),
+            borderPadding(_borderPadding),
+            gutters(false),
+            layout(_layout),
+            stereo(_stereo),
+            lensModel(FisheyeModelEquidistant),
+            lensFov(M_PI),
+            lensFeather(0) {}
+
+        // lenses of the fisheye projections, the angles being in degrees
+        void setLens(FisheyeModel model, double fov, double feather) {
+            lensModel = model;
+            lensFov = fov * M_PI / 180;
+            lensFeather = feather * M_PI / 180;
+        }
+
+        ProjectionPtr create(int imageWidth) const {
+            imageWidth = getStereoEyeWidth(imageWidth, stereo);
+            switch (type) {
+                case ProjectionTypeSpherical:
+                    return ProjectionPtr(new SphericalProjection(imageWidth, imageWidth / 2));
+                case ProjectionTypeCubemap:
+                    return ProjectionPtr(new CubemapProjection(imageWidth / CubemapProjection::getLayoutColumns(layout),
+                                                               borderPadding, layout, gutters));
+                case ProjectionTypeEquiAngularCubemap:
+                    return ProjectionPtr(new EquiAngularCubemapProjection(
+                        imageWidth / CubemapProjection::getLayoutColumns(layout), borderPadding, layout, gutters));
+                case ProjectionTypeBandedSpherical:
+                    return ProjectionPtr(new BandedSphericalProjection(imageWidth));
+                case ProjectionTypeOctahedral:
+                    return ProjectionPtr(new OctahedralProjection(imageWidth, borderPadding));
+                case ProjectionTypeFisheye:
+                    return ProjectionPtr(new FisheyeProjection(
+                        FisheyeProjection::centered(imageWidth, imageWidth, lensModel, lensFov, lensFeather)));
+                case ProjectionTypeDualFisheye:
+                    return ProjectionPtr(new DualFisheyeProjection(
+                        DualFisheyeProjection::centered(imageWidth, imageWidth / 2, lensModel, lensFov, lensFeather)));
+                case ProjectionTypeRegion:
+                case ProjectionTypeScaled:
+                    // made from an existing projection
+                    break;
+            }
+            throw std::invalid_argument("unknown projection type");
+        }
+    };
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_PROJECTIONS_HPP_ */
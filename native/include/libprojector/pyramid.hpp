@@ -0,0 +1,96 @@
+#ifndef LIBPROJECTOR_PYRAMID_HPP_
+#define LIBPROJECTOR_PYRAMID_HPP_
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include <libprojector/convertor.hpp>
+#include <libprojector/projections.hpp>
+#include <libprojector/ray_field.hpp>
+#include <libprojector/sampler.hpp>
+#include <libprojector/thread_pool.hpp>
+
+namespace libprojector {
+
+    /**
+     Writes the sides of a cubemap output as Deep Zoom tile pyramids, in one
+     pass over the source.
+
+     Only the finest level is converted, tile by tile, the maps of each tile
+     being built from the rays of its region cut from the ray field of its
+     side (built on the first write and kept for the next ones), and the
+     mipmap sampling reading a single pyramid of the source. Every coarser
+     tile is then the box downsample
+     of the (up to) 4 tiles under it, made as soon as they are, so that the
+     tiles of a side are never all in memory at once. The subtrees of the
+     pyramids are converted and encoded in parallel.
+
+     Each side is written into `directory` as `<side>.dzi` and its tiles as
+     `<side>_files/<level>/<column>_<row>.<format>` (sides named `+x`, `-x`,
+     `+y`, `-y`, `+z` and `-z`), the level 0 being a single pixel.
+     */
+    class CubemapPyramid {
+    public:
+        CubemapPyramid(ProjectionPtr inProj, ProjectionPtr outProj, int tileSize = 256, int threads = 0);
+
+        void setRotation(const Rotation& rotation) {
+            convertor.setRotation(rotation);
+        }
+
+        void set_rotation(double yaw, double pitch, double roll) {
+            setRotation(Rotation::fromEuler(yaw, pitch, roll));
+        }
+
+        // encoding quality in [0,100], negative for the codec default
+        void setQuality(int _quality) {
+            quality = _quality;
+        }
+
+        // extension of the tiles (e.g. jpg, png, webp)
+        void setFormat(const std::string& _format) {
+            format = _format;
+        }
+
+        int getLevelCount() const {
+            return static_cast<int>(levelSizes.size());
+        }
+
+        // Size of the sides at a level
+        int getLevelSize(int level) const {
+            return levelSizes.at(level);
+        }
+
+        void write(const cv::Mat& src, const std::string& directory, int interpolation);
+
+    private:
+        ProjectionConvertor convertor;
+        std::vector<cv::Rect> sideRects;
+        std::vector<int> levelSizes;  // from the level 0
+        int tileSize;
+        int quality;
+        std::string format;
+        ThreadPool pool;
+        std::vector<RayFieldPtr> sideRays;
+
+        int getTileCount(int level) const {
+            return (levelSizes[level] + tileSize - 1) / tileSize;
+        }
+
+        cv::Rect getTileRect(int level, int column, int row) const;
+
+        // Convert (or downsample) a tile and the tiles under it, writing them all
+        cv::Mat renderTile(const cv::Mat& src, const MipPyramid* mipPyramid, const std::string& directory, int side,
+                           int level, int column, int row, int interpolation);
+
+        cv::Mat downsampleTile(const cv::Mat children[4], int level, int column, int row) const;
+
+        void writeTile(const cv::Mat& tile, const std::string& directory, int side, int level, int column, int row) const;
+
+        CubemapPyramid(const CubemapPyramid&);
+        CubemapPyramid& operator=(const CubemapPyramid&);
+    };
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_PYRAMID_HPP_ */
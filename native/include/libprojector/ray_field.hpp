@@ -0,0 +1,126 @@
+#ifndef LIBPROJECTOR_RAY_FIELD_HPP_
+#define LIBPROJECTOR_RAY_FIELD_HPP_
+
+#include <cmath>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <opencv2/core/core.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <libprojector/projections.hpp>
+
+namespace libprojector {
+
+    /**
+     Octahedral encoding of a direction into 2 floats: the ray is projected
+     on the octahedron |x| + |y| + |z| = 1, the lower half being folded
+     over the upper one. Decoding needs no trigonometry, and the floats
+     keep the directions to about 1e-7 radians.
+     */
+    inline cv::Vec2f encodeRay(const Ray& r) {
+        double n = fabs(r.x) + fabs(r.y) + fabs(r.z);
+        if (n == 0) {
+            return cv::Vec2f(0, 0);
+        }
+        double a = r.x / n, b = r.y / n;
+        if (r.z < 0) {
+            double foldedA = (1 - fabs(b)) * (a < 0 ? -1 : 1);
+            double foldedB = (1 - fabs(a)) * (b < 0 ? -1 : 1);
+            a = foldedA;
+            b = foldedB;
+        }
+        return cv::Vec2f(static_cast<float>(a), static_cast<float>(b));
+    }
+
+    // Unit ray of an octahedral encoding
+    inline void decodeRay(const cv::Vec2f& encoded, Ray& r) {
+        double a = encoded[0], b = encoded[1];
+        double z = 1 - fabs(a) - fabs(b);
+        if (z < 0) {
+            double unfoldedA = (1 - fabs(b)) * (a < 0 ? -1 : 1);
+            double unfoldedB = (1 - fabs(a)) * (b < 0 ? -1 : 1);
+            a = unfoldedA;
+            b = unfoldedB;
+        }
+        double n = sqrt(a * a + b * b + z * z);
+        r.x = a / n;
+        r.y = b / n;
+        r.z = z / n;
+    }
+
+    /**
+     Rays of every pixel of a projection (before any rotation), encoded
+     (see encodeRay) in a CV_32FC2 image: the half of the map building that
+     only depends on the output geometry.
+     */
+    class RayField {
+    public:
+        explicit RayField(const Projection& proj);
+
+        // Field over existing rays (e.g. a region of a bigger field)
+        explicit RayField(const cv::Mat& _rays) : rays(_rays) {}
+
+        const cv::Mat& getRays() const {
+            return rays;
+        }
+
+        size_t getBytes() const {
+            return rays.total() * rays.elemSize();
+        }
+
+    private:
+        cv::Mat rays;
+    };
+
+    typedef boost::shared_ptr<const RayField> RayFieldPtr;
+
+    /**
+     Ray fields keyed on the output geometry alone (Projection::getKey), so
+     that the conversions from any input to the same output share them. The
+     least recently used fields are dropped past the capacity (in bytes).
+
+     The field of a region is cut from the field of the whole projection
+     when it's cached, and built on its own (without being cached) otherwise.
+     Safe to use from several threads, two threads asking for a field not
+     cached yet may both build it.
+     */
+    class RayFieldCache {
+    public:
+        explicit RayFieldCache(size_t _capacity) :
+            capacity(_capacity),
+            bytes(0) {}
+
+        RayFieldPtr get(const ProjectionPtr& proj);
+
+        void setCapacity(size_t capacity);
+
+        size_t getBytes();
+
+        void clear();
+
+    private:
+        struct Entry {
+            RayFieldPtr field;
+            std::list<std::string>::iterator recent;
+        };
+
+        std::mutex mutex;
+        size_t capacity;
+        size_t bytes;
+        std::map<std::string, Entry> entries;
+        std::list<std::string> recentKeys;  // the front being the most recent
+
+        RayFieldPtr find(const std::string& key);
+
+        // drop the least recently used fields down to the capacity, the mutex being held
+        void evict();
+    };
+
+    // Cache shared by the convertors
+    RayFieldCache& getRayFieldCache();
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_RAY_FIELD_HPP_ */
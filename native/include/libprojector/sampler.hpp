@@ -0,0 +1,119 @@
+#ifndef LIBPROJECTOR_SAMPLER_HPP_
+#define LIBPROJECTOR_SAMPLER_HPP_
+
+#include <algorithm>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include <libprojector/tiling.hpp>
+
+namespace libprojector {
+
+    /**
+     Interpolations implemented by the native samplers, next to the
+     cv::InterpolationFlags handled by cv::remap.
+     */
+    enum NativeInterpolation {
+        // trilinear sampling of a mip pyramid, the level being picked per
+        // pixel from the footprint of the pixel in the source
+        INTER_NATIVE_MIPMAP = 100,
+        // separable kernels over 4x4 and 6x6 taps, with weight tables
+        // quantized to INTER_NATIVE_TAB_SIZE subpixel positions
+        INTER_NATIVE_BICUBIC = 101,
+        INTER_NATIVE_LANCZOS3 = 102,
+    };
+
+    // subpixel positions of the kernel weight tables, as cv::INTER_TAB_SIZE
+    const int INTER_NATIVE_TAB_SIZE = 32;
+
+    inline bool isNativeInterpolation(int interpolation) {
+        return interpolation >= INTER_NATIVE_MIPMAP;
+    }
+
+    inline bool isKernelInterpolation(int interpolation) {
+        return interpolation == INTER_NATIVE_BICUBIC || interpolation == INTER_NATIVE_LANCZOS3;
+    }
+
+    // Closest cv::InterpolationFlags, for the steps handled by OpenCV (e.g. resizes)
+    int toCvInterpolation(int interpolation);
+
+    /**
+     Level of detail of every output pixel: log2 of its footprint in the
+     source, from the local Jacobian of the maps. Differences across a
+     discontinuity of the maps (cubemap sides, wrap of a `wrapWidth` wide
+     source) are skipped by using the smaller of the forward and backward
+     differences.
+     */
+    cv::Mat computeLodMap(const cv::Mat& mapX, const cv::Mat& mapY, float wrapWidth);
+
+    /**
+     Source and its successive halvings (box filtered), down to 1 pixel.
+     */
+    class MipPyramid {
+    private:
+        std::vector<cv::Mat> levels;
+
+        MipPyramid() {}
+
+    public:
+        explicit MipPyramid(const cv::Mat& src, int maxLevels = 16);
+
+        // Levels of `base` from `first` on (shared, not copied), e.g. the
+        // pyramid of a halving of the source
+        MipPyramid(const MipPyramid& base, int first) :
+            levels(base.levels.begin() + std::min(first, base.size() - 1), base.levels.end()) {}
+
+        // Copy of the levels converted to `depth`, e.g. the float copy of a half float pyramid
+        MipPyramid convertTo(int depth) const;
+
+        int size() const {
+            return static_cast<int>(levels.size());
+        }
+
+        const cv::Mat& operator[](int level) const {
+            return levels[level];
+        }
+    };
+
+    // Trilinear sampling of the pyramid at the maps, with wrap on the borders
+    void remapMipmap(const MipPyramid& pyramid, cv::Mat& dst,
+                     const cv::Mat& mapX, const cv::Mat& mapY, const cv::Mat& lod, const TileGrid& grid);
+
+    /**
+     Separable kernel weights for each of the quantized subpixel positions,
+     normalized so that every position sums to 1.
+     */
+    class KernelTable {
+    private:
+        int taps;
+        std::vector<float> weights;
+
+        explicit KernelTable(int interpolation);
+
+    public:
+        static const KernelTable& get(int interpolation);
+
+        int getTaps() const {
+            return taps;
+        }
+
+        // `taps` weights, for the pixels from 1 - taps/2 to taps/2 around the sample
+        const float* getWeights(int position) const {
+            return &weights[position * taps];
+        }
+    };
+
+    /**
+     Splits the maps into the integer source pixels (CV_32SC2) and the
+     index of the quantized subpixel position (CV_16UC1, y * TAB + x), so
+     that the kernel samplers only look up their weights.
+     */
+    void computeFixedMaps(const cv::Mat& mapX, const cv::Mat& mapY, cv::Mat& coords, cv::Mat& positions);
+
+    // Sampling with a kernel interpolation at the fixed maps, with wrap on the borders
+    void remapKernel(const cv::Mat& src, cv::Mat& dst, const cv::Mat& coords, const cv::Mat& positions,
+                     int interpolation, const TileGrid& grid);
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_SAMPLER_HPP_ */
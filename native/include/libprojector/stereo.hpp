@@ -0,0 +1,34 @@
+#ifndef LIBPROJECTOR_STEREO_HPP_
+#define LIBPROJECTOR_STEREO_HPP_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace libprojector {
+
+    /**
+     Placement of the eyes of a stereoscopic image, the left eye coming first
+     (on top, or on the left).
+     */
+    typedef enum StereoLayout {
+        StereoLayoutMono,
+        StereoLayoutTopBottom,
+        StereoLayoutSideBySide,
+    } StereoLayout;
+
+    inline int getStereoEyeCount(StereoLayout layout) {
+        return (layout == StereoLayoutMono) ? 1 : 2;
+    }
+
+    // Width of one eye of an image `imageWidth` wide
+    int getStereoEyeWidth(int imageWidth, StereoLayout layout);
+
+    // Size of the image holding eyes of size `eyeSize`
+    cv::Size getStereoImageSize(const cv::Size& eyeSize, StereoLayout layout);
+
+    // Views on the eyes of an image, sharing its data
+    std::vector<cv::Mat> getStereoEyes(const cv::Mat& image, StereoLayout layout);
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_STEREO_HPP_ */
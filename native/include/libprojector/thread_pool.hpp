@@ -0,0 +1,76 @@
+#ifndef LIBPROJECTOR_THREAD_POOL_HPP_
+#define LIBPROJECTOR_THREAD_POOL_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+namespace libprojector {
+
+    /**
+     Work-stealing thread pool.
+
+     Each worker owns a queue: the tasks submitted from a worker go to its own
+     queue and are run last in first out, so that a task continuing the work of
+     the current one (e.g. encoding the image just converted) runs right away on
+     the same core. Idle workers steal the oldest tasks of the other queues.
+     */
+    class ThreadPool {
+    public:
+        typedef std::function<void()> Task;
+
+        // 0 threads means one per hardware thread
+        explicit ThreadPool(int threads = 0);
+        ~ThreadPool();
+
+        int size() const {
+            return static_cast<int>(threads.size());
+        }
+
+        void submit(const Task& task);
+
+        // Blocks until every submitted task (and the tasks they submitted) ran
+        void wait();
+
+        /**
+         Runs `function(i)` for i in [0, count) and waits for these calls only,
+         so that it can be used while other work is going on in the pool. The
+         first exception thrown is rethrown once all the calls are done.
+
+         Called from a worker of the pool, the calls run inline instead, so
+         that a worker never blocks waiting for the others.
+         */
+        void forEach(size_t count, const std::function<void(size_t)>& function);
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<boost::shared_ptr<Worker> > workers;
+        std::vector<std::thread> threads;
+
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        std::condition_variable idle;
+        size_t queued;   // tasks waiting in the queues
+        size_t pending;  // tasks submitted and not finished yet
+        size_t nextWorker;
+        bool stopping;
+
+        bool pop(int index, Task& task);
+        bool steal(int index, Task& task);
+        void run(int index);
+
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator=(const ThreadPool&);
+    };
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_THREAD_POOL_HPP_ */
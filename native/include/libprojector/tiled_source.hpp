@@ -0,0 +1,151 @@
+#ifndef LIBPROJECTOR_TILED_SOURCE_HPP_
+#define LIBPROJECTOR_TILED_SOURCE_HPP_
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace libprojector {
+
+    /**
+     Source image stored raw in square tiles, with its pyramid, read through
+     a memory mapping so that only the tiles a conversion samples are read,
+     whatever the size of the image (e.g. 100k pixels wide panoramas).
+
+     The file (in the native byte order) is a header padded to 4096 bytes:
+
+        "PJTILES1", then int32 width, height, OpenCV type, tile size, levels
+
+     then the tiles of each level, from the full image, each level being
+     half the size of the previous one (rounded up). The tiles of a level
+     are stored row by row, each one as `tile size` rows of `tile size`
+     pixels (the tiles of the right and bottom edges being padded).
+
+     The memory budget covers the tiles read and the copies of the reads.
+     Half of it keeps the tiles read, the least recently used ones being
+     released (madvise) past it. The reads go a few tiles at a time, at most
+     that half over the threads (cv::getNumThreads), the tiles of the reads
+     going on being kept until copied (a tile per read with a budget under a
+     tile per thread). The other half is for the copies, each read copying
+     at most that half over the threads (getMaxCopyBytes).
+     */
+    class TiledSource {
+    public:
+        TiledSource(const std::string& path, size_t memoryBudget);
+        ~TiledSource();
+
+        /**
+         Write `image` as a tiled source, the pyramid going down to a level
+         fitting in a tile. The tile size must be a multiple of 64, so that
+         the tiles are aligned on the memory pages.
+         */
+        static void write(const std::string& path, const cv::Mat& image, int tileSize = 256);
+
+        // Reads the size of a tiled source from its header, false for the other files
+        static bool probe(const std::string& path, cv::Size& size);
+
+        int getLevelCount() const {
+            return static_cast<int>(levels.size());
+        }
+
+        cv::Size getSize(int level = 0) const {
+            return levels.at(level).size;
+        }
+
+        int type() const {
+            return imageType;
+        }
+
+        int getTileSize() const {
+            return tileSize;
+        }
+
+        // Memory of the tiles read and not released yet, and of the copies not released
+        size_t getResidentBytes();
+
+        // Most memory resident at once since the source was opened
+        size_t getPeakBytes();
+
+        // Size of the copies within the budget whatever the threads reading
+        size_t getMaxCopyBytes() const;
+
+        /**
+         Copy a rectangle of a level into `dst`, the columns out of the level
+         wrapping around and the rows being clamped (as the rays do on an
+         equirectangular image). The copy counts in the resident memory until
+         given back to releaseCopy.
+         */
+        void read(int level, const cv::Rect& rect, cv::Mat& dst);
+
+        // Release a copy made by read
+        void releaseCopy(cv::Mat& copy);
+
+    private:
+        struct Level {
+            cv::Size size;
+            int columns;  // tiles per row
+            int rows;
+            size_t offset;  // of the first tile in the file
+        };
+
+        std::vector<Level> levels;
+        int imageType;
+        int tileSize;
+        size_t tileBytes;
+        size_t memoryBudget;
+
+        unsigned char* data;
+        size_t dataSize;
+
+        struct Resident {
+            std::list<size_t>::iterator position;
+            int reads;  // going on, the tile being kept meanwhile
+        };
+
+        // tiles by recency, the front being the most recent, with their
+        // position in the list
+        std::mutex mutex;
+        std::list<size_t> recentTiles;
+        std::map<size_t, Resident> residentTiles;
+        size_t copyBytes;
+        size_t peakBytes;
+
+        static std::vector<Level> getLevels(const cv::Size& size, int levelCount, int tileSize, size_t tileBytes);
+
+        const unsigned char* getTile(int level, int column, int row) const;
+
+        // Tiles read at once by a read, within the budget whatever the threads reading
+        size_t getMaxReadTiles() const;
+
+        // Mark the tiles as used and kept until `release`, releasing the
+        // oldest other ones past the budget
+        void acquire(const std::vector<size_t>& tiles);
+        void release(const std::vector<size_t>& tiles);
+
+        // Release the oldest tiles not being read past the budget, with the lock held
+        void evict();
+
+        // Record the memory resident, with the lock held
+        void updatePeak();
+
+        TiledSource(const TiledSource&);
+        TiledSource& operator=(const TiledSource&);
+    };
+
+    /**
+     Remap a level of a tiled source with the maps (in the coordinates of
+     that level), output tile by output tile: each tile only reads the part
+     of the source under its maps, the tiles whose footprint is bigger than
+     the copies of the source (getMaxCopyBytes) being split (down to a
+     pixel). Only the OpenCV interpolations apply, the native ones using the
+     closest of them.
+     */
+    void remapTiledSource(TiledSource& source, int level, const cv::Mat& mapX, const cv::Mat& mapY,
+                          int interpolation, cv::Mat& dst);
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_TILED_SOURCE_HPP_ */
@@ -0,0 +1,96 @@
+#ifndef LIBPROJECTOR_TILING_HPP_
+#define LIBPROJECTOR_TILING_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include <opencv2/core/core.hpp>
+
+namespace libprojector {
+
+    /**
+     Size in bytes of the data cache of the given level (1 or 2), with
+     conservative defaults when it can't be queried.
+     */
+    inline size_t getCacheSize(int level) {
+        long size = -1;
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+        size = sysconf(level == 1 ? _SC_LEVEL1_DCACHE_SIZE : _SC_LEVEL2_CACHE_SIZE);
+#endif
+        if (size <= 0) {
+            size = (level == 1) ? 32 * 1024 : 256 * 1024;
+        }
+        return static_cast<size_t>(size);
+    }
+
+    /**
+     Split of an image into square tiles, ordered along a Z-order (Morton)
+     curve so that consecutive tiles are close to each other in the image
+     as well as in the source they sample.
+     */
+    class TileGrid {
+    private:
+        std::vector<cv::Rect> tiles;
+
+        static uint32_t interleave(uint32_t v) {
+            v &= 0x0000ffff;
+            v = (v | (v << 8)) & 0x00ff00ff;
+            v = (v | (v << 4)) & 0x0f0f0f0f;
+            v = (v | (v << 2)) & 0x33333333;
+            v = (v | (v << 1)) & 0x55555555;
+            return v;
+        }
+
+    public:
+        TileGrid(int width, int height, int tileSize) {
+            int countX = (width + tileSize - 1) / tileSize;
+            int countY = (height + tileSize - 1) / tileSize;
+
+            std::vector<std::pair<uint32_t, cv::Rect> > ordered;
+            ordered.reserve(countX * countY);
+            for (int ty = 0; ty < countY; ++ty) {
+                for (int tx = 0; tx < countX; ++tx) {
+                    cv::Rect tile(tx * tileSize, ty * tileSize,
+                                  std::min(tileSize, width - tx * tileSize),
+                                  std::min(tileSize, height - ty * tileSize));
+                    uint32_t code = interleave(tx) | (interleave(ty) << 1);
+                    ordered.push_back(std::make_pair(code, tile));
+                }
+            }
+            std::sort(ordered.begin(), ordered.end(), compareCodes);
+
+            tiles.reserve(ordered.size());
+            for (size_t i = 0; i < ordered.size(); ++i) {
+                tiles.push_back(ordered[i].second);
+            }
+        }
+
+        static bool compareCodes(const std::pair<uint32_t, cv::Rect>& a, const std::pair<uint32_t, cv::Rect>& b) {
+            return a.first < b.first;
+        }
+
+        // Side of the tiles for which half of the cache holds a tile worth
+        // of `bytesPerPixel`, as a multiple of 16 pixels
+        static int tileSizeFor(size_t cacheSize, size_t bytesPerPixel) {
+            int side = static_cast<int>(sqrt(static_cast<double>(cacheSize / 2) / bytesPerPixel));
+            side = (side / 16) * 16;
+            return std::max(16, std::min(side, 512));
+        }
+
+        int size() const {
+            return static_cast<int>(tiles.size());
+        }
+
+        const cv::Rect& operator[](int index) const {
+            return tiles[index];
+        }
+    };
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_TILING_HPP_ */
@@ -0,0 +1,44 @@
+#ifndef LIBPROJECTOR_YUV_HPP_
+#define LIBPROJECTOR_YUV_HPP_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace libprojector {
+
+    /**
+     Planar YUV 4:2:0 layouts of the video decoders and encoders, stored as
+     in OpenCV (COLOR_YUV2BGR_I420, ...): a single-channel frame of
+     height * 3/2 rows, the luma plane followed by the chroma planes.
+     */
+    enum YUVFormat {
+        YUVFormatI420,  // Y, then U and V planes of (width/2) x (height/2)
+        YUVFormatNV12,  // Y, then a plane of interleaved UV pairs
+    };
+
+    struct YUVPlanes {
+        cv::Mat luma;
+        // U and V for I420, the UV pairs (2 channels) for NV12
+        std::vector<cv::Mat> chroma;
+    };
+
+    // Luma size of a frame, which must have even dimensions
+    cv::Size getYUVFrameSize(const cv::Mat& frame);
+
+    cv::Mat createYUVFrame(const cv::Size& size);
+
+    // Headers on the planes of a continuous frame, sharing its data
+    YUVPlanes getYUVPlanes(const cv::Mat& frame, YUVFormat format);
+
+    /**
+     Derives the maps of the half-size chroma planes from the luma maps: each
+     chroma pixel samples at the center of the 2x2 luma pixels it covers.
+     `wrapWidth` is the luma width of a spherical input (0 otherwise), for
+     the horizontal positions wrapping around.
+     */
+    void computeChromaMaps(const cv::Mat& mapX, const cv::Mat& mapY, float wrapWidth,
+                           cv::Mat& chromaMapX, cv::Mat& chromaMapY);
+
+} // end namespace libprojector
+
+#endif /* LIBPROJECTOR_YUV_HPP_ */
@@ -0,0 +1,168 @@
+#include <stdexcept>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+#include <libprojector/batch.hpp>
+#include <libprojector/image_io.hpp>
+
+namespace libprojector {
+
+    BatchConvertor::BatchConvertor(const ProjectionSpec& _inSpec, const ProjectionSpec& _outSpec, int _outputWidth, int threads) :
+        inSpec(_inSpec),
+        outSpec(_outSpec),
+        outputWidth(_outputWidth),
+        interpolation(cv::INTER_LINEAR),
+        quality(-1),
+        depth(ImageDepth8U),
+        pool(new ThreadPool(threads)),
+        cache(new MapCache()) {}
+
+    BatchConvertor::BatchConvertor(const ProjectionSpec& _inSpec, const ProjectionSpec& _outSpec, int _outputWidth,
+                                   BatchConvertor& shared) :
+        inSpec(_inSpec),
+        outSpec(_outSpec),
+        outputWidth(_outputWidth),
+        interpolation(cv::INTER_LINEAR),
+        quality(-1),
+        depth(ImageDepth8U),
+        pool(shared.pool),
+        cache(shared.cache) {}
+
+    void BatchConvertor::addJob(const std::string& input, const std::string& output) {
+        Job job;
+        job.input = input;
+        job.output = output;
+        jobs.push_back(job);
+    }
+
+    std::vector<std::string> BatchConvertor::cubemapSidePaths(const std::string& output) {
+        static const char* suffixes[6] = {"+x", "-x", "+y", "-y", "+z", "-z"};
+
+        std::string name = output;
+        std::string ext;
+        size_t dot = output.rfind('.');
+        size_t slash = output.find_last_of("/\\");
+        if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+            name = output.substr(0, dot);
+            ext = output.substr(dot);
+        }
+
+        std::vector<std::string> paths;
+        for (int i = 0; i < 6; ++i) {
+            paths.push_back(name + suffixes[i] + ext);
+        }
+        return paths;
+    }
+
+    void BatchConvertor::run(const ResultCallback& onResult) {
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            pool->submit(std::bind(&BatchConvertor::decode, this, i));
+        }
+
+        size_t done = 0;
+        while (done < jobs.size()) {
+            std::deque<BatchResult> finished;
+            {
+                std::unique_lock<std::mutex> lock(resultsMutex);
+                resultsReady.wait(lock, [this] { return !results.empty(); });
+                finished.swap(results);
+            }
+            for (size_t i = 0; i < finished.size(); ++i, ++done) {
+                onResult(finished[i]);
+            }
+        }
+        // every task is done with the jobs once its result is in (see
+        // finish), without waiting for the pool, which other convertors
+        // may share; the pool and the maps are kept for the next jobs
+        jobs.clear();
+    }
+
+    cv::Mat BatchConvertor::convertImage(const cv::Mat& image, const Rotation& _rotation) {
+        ProjectionPtr inProj = inSpec.create(image.cols);
+        ProjectionPtr outProj = outSpec.create(outputWidth);
+        return cache->convert(inProj, outProj, _rotation, image, interpolation, inSpec.stereo, outSpec.stereo);
+    }
+
+    void BatchConvertor::decode(size_t index) {
+        const std::string& input = jobs[index].input;
+        cv::Mat image;
+        int scale = 1;
+        try {
+            // decode at a reduced scale when the output is less dense than
+            // the input, the size of the input being read from its header
+            cv::Size size;
+            if (depth == ImageDepth8U && probeImageSize(input, size)) {
+                ProjectionPtr inProj = inSpec.create(size.width);
+                ProjectionPtr outProj = outSpec.create(outputWidth);
+                scale = getReducedDecodeScale(*inProj, *outProj);
+            }
+            image = cv::imread(input, getDecodeFlags(depth, scale));
+            if (!image.empty()) {
+                image = toImageDepth(image, depth);
+            }
+        } catch (const std::exception& e) {
+            finish(index, false, e.what());
+            return;
+        }
+        if (image.empty()) {
+            finish(index, false, "unable to read the image");
+            return;
+        }
+        pool->submit(std::bind(&BatchConvertor::convert, this, index, image, scale));
+    }
+
+    void BatchConvertor::convert(size_t index, cv::Mat image, int scale) {
+        cv::Mat out;
+        try {
+            ProjectionSpec scaledSpec = inSpec;
+            scaledSpec.borderPadding = inSpec.borderPadding / scale;
+
+            ProjectionPtr inProj = scaledSpec.create(image.cols);
+            ProjectionPtr outProj = outSpec.create(outputWidth);
+            out = cache->convert(inProj, outProj, rotation, image, interpolation, inSpec.stereo, outSpec.stereo);
+        } catch (const std::exception& e) {
+            finish(index, false, e.what());
+            return;
+        }
+        image.release();
+        pool->submit(std::bind(&BatchConvertor::encode, this, index, out));
+    }
+
+    void BatchConvertor::encode(size_t index, cv::Mat image) {
+        const std::string& output = jobs[index].output;
+        try {
+            bool isCubemap = outSpec.type == ProjectionTypeCubemap || outSpec.type == ProjectionTypeEquiAngularCubemap;
+            if (isCubemap && outSpec.layout == CubemapLayoutStrip && outSpec.stereo == StereoLayoutMono) {
+                std::vector<std::string> paths = cubemapSidePaths(output);
+                int side = image.rows;
+                for (int i = 0; i < 6; ++i) {
+                    cv::Mat sideImage = toEncodable(image(cv::Rect(i * side, 0, side, side)));
+                    if (!cv::imwrite(paths[i], sideImage, getEncodeParams(paths[i], quality))) {
+                        finish(index, false, "unable to write '" + paths[i] + "'");
+                        return;
+                    }
+                }
+            } else if (!cv::imwrite(output, toEncodable(image), getEncodeParams(output, quality))) {
+                finish(index, false, "unable to write the image");
+                return;
+            }
+        } catch (const std::exception& e) {
+            finish(index, false, e.what());
+            return;
+        }
+        finish(index, true);
+    }
+
+    void BatchConvertor::finish(size_t index, bool success, const std::string& error) {
+        BatchResult result;
+        result.input = jobs[index].input;
+        result.output = jobs[index].output;
+        result.success = success;
+        result.error = error;
+
+        // notified under the lock: run may return as soon as it's released
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        results.push_back(result);
+        resultsReady.notify_one();
+    }
+
+} // end namespace libprojector
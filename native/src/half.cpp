@@ -0,0 +1,34 @@
+#include <stdexcept>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <libprojector/half.hpp>
+
+namespace libprojector {
+
+    void convertToHalf(const cv::Mat& src, cv::Mat& dst) {
+#ifdef LIBPROJECTOR_HALF_FLOAT
+        src.convertTo(dst, CV_16F);
+#else
+        throw std::runtime_error("the half float images need OpenCV 4 or later");
+#endif
+    }
+
+    void convertFromHalf(const cv::Mat& src, cv::Mat& dst) {
+        if (src.depth() != DEPTH_HALF) {
+            throw std::invalid_argument("not a half float image");
+        }
+        src.convertTo(dst, CV_32F);
+    }
+
+    void resizeImage(const cv::Mat& src, cv::Mat& dst, const cv::Size& size, int interpolation) {
+        if (src.depth() != DEPTH_HALF) {
+            cv::resize(src, dst, size, 0, 0, interpolation);
+            return;
+        }
+        cv::Mat values, resized;
+        convertFromHalf(src, values);
+        cv::resize(values, resized, size, 0, 0, interpolation);
+        convertToHalf(resized, dst);
+    }
+
+} // end namespace libprojector
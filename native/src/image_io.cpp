@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+#include <libprojector/half.hpp>
+#include <libprojector/image_io.hpp>
+#include <libprojector/tiled_source.hpp>
+
+namespace libprojector {
+
+    namespace {
+
+        int readBigEndian(const unsigned char* bytes, int count) {
+            int value = 0;
+            for (int i = 0; i < count; ++i) {
+                value = (value << 8) | bytes[i];
+            }
+            return value;
+        }
+
+        bool probePNG(std::ifstream& file, cv::Size& size) {
+            // signature, then the IHDR chunk: length, type, width, height
+            unsigned char header[24];
+            if (!file.read(reinterpret_cast<char*>(header), sizeof(header))) {
+                return false;
+            }
+            static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+            if (!std::equal(signature, signature + 8, header) || !std::equal(header + 12, header + 16, "IHDR")) {
+                return false;
+            }
+            size = cv::Size(readBigEndian(header + 16, 4), readBigEndian(header + 20, 4));
+            return true;
+        }
+
+        bool probeJPEG(std::ifstream& file, cv::Size& size) {
+            unsigned char bytes[2];
+            if (!file.read(reinterpret_cast<char*>(bytes), 2) || bytes[0] != 0xff || bytes[1] != 0xd8) {
+                return false;
+            }
+
+            // walk the segments up to the start of frame
+            while (true) {
+                int c;
+                do {
+                    c = file.get();
+                } while (c == 0xff);
+                if (c == EOF) {
+                    return false;
+                }
+                int marker = c;
+
+                // markers without payload
+                if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd9)) {
+                    continue;
+                }
+
+                unsigned char segment[7];
+                if (!file.read(reinterpret_cast<char*>(segment), 2)) {
+                    return false;
+                }
+                int length = readBigEndian(segment, 2);
+                if (length < 2) {
+                    return false;
+                }
+
+                // SOFn, except DHT (c4), JPG (c8) and DAC (cc) which share the range
+                bool isStartOfFrame = marker >= 0xc0 && marker <= 0xcf &&
+                    marker != 0xc4 && marker != 0xc8 && marker != 0xcc;
+                if (isStartOfFrame) {
+                    // precision, height, width
+                    if (length < 7 || !file.read(reinterpret_cast<char*>(segment + 2), 5)) {
+                        return false;
+                    }
+                    size = cv::Size(readBigEndian(segment + 5, 2), readBigEndian(segment + 3, 2));
+                    return size.width > 0 && size.height > 0;
+                }
+
+                if (!file.seekg(length - 2, std::ios::cur)) {
+                    return false;
+                }
+            }
+        }
+
+        std::string getExtension(const std::string& path) {
+            size_t dot = path.rfind('.');
+            if (dot == std::string::npos) {
+                return std::string();
+            }
+            std::string ext = path.substr(dot + 1);
+            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+            return ext;
+        }
+
+        // value of the white for the images of `depth`
+        double getWhite(int depth) {
+            switch (depth) {
+                case CV_8U: return 255;
+                case CV_16U: return 65535;
+            }
+            return 1;
+        }
+
+    } // end anonymous namespace
+
+    bool probeImageSize(const std::string& path, cv::Size& size) {
+        // NB: the EXIF orientation isn't taken into account, as for panoramas
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        if (probePNG(file, size)) {
+            return true;
+        }
+        file.clear();
+        file.seekg(0);
+        if (probeJPEG(file, size)) {
+            return true;
+        }
+        return TiledSource::probe(path, size);
+    }
+
+    cv::Size getImageSize(const std::string& path) {
+        cv::Size size;
+        if (probeImageSize(path, size)) {
+            return size;
+        }
+        cv::Mat image = cv::imread(path, cv::IMREAD_UNCHANGED);
+        if (image.empty()) {
+            throw std::runtime_error("unable to read '" + path + "'");
+        }
+        return image.size();
+    }
+
+    int getReducedDecodeFlags(int scale) {
+        switch (scale) {
+            case 1: return cv::IMREAD_COLOR;
+            case 2: return cv::IMREAD_REDUCED_COLOR_2;
+            case 4: return cv::IMREAD_REDUCED_COLOR_4;
+            case 8: return cv::IMREAD_REDUCED_COLOR_8;
+        }
+        throw std::invalid_argument("the decode scale must be 1, 2, 4 or 8");
+    }
+
+    int getDecodeFlags(ImageDepth depth, int scale) {
+        if (depth == ImageDepth8U) {
+            return getReducedDecodeFlags(scale);
+        }
+        if (scale != 1) {
+            throw std::invalid_argument("the reduced decoding is for 8 bits images only");
+        }
+        return cv::IMREAD_COLOR | cv::IMREAD_ANYDEPTH;
+    }
+
+    cv::Mat toImageDepth(const cv::Mat& image, ImageDepth depth) {
+        cv::Mat values = image;
+        if (image.depth() == DEPTH_HALF) {
+            if (depth == ImageDepthHalf) {
+                return image;
+            }
+            convertFromHalf(image, values);
+        }
+
+        int targetDepth;
+        switch (depth) {
+            case ImageDepth8U: targetDepth = CV_8U; break;
+            case ImageDepth16U: targetDepth = CV_16U; break;
+            case ImageDepthHalf:
+            case ImageDepthFloat: targetDepth = CV_32F; break;
+            default:
+                throw std::invalid_argument("unknown image depth");
+        }
+
+        cv::Mat result = values;
+        if (values.depth() != targetDepth) {
+            values.convertTo(result, targetDepth, getWhite(targetDepth) / getWhite(values.depth()));
+        }
+        if (depth == ImageDepthHalf) {
+            cv::Mat half;
+            convertToHalf(result, half);
+            return half;
+        }
+        return result;
+    }
+
+    cv::Mat toEncodable(const cv::Mat& image) {
+        if (image.depth() != DEPTH_HALF) {
+            return image;
+        }
+        cv::Mat values;
+        convertFromHalf(image, values);
+        return values;
+    }
+
+    std::vector<int> getEncodeParams(const std::string& path, int quality) {
+        std::vector<int> params;
+        if (quality < 0) {
+            return params;
+        }
+        std::string ext = getExtension(path);
+        if (ext == "jpg" || ext == "jpeg") {
+            params.push_back(cv::IMWRITE_JPEG_QUALITY);
+            params.push_back(std::min(quality, 100));
+        } else if (ext == "webp") {
+            params.push_back(cv::IMWRITE_WEBP_QUALITY);
+            params.push_back(std::max(1, std::min(quality, 100)));
+        }
+        return params;
+    }
+
+    std::vector<cv::Mat> readImages(ThreadPool& pool, const std::vector<std::string>& paths, int flags) {
+        std::vector<cv::Mat> images(paths.size());
+        pool.forEach(paths.size(), [&](size_t i) {
+            images[i] = cv::imread(paths[i], flags);
+            if (images[i].empty()) {
+                throw std::runtime_error("unable to read '" + paths[i] + "'");
+            }
+        });
+        return images;
+    }
+
+    cv::Mat readCubemap(ThreadPool& pool, const std::vector<std::string>& paths, int flags) {
+        if (paths.size() != 6) {
+            throw std::invalid_argument("a cubemap needs 6 sides");
+        }
+
+        // the strip is allocated from the first side decoded, the decoded
+        // size depending on the flags (e.g. reduced decoding)
+        std::mutex mutex;
+        cv::Mat strip;
+        pool.forEach(paths.size(), [&](size_t i) {
+            cv::Mat image = cv::imread(paths[i], flags);
+            if (image.empty()) {
+                throw std::runtime_error("unable to read '" + paths[i] + "'");
+            }
+
+            cv::Mat target;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (strip.empty()) {
+                    strip.create(image.rows, 6 * image.rows, image.type());
+                }
+                if (image.cols != strip.rows || image.rows != strip.rows || strip.type() != image.type()) {
+                    throw std::invalid_argument("the cubemap sides must be squares of the same size and type");
+                }
+                int side = strip.rows;
+                target = strip(cv::Rect(static_cast<int>(i) * side, 0, side, side));
+            }
+            image.copyTo(target);
+        });
+        return strip;
+    }
+
+    void writeImages(ThreadPool& pool, const std::vector<std::string>& paths, const std::vector<cv::Mat>& images, int quality) {
+        if (paths.size() != images.size()) {
+            throw std::invalid_argument("as many paths as images are needed");
+        }
+        pool.forEach(paths.size(), [&](size_t i) {
+            if (!cv::imwrite(paths[i], toEncodable(images[i]), getEncodeParams(paths[i], quality))) {
+                throw std::runtime_error("unable to write '" + paths[i] + "'");
+            }
+        });
+    }
+
+    ThreadPool& getIOPool() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+} // end namespace libprojector
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <libprojector/multi_target.hpp>
+
+namespace libprojector {
+
+    // the decoded sources are at most 64 times smaller than the input
+    static const int MAX_SOURCE_SCALE = 64;
+
+    MultiTargetConvertor::MultiTargetConvertor(ProjectionPtr _inProj, int threads) :
+        inProj(_inProj),
+        pool(threads) {}
+
+    int MultiTargetConvertor::addTarget(ProjectionPtr outProj, int interpolation) {
+        Target target;
+        target.outProj = outProj;
+        target.interpolation = interpolation;
+        target.scale = getReducedDecodeScale(*inProj, *outProj, MAX_SOURCE_SCALE);
+        targets.push_back(target);
+        return static_cast<int>(targets.size()) - 1;
+    }
+
+    void MultiTargetConvertor::setRotation(const Rotation& _rotation) {
+        rotation = _rotation;
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (targets[i].convertor) {
+                targets[i].convertor->setRotation(rotation);
+            }
+        }
+    }
+
+    int MultiTargetConvertor::getDecodeScale(int maxScale) const {
+        int scale = maxScale;
+        for (size_t i = 0; i < targets.size(); ++i) {
+            scale = std::min(scale, targets[i].scale);
+        }
+        return scale;
+    }
+
+    std::vector<cv::Mat> MultiTargetConvertor::convert(const cv::Mat& src) {
+        if (targets.empty()) {
+            throw std::logic_error("no target to convert to");
+        }
+
+        // scale of the source, its width being the input one divided (and
+        // rounded up, as the reduced decoding does) by a power of two
+        int srcScale = 1;
+        while (srcScale < MAX_SOURCE_SCALE && (inProj->getWidth() + 2 * srcScale - 1) / (2 * srcScale) >= src.cols) {
+            srcScale *= 2;
+        }
+        if ((inProj->getWidth() + srcScale - 1) / srcScale != src.cols && inProj->getWidth() / srcScale != src.cols) {
+            throw std::invalid_argument("the source must be the input at a power of two downscale");
+        }
+
+        // halvings of the source down to the least dense target: the levels
+        // of a mip pyramid, which goes on down to a pixel when a target
+        // samples it with the mipmap interpolation
+        std::vector<int> targetLevels(targets.size(), 0);
+        int levelCount = 1;
+        bool mipmap = false;
+        for (size_t i = 0; i < targets.size(); ++i) {
+            for (int scale = srcScale; scale < targets[i].scale; scale *= 2) {
+                ++targetLevels[i];
+            }
+            levelCount = std::max(levelCount, targetLevels[i] + 1);
+            mipmap = mipmap || targets[i].interpolation == INTER_NATIVE_MIPMAP;
+        }
+        // the samplers go through float for the half floats: converted once
+        // here rather than by the sampling of every tile
+        cv::Mat values = src;
+        if (src.depth() == DEPTH_HALF) {
+            convertFromHalf(src, values);
+        }
+        MipPyramid levels(values, mipmap ? std::numeric_limits<int>::max() : levelCount);
+
+        for (size_t i = 0; i < targets.size(); ++i) {
+            const cv::Mat& source = levels[targetLevels[i]];
+            Target& target = targets[i];
+            if (!target.convertor || target.convertor->getInProjection()->getWidth() != source.cols ||
+                target.convertor->getInProjection()->getHeight() != source.rows) {
+                ProjectionPtr levelProj = inProj;
+                if (source.cols != inProj->getWidth() || source.rows != inProj->getHeight()) {
+                    levelProj.reset(new ScaledProjection(inProj, source.cols, source.rows));
+                }
+                target.convertor.reset(new ProjectionConvertor(levelProj, target.outProj));
+                target.convertor->setRotation(rotation);
+            }
+        }
+
+        // the largest outputs first, so that the tiles of the small ones fill the end of the pass
+        std::vector<size_t> order(targets.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            const Projection& first = *targets[a].outProj;
+            const Projection& second = *targets[b].outProj;
+            return static_cast<double>(first.getWidth()) * first.getHeight() >
+                static_cast<double>(second.getWidth()) * second.getHeight();
+        });
+
+        // the mip pyramid of each level, sharing the levels
+        std::vector<MipPyramid> pyramids;
+        for (int level = 0; level < levelCount; ++level) {
+            pyramids.push_back(MipPyramid(levels, level));
+        }
+
+        // the fast paths and the inputs with view weights are converted here,
+        // with the parallelism of OpenCV; the maps of the other targets are
+        // brought up to date, and their tiles sampled on the pool, without
+        // any parallel loop nested in its tasks
+        std::vector<cv::Mat> outputs(targets.size());
+        std::vector<std::pair<size_t, cv::Rect> > tiles;
+        for (size_t i = 0; i < order.size(); ++i) {
+            Target& target = targets[order[i]];
+            int level = targetLevels[order[i]];
+            const cv::Mat& source = levels[level];
+            cv::Mat& output = outputs[order[i]];
+            if (target.convertor->convertFast(source, output, target.interpolation)) {
+                continue;
+            }
+            if (inProj->hasViewWeights()) {
+                output = target.convertor->convertImage(source, target.interpolation, &pyramids[level]);
+                continue;
+            }
+
+            target.convertor->update();
+            target.convertor->prepare(target.interpolation);
+            output.create(target.outProj->getHeight(), target.outProj->getWidth(), source.type());
+            TileGrid grid(output.cols, output.rows, ProjectionConvertor::getRemapTileSize(source));
+            for (int t = 0; t < grid.size(); ++t) {
+                tiles.push_back(std::make_pair(order[i], grid[t]));
+            }
+        }
+
+        pool.forEach(tiles.size(), [&](size_t i) {
+            const Target& target = targets[tiles[i].first];
+            int level = targetLevels[tiles[i].first];
+            target.convertor->remapTile(levels[level], outputs[tiles[i].first], tiles[i].second, target.interpolation,
+                                        &pyramids[level]);
+        });
+
+        if (src.depth() == DEPTH_HALF) {
+            for (size_t i = 0; i < outputs.size(); ++i) {
+                cv::Mat output = outputs[i];
+                convertToHalf(output, outputs[i]);
+            }
+        }
+        return outputs;
+    }
+
+} // end namespace libprojector
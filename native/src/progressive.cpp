@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <stdexcept>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <libprojector/half.hpp>
+#include <libprojector/progressive.hpp>
+
+namespace libprojector {
+
+    namespace {
+
+        cv::Mat resizeSource(const cv::Mat& src, const cv::Size& size) {
+            if (src.size() == size) {
+                return src;
+            }
+            int interpolation = (size.width < src.cols) ? cv::INTER_AREA : cv::INTER_LINEAR;
+            cv::Mat resized;
+            resizeImage(src, resized, size, interpolation);
+            return resized;
+        }
+
+    } // end anonymous namespace
+
+    ProgressiveConvertor::ProgressiveConvertor(ProjectionPtr _inProj, ProjectionPtr outProj, int previewWidth, int refinement) :
+        inProj(_inProj) {
+        if (previewWidth <= 0 || refinement < 2) {
+            throw std::invalid_argument("the preview width must be positive, and the refinement at least 2");
+        }
+
+        // output downscales, from the last stage
+        std::vector<int> scales(1, 1);
+        while (outProj->getWidth() / scales.back() > previewWidth) {
+            scales.push_back(scales.back() * refinement);
+        }
+        std::reverse(scales.begin(), scales.end());
+
+        for (size_t i = 0; i < scales.size(); ++i) {
+            ProjectionPtr stageOut = outProj;
+            if (scales[i] > 1) {
+                stageOut.reset(new ScaledProjection(outProj, std::max(1, outProj->getWidth() / scales[i]),
+                                                    std::max(1, outProj->getHeight() / scales[i])));
+            }
+
+            // the last stage samples the full input, as convert_image does
+            bool last = i + 1 == scales.size();
+            int decodeScale = last ? 1 : getReducedDecodeScale(*inProj, *stageOut);
+            ProjectionPtr stageIn = inProj;
+            if (decodeScale > 1) {
+                stageIn.reset(new ScaledProjection(inProj, std::max(1, inProj->getWidth() / decodeScale),
+                                                   std::max(1, inProj->getHeight() / decodeScale)));
+            }
+
+            decodeScales.push_back(decodeScale);
+            stages.push_back(ProjectionConvertor(stageIn, stageOut));
+        }
+    }
+
+    cv::Size ProgressiveConvertor::getStageSize(int stage) const {
+        const ProjectionConvertor& convertor = stages.at(stage);
+        return cv::Size(convertor.getOutProjection()->getWidth(), convertor.getOutProjection()->getHeight());
+    }
+
+    int ProgressiveConvertor::getStageDecodeScale(int stage) const {
+        return decodeScales.at(stage);
+    }
+
+    void ProgressiveConvertor::setRotation(const Rotation& rotation) {
+        for (size_t i = 0; i < stages.size(); ++i) {
+            stages[i].setRotation(rotation);
+        }
+    }
+
+    cv::Mat ProgressiveConvertor::convertStage(const cv::Mat& src, int stage, int interpolation) {
+        return convertStereoStage(src, stage, StereoLayoutMono, StereoLayoutMono, interpolation);
+    }
+
+    cv::Mat ProgressiveConvertor::convertStereoStage(const cv::Mat& src, int stage, StereoLayout inLayout,
+                                                     StereoLayout outLayout, int interpolation) {
+        if (stage < 0 || stage >= getStageCount()) {
+            throw std::out_of_range("no such stage");
+        }
+        ProjectionConvertor& convertor = stages[stage];
+        const Projection& stageIn = *convertor.getInProjection();
+        cv::Size eyeSize(stageIn.getWidth(), stageIn.getHeight());
+        cv::Mat source = resizeSource(src, getStereoImageSize(eyeSize, inLayout));
+
+        bool last = stage + 1 == getStageCount();
+        if (!last) {
+            interpolation = cv::INTER_LINEAR;
+        }
+        cv::Mat dst;
+        if (convertor.convertStereoFast(source, dst, inLayout, outLayout, interpolation)) {
+            return dst;
+        }
+        if (stage > 0 && !last) {
+            convertor.updateFrom(stages[stage - 1]);
+        }
+        if (inLayout == StereoLayoutMono && outLayout == StereoLayoutMono) {
+            return convertor.convert_image(source, interpolation);
+        }
+        return convertor.convert_stereo(source, inLayout, outLayout, interpolation);
+    }
+
+    cv::Mat ProgressiveConvertor::convert(const cv::Mat& src, int interpolation, const StageCallback& callback) {
+        cv::Mat dst;
+        for (int stage = 0; stage < getStageCount(); ++stage) {
+            dst = convertStage(src, stage, interpolation);
+            if (callback) {
+                callback(stage, dst);
+            }
+        }
+        return dst;
+    }
+
+} // end namespace libprojector
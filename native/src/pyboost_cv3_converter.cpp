@@ -95,6 +95,9 @@ public:
 				depth == CV_16U ? NPY_USHORT :
 				depth == CV_16S ? NPY_SHORT :
 				depth == CV_32S ? NPY_INT :
+#ifdef CV_16F
+				depth == CV_16F ? NPY_HALF :
+#endif
 				depth == CV_32F ? NPY_FLOAT :
 				depth == CV_64F ?
 									NPY_DOUBLE :
@@ -166,6 +169,9 @@ Mat fromNDArrayToMat(PyObject* o) {
 					typenum == NPY_SHORT ? CV_16S :
 					typenum == NPY_INT ? CV_32S :
 					typenum == NPY_INT32 ? CV_32S :
+#ifdef CV_16F
+					typenum == NPY_HALF ? CV_16F :
+#endif
 					typenum == NPY_FLOAT ? CV_32F :
 					typenum == NPY_DOUBLE ? CV_64F : -1;
 
@@ -299,6 +305,9 @@ void* matFromNDArrayBoostConverter::convertible(PyObject* object) {
 			&& typenum != NPY_UBYTE && typenum != NPY_BYTE
 			&& typenum != NPY_USHORT && typenum != NPY_SHORT
 			&& typenum != NPY_INT && typenum != NPY_INT32
+#ifdef CV_16F
+			&& typenum != NPY_HALF
+#endif
 			&& typenum != NPY_FLOAT && typenum != NPY_DOUBLE) {
 		return NULL;
 	}
@@ -336,6 +345,9 @@ void matFromNDArrayBoostConverter::construct(PyObject* object,
 				typenum == NPY_SHORT ? CV_16S :
 				typenum == NPY_INT ? CV_32S :
 				typenum == NPY_INT32 ? CV_32S :
+#ifdef CV_16F
+				typenum == NPY_HALF ? CV_16F :
+#endif
 				typenum == NPY_FLOAT ? CV_32F :
 				typenum == NPY_DOUBLE ? CV_64F : -1;
 
@@ -92,6 +92,7 @@ public:
         depth == CV_16U ? NPY_USHORT :
         depth == CV_16S ? NPY_SHORT :
         depth == CV_32S ? NPY_INT :
+        depth == CV_16F ? NPY_HALF :
         depth == CV_32F ? NPY_FLOAT :
         depth == CV_64F ?
                   NPY_DOUBLE :
@@ -163,6 +164,7 @@ Mat fromNDArrayToMat(PyObject* o) {
           typenum == NPY_SHORT ? CV_16S :
           typenum == NPY_INT ? CV_32S :
           typenum == NPY_INT32 ? CV_32S :
+          typenum == NPY_HALF ? CV_16F :
           typenum == NPY_FLOAT ? CV_32F :
           typenum == NPY_DOUBLE ? CV_64F : -1;
 
@@ -296,7 +298,7 @@ void* matFromNDArrayBoostConverter::convertible(PyObject* object) {
       && typenum != NPY_UBYTE && typenum != NPY_BYTE
       && typenum != NPY_USHORT && typenum != NPY_SHORT
       && typenum != NPY_INT && typenum != NPY_INT32
-      && typenum != NPY_FLOAT && typenum != NPY_DOUBLE) {
+      && typenum != NPY_HALF && typenum != NPY_FLOAT && typenum != NPY_DOUBLE) {
     return NULL;
   }
   int ndims = PyArray_NDIM(oarr); //data type not supported
@@ -333,6 +335,7 @@ void matFromNDArrayBoostConverter::construct(PyObject* object,
         typenum == NPY_SHORT ? CV_16S :
         typenum == NPY_INT ? CV_32S :
         typenum == NPY_INT32 ? CV_32S :
+        typenum == NPY_HALF ? CV_16F :
         typenum == NPY_FLOAT ? CV_32F :
         typenum == NPY_DOUBLE ? CV_64F : -1;
 
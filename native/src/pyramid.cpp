@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <libprojector/half.hpp>
+#include <libprojector/image_io.hpp>
+#include <libprojector/pyramid.hpp>
+
+namespace libprojector {
+
+    namespace {
+
+        const char* SIDE_NAMES[6] = {"+x", "-x", "+y", "-y", "+z", "-z"};
+
+        // the existing directories are fine
+        void makeDirectory(const std::string& path) {
+#ifdef _WIN32
+            int result = _mkdir(path.c_str());
+#else
+            int result = mkdir(path.c_str(), 0755);
+#endif
+            struct stat info;
+            if (result != 0 && (stat(path.c_str(), &info) != 0 || !(info.st_mode & S_IFDIR))) {
+                throw std::runtime_error("unable to create '" + path + "'");
+            }
+        }
+
+        std::string getSideDirectory(const std::string& directory, int side) {
+            return directory + "/" + SIDE_NAMES[side] + "_files";
+        }
+
+        std::string getLevelDirectory(const std::string& directory, int side, int level) {
+            std::ostringstream path;
+            path << getSideDirectory(directory, side) << "/" << level;
+            return path.str();
+        }
+
+    } // end anonymous namespace
+
+    CubemapPyramid::CubemapPyramid(ProjectionPtr inProj, ProjectionPtr outProj, int _tileSize, int threads) :
+        convertor(inProj, outProj),
+        tileSize(_tileSize),
+        quality(-1),
+        format("jpg"),
+        pool(threads) {
+        const CubemapProjection* cubemap = dynamic_cast<const CubemapProjection*>(outProj.get());
+        if (cubemap == NULL) {
+            throw std::invalid_argument("the pyramids are made of the sides of a cubemap");
+        }
+        if (tileSize <= 0) {
+            throw std::invalid_argument("the tile size must be positive");
+        }
+        for (int side = 0; side < 6; ++side) {
+            sideRects.push_back(cubemap->getSideRect(side));
+        }
+
+        // halving (rounded up) down to a single pixel
+        levelSizes.push_back(sideRects[0].width);
+        while (levelSizes.back() > 1) {
+            levelSizes.push_back((levelSizes.back() + 1) / 2);
+        }
+        std::reverse(levelSizes.begin(), levelSizes.end());
+    }
+
+    cv::Rect CubemapPyramid::getTileRect(int level, int column, int row) const {
+        int size = levelSizes[level];
+        return cv::Rect(column * tileSize, row * tileSize, tileSize, tileSize) & cv::Rect(0, 0, size, size);
+    }
+
+    void CubemapPyramid::writeTile(const cv::Mat& tile, const std::string& directory, int side, int level, int column, int row) const {
+        std::ostringstream path;
+        path << getLevelDirectory(directory, side, level) << "/" << column << "_" << row << "." << format;
+        if (!cv::imwrite(path.str(), toEncodable(tile), getEncodeParams(path.str(), quality))) {
+            throw std::runtime_error("unable to write '" + path.str() + "'");
+        }
+    }
+
+    cv::Mat CubemapPyramid::downsampleTile(const cv::Mat children[4], int level, int column, int row) const {
+        // children by row: (2c, 2r), (2c + 1, 2r), (2c, 2r + 1), (2c + 1, 2r + 1)
+        int width = children[0].cols + (children[1].empty() ? 0 : children[1].cols);
+        int height = children[0].rows + (children[2].empty() ? 0 : children[2].rows);
+        cv::Mat canvas(height, width, children[0].type());
+        for (int i = 0; i < 4; ++i) {
+            if (!children[i].empty()) {
+                int x = (i % 2) ? children[0].cols : 0;
+                int y = (i / 2) ? children[0].rows : 0;
+                children[i].copyTo(canvas(cv::Rect(x, y, children[i].cols, children[i].rows)));
+            }
+        }
+
+        cv::Mat tile;
+        resizeImage(canvas, tile, getTileRect(level, column, row).size(), cv::INTER_AREA);
+        return tile;
+    }
+
+    cv::Mat CubemapPyramid::renderTile(const cv::Mat& src, const MipPyramid* mipPyramid, const std::string& directory,
+                                       int side, int level, int column, int row, int interpolation) {
+        cv::Mat tile;
+        if (level + 1 == getLevelCount()) {
+            cv::Rect rect = getTileRect(level, column, row);
+            ProjectionConvertor region = convertor.region(rect + sideRects[side].tl());
+            region.convertRays(sideRays[side]->getRays()(rect));
+            region.prepare(interpolation);
+            tile = region.remapImage(src, interpolation, mipPyramid);
+        } else {
+            int count = getTileCount(level + 1);
+            cv::Mat children[4];
+            for (int i = 0; i < 4; ++i) {
+                int childColumn = 2 * column + i % 2;
+                int childRow = 2 * row + i / 2;
+                if (childColumn < count && childRow < count) {
+                    children[i] = renderTile(src, mipPyramid, directory, side, level + 1, childColumn, childRow,
+                                             interpolation);
+                }
+            }
+            tile = downsampleTile(children, level, column, row);
+        }
+        writeTile(tile, directory, side, level, column, row);
+        return tile;
+    }
+
+    void CubemapPyramid::write(const cv::Mat& src, const std::string& directory, int interpolation) {
+        makeDirectory(directory);
+        for (int side = 0; side < 6; ++side) {
+            makeDirectory(getSideDirectory(directory, side));
+            for (int level = 0; level < getLevelCount(); ++level) {
+                makeDirectory(getLevelDirectory(directory, side, level));
+            }
+
+            std::ofstream dzi((directory + "/" + SIDE_NAMES[side] + ".dzi").c_str());
+            dzi << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" TileSize=\"" << tileSize
+                << "\" Overlap=\"0\" Format=\"" << format << "\">\n"
+                << "  <Size Width=\"" << levelSizes.back() << "\" Height=\"" << levelSizes.back() << "\"/>\n"
+                << "</Image>\n";
+            if (!dzi) {
+                throw std::runtime_error("unable to write the descriptors into '" + directory + "'");
+            }
+        }
+
+        // the rays of the sides, cut from the field of the whole output when
+        // the cache has it
+        if (sideRays.empty()) {
+            for (int side = 0; side < 6; ++side) {
+                ProjectionPtr sideProj(new RegionProjection(convertor.getOutProjection(), sideRects[side]));
+                sideRays.push_back(getRayFieldCache().get(sideProj));
+            }
+        }
+
+        // the tiles sample one float copy of a half float source, and one
+        // mip pyramid of it
+        cv::Mat values = src;
+        if (src.depth() == DEPTH_HALF) {
+            convertFromHalf(src, values);
+        }
+        boost::shared_ptr<MipPyramid> mipPyramid;
+        if (interpolation == INTER_NATIVE_MIPMAP) {
+            mipPyramid.reset(new MipPyramid(values));
+        }
+
+        // the subtrees from the coarsest level with enough tiles to keep the
+        // pool busy are rendered in parallel, the levels above them from the
+        // tiles they return
+        int splitLevel = 0;
+        while (splitLevel + 1 < getLevelCount() && 6 * getTileCount(splitLevel) * getTileCount(splitLevel) < 4 * pool.size()) {
+            ++splitLevel;
+        }
+
+        int count = getTileCount(splitLevel);
+        std::vector<cv::Mat> tiles(6 * count * count);
+        pool.forEach(tiles.size(), [&](size_t i) {
+            int side = static_cast<int>(i) / (count * count);
+            int index = static_cast<int>(i) % (count * count);
+            tiles[i] = renderTile(values, mipPyramid.get(), directory, side, splitLevel, index % count, index / count,
+                                  interpolation);
+        });
+
+        for (int level = splitLevel - 1; level >= 0; --level) {
+            int childCount = count;
+            count = getTileCount(level);
+            std::vector<cv::Mat> children = tiles;
+            tiles.assign(6 * count * count, cv::Mat());
+            pool.forEach(tiles.size(), [&](size_t i) {
+                int side = static_cast<int>(i) / (count * count);
+                int index = static_cast<int>(i) % (count * count);
+                int column = index % count, row = index / count;
+                cv::Mat quad[4];
+                for (int j = 0; j < 4; ++j) {
+                    int childColumn = 2 * column + j % 2;
+                    int childRow = 2 * row + j / 2;
+                    if (childColumn < childCount && childRow < childCount) {
+                        quad[j] = children[(side * childCount + childRow) * childCount + childColumn];
+                    }
+                }
+                tiles[i] = downsampleTile(quad, level, column, row);
+                writeTile(tiles[i], directory, side, level, column, row);
+            });
+        }
+    }
+
+} // end namespace libprojector
@@ -2,8 +2,18 @@
 
 #include <iostream>
 #include <boost/python.hpp>
+#include <boost/python/stl_iterator.hpp>
 #include <pyboostcvconverter/pyboostcvconverter.hpp>
 
+#include <libprojector/batch.hpp>
+#include <libprojector/convertor.hpp>
+#include <libprojector/image_io.hpp>
+#include <libprojector/multi_target.hpp>
+#include <libprojector/progressive.hpp>
+#include <libprojector/projections.hpp>
+#include <libprojector/pyramid.hpp>
+#include <libprojector/tiled_source.hpp>
+
 namespace libprojector {
 
     using namespace boost::python;
@@ -12,313 +22,179 @@ namespace libprojector {
         return os << boost::python::extract<std::string>(boost::python::str(o))();
     }
 
-    struct Ray {
-        double x;
-        double y;
-        double z;
-    };
-
-    struct TexCoords {
-        double u;
-        double v;
-    };
+    // Releases the GIL for the lifetime of the object
+    class ScopedGILRelease {
+    private:
+        PyThreadState* state;
 
-    class Projection {
     public:
-        // Empty virtual destructor for proper cleanup
-        virtual ~Projection() {}
-
-        virtual int getWidth() const = 0;
-        virtual int getHeight() const = 0;
-        virtual void toRay(double u, double v, Ray& r) const = 0;
-        virtual void toTexCoords(Ray r, TexCoords& point) const = 0;
+        ScopedGILRelease() : state(PyEval_SaveThread()) {}
+        ~ScopedGILRelease() { PyEval_RestoreThread(state); }
     };
 
-    typedef boost::shared_ptr<Projection> ProjectionPtr;
-
-    class SphericalProjection: public Projection {
-    private:
-        double imageMidWidth;
-        double imageMidHeight;
-        double scale;
+    static void batch_set_rotation(BatchConvertor& batch, double yaw, double pitch, double roll) {
+        batch.setRotation(Rotation::fromEuler(yaw, pitch, roll));
+    }
 
-    public:
-        SphericalProjection(int _imageWidth, int _imageHeight) : 
-            imageMidWidth(static_cast<double>(_imageWidth)/2),
-            imageMidHeight(static_cast<double>(_imageHeight)/2) {
-                scale = imageMidWidth / M_PI;
+    // The conversion runs without the GIL, which is taken back to report
+    // each result to `callback(input, output, success, error)`
+    static void batch_run(BatchConvertor& batch, object callback) {
+        BatchConvertor::ResultCallback onResult = [&callback](const BatchResult& result) {
+            PyGILState_STATE gil = PyGILState_Ensure();
+            try {
+                if (!callback.is_none()) {
+                    callback(result.input, result.output, result.success, result.error);
+                }
+            } catch (const error_already_set&) {
+                PyErr_Print();
             }
+            PyGILState_Release(gil);
+        };
 
-        int getWidth() const {
-            return static_cast<int>(2 * imageMidWidth);
-        }
-
-        int getHeight() const {
-            return static_cast<int>(2 * imageMidHeight);
-        }
-
-        void toRay(double u, double v, Ray& r) const {
-            u -= imageMidWidth;
-            v -= imageMidHeight;
+        ScopedGILRelease release;
+        batch.run(onResult);
+    }
 
-            // ensure u-axis negative on the center left, positive on center right
-            // ensure v-axis negative on the center bottom, positive on center top
-            // u *= -1.0;
-            v *= -1.0;
+    // Without the GIL, so that the conversions of other threads go on meanwhile
+    static cv::Mat batch_convert_image(BatchConvertor& batch, cv::Mat image, double yaw, double pitch, double roll) {
+        ScopedGILRelease release;
+        return batch.convertImage(image, Rotation::fromEuler(yaw, pitch, roll));
+    }
 
-            u /= scale;
-            v /= scale;
+    template<typename T>
+    static std::vector<T> to_vector(object iterable) {
+        return std::vector<T>(stl_input_iterator<T>(iterable), stl_input_iterator<T>());
+    }
 
-            double sinv = sinf(M_PI_2 - v);
-            r.x = sinv * cosf(u);
-            r.y = sinv * sinf(u);
-            r.z = cosf(M_PI_2 - v);
+    static object probe_image_size(const std::string& path) {
+        cv::Size size;
+        bool found;
+        {
+            ScopedGILRelease release;
+            found = probeImageSize(path, size);
         }
+        return found ? object(make_tuple(size.width, size.height)) : object();
+    }
 
-        void toTexCoords(Ray r, TexCoords& point) const {
-            // NB: we take the asumption the the ray is on the unit sphere
-            double u = scale * atan2f(r.y, r.x);
-            double v = scale * (M_PI_2 - acosf(r.z));
-
-            v *= -1.0;
-
-            u += imageMidWidth;
-            v += imageMidHeight;
-
-            point.u = u;
-            point.v = v;
+    static tuple image_size(const std::string& path) {
+        cv::Size size;
+        {
+            ScopedGILRelease release;
+            size = getImageSize(path);
         }
-    };
-
-    /**
-     Cubemap projection associated with the following cubemap layout
-     
-     Input layout
-
-      -------- -------- -------- -------- -------- --------
-     |   +x   |   -x   |   +y   |   -y   |   +z   |   -z   |
-     |  side  |  side  |  side  |  side  |  side  |  side  |
-      -------- -------- -------- -------- -------- --------
-
-     */
-    class CubemapProjection: public Projection {
-    private:
-        double sideWidth;
-        double sideBorderPadding;  // can be used to give some pixels to the interpolation on the borders
-
-    public:
-        CubemapProjection(int _sideWidth, int _sideBorderPadding) : 
-            sideWidth(static_cast<double>(_sideWidth)),
-            sideBorderPadding(static_cast<double>(_sideBorderPadding)) {}
+        return make_tuple(size.width, size.height);
+    }
 
-        int getWidth() const {
-            return static_cast<int>(6 * sideWidth);
+    static list read_images(object paths, int flags) {
+        std::vector<std::string> pathList = to_vector<std::string>(paths);
+        std::vector<cv::Mat> images;
+        {
+            ScopedGILRelease release;
+            images = readImages(getIOPool(), pathList, flags);
         }
-
-        int getHeight() const {
-            return static_cast<int>(1 * sideWidth);
+        list result;
+        for (size_t i = 0; i < images.size(); ++i) {
+            result.append(images[i]);
         }
+        return result;
+    }
 
-        void toRay(double u, double v, Ray& ray) const {
-            int offsetXIndex = floor(u / sideWidth);
-            int offsetYIndex = floor(v / sideWidth);
-
-            // local (side) coords [-1,1]
-            double uu = 2.0 * ((u - (offsetXIndex * sideWidth)) / sideWidth) - 1.0;
-            double vv = 2.0 * ((v - (offsetYIndex * sideWidth)) / sideWidth) - 1.0;
-
-            ray.x = 0;
-            ray.y = 0;
-            ray.z = 0;
-
-            double maxAxis = sqrtf(1.0 / (1.0 + uu*uu + vv*vv));
-
-            // +x
-            if (offsetXIndex == 0 && offsetYIndex == 0) {
-                // uu [-1,1] from -y to +y
-                // vv [-1,1] from +z to -z
-                ray.y = uu * maxAxis;
-                ray.z = -vv * maxAxis;
-                ray.x = maxAxis;
-            }
-            // -x
-            if (offsetXIndex == 1 && offsetYIndex == 0) {
-                // uu [-1,1] from +y to -y
-                // vv [-1,1] from +z to -z
-                ray.y = -uu * maxAxis;
-                ray.z = -vv * maxAxis;
-                ray.x = -1.0 * maxAxis;
-            }
-            // +y
-            if (offsetXIndex == 2 && offsetYIndex == 0) {
-                // uu [-1,1] from +x to -x
-                // vv [-1,1] from +z to -z
-                ray.x = -uu * maxAxis;
-                ray.z = -vv * maxAxis;
-                ray.y = maxAxis;
-            }
-            // -y
-            if (offsetXIndex == 3 && offsetYIndex == 0) {
-                // uu [-1,1] from -x to +x
-                // vv [-1,1] from +z to -z
-                ray.x = uu * maxAxis;
-                ray.z = -vv * maxAxis;
-                ray.y = -1.0 * maxAxis;
-            }
-            // +z
-            if (offsetXIndex == 4 && offsetYIndex == 0) {
-                // u in [-1,1] from -x to +x
-                // v in [-1,1] from +y to -y
-                ray.x = uu * maxAxis;
-                ray.y = -vv * maxAxis;
-                ray.z = maxAxis;
-            }
-            // -z
-            if (offsetXIndex == 5 && offsetYIndex == 0) {
-                // u in [-1,1] from -x to +x
-                // v in [-1,1] from -y to +y
-                ray.x = uu * maxAxis;
-                ray.y = vv * maxAxis;
-                ray.z = -1.0 * maxAxis;
-            }
+    static cv::Mat read_cubemap(object paths, int flags) {
+        std::vector<std::string> pathList = to_vector<std::string>(paths);
+        ScopedGILRelease release;
+        return readCubemap(getIOPool(), pathList, flags);
+    }
 
-            // Security check
-            // if (isnan(ray.x) || isnan(ray.y) || isnan(ray.z)) {
-            //     std::cerr << "tex(u,v) = " << uu << "," << vv << std::endl;
-            //     std::cerr << "ray(x,y,z) = " << ray.x << "," << ray.y << "," << ray.z << std::endl;
-            // }
-        }
+    static void write_images(object paths, object images, int quality) {
+        std::vector<std::string> pathList = to_vector<std::string>(paths);
+        std::vector<cv::Mat> imageList = to_vector<cv::Mat>(images);
+        ScopedGILRelease release;
+        writeImages(getIOPool(), pathList, imageList, quality);
+    }
 
-        void toTexCoords(Ray r, TexCoords& point) const {
-            double absX = fabs(r.x);
-            double absY = fabs(r.y);
-            double absZ = fabs(r.z);
-
-            bool isXPositive = (r.x > 0);
-            bool isYPositive = (r.y > 0);
-            bool isZPositive = (r.z > 0);
-
-            double maxAxis;
-            double offsetXIndex, offsetYIndex;
-            double u, v;
-
-            // +x
-            if (isXPositive && absX >= absY && absX >= absZ) {
-                // u in [0,1] from -y to +y
-                // v in [0,1] from +z to -z
-                maxAxis = absX;
-                offsetXIndex = 0;
-                offsetYIndex = 0;
-                u = r.y;
-                v = -r.z;
-            }
-            // -x
-            if (!isXPositive && absX >= absY && absX >= absZ) {
-                // u in [0,1] from +y to -y
-                // v in [0,1] from -z to +z
-                maxAxis = absX;
-                offsetXIndex = 1;
-                offsetYIndex = 0;
-                u = -r.y;
-                v = -r.z;
-            }
+    // the angles of the python API are in degrees
+    static boost::shared_ptr<FisheyeProjection> make_fisheye(int width, int height, FisheyeModel model, double fov,
+                                                             double centerX, double centerY, double radius, double feather) {
+        return boost::shared_ptr<FisheyeProjection>(new FisheyeProjection(
+            width, height, model, fov * M_PI / 180, centerX, centerY, radius, feather * M_PI / 180));
+    }
 
-            // +y
-            if (isYPositive && absY >= absX && absY >= absZ) {
-                // u in [0,1] from +x to -x
-                // v in [0,1] from +z to -z
-                maxAxis = absY;
-                offsetXIndex = 2;
-                offsetYIndex = 0;
-                u = -r.x;
-                v = -r.z;
-            }
-            // -y
-            if (!isYPositive && absY >= absX && absY >= absZ) {
-                // u in [0,1] from -x to +x
-                // v in [0,1] from +z to -z
-                maxAxis = absY;
-                offsetXIndex = 3;
-                offsetYIndex = 0;
-                u = r.x;
-                v = -r.z;
-            }
+    static void fisheye_set_rotation(FisheyeProjection& fisheye, double yaw, double pitch, double roll) {
+        fisheye.setRotation(Rotation::fromEuler(yaw, pitch, roll).m);
+    }
 
-            // +z
-            if (isZPositive && absZ >= absX && absZ >= absY) {
-                // u in [0,1] from -x to +x
-                // v in [0,1] from +y to -y
-                maxAxis = absZ;
-                offsetXIndex = 4;
-                offsetYIndex = 0;
-                u = r.x;
-                v = -r.y;
-            }
-            // -z
-            if (!isZPositive && absZ >= absX && absZ >= absY) {
-                // u in [0,1] from -x to +x
-                // v in [0,1] from -y to +y
-                maxAxis = absZ;
-                offsetXIndex = 5;
-                offsetYIndex = 0;
-                u = r.x;
-                v = r.y;
-            }
+    static boost::shared_ptr<DualFisheyeProjection> make_dual_fisheye(int width, int height, FisheyeModel model,
+                                                                      double fov, double feather) {
+        return boost::shared_ptr<DualFisheyeProjection>(new DualFisheyeProjection(
+            DualFisheyeProjection::centered(width, height, model, fov * M_PI / 180, feather * M_PI / 180)));
+    }
 
-            // convert range from [-1,1] to [0,1]
-            u = 0.5 * (u / maxAxis + 1.0);
-            v = 0.5 * (v / maxAxis + 1.0);
+    static ProjectionConvertor convertor_region(const ProjectionConvertor& convertor, int x, int y, int width, int height) {
+        return convertor.region(cv::Rect(x, y, width, height));
+    }
 
-            // convert the (u,v) to the layout described in the class comment (cross layout)
-            point.u = offsetXIndex * sideWidth + sideBorderPadding + u * (sideWidth - 2*sideBorderPadding);
-            point.v = offsetYIndex * sideWidth + sideBorderPadding + v * (sideWidth - 2*sideBorderPadding);
+    static list convert_sides(const ProjectionConvertor& convertor, cv::Mat src, object sides, int interpolation) {
+        std::vector<cv::Mat> images = convertor.convertSides(src, to_vector<int>(sides), interpolation);
+        list result;
+        for (size_t i = 0; i < images.size(); ++i) {
+            result.append(images[i]);
         }
-    };
+        return result;
+    }
 
-    typedef enum ProjectionType {
-        ProjectionTypeSpherical,
-        ProjectionTypeCubemap,
-    } ProjectionType;
+    static tuple progressive_stage_size(const ProgressiveConvertor& convertor, int stage) {
+        cv::Size size = convertor.getStageSize(stage);
+        return make_tuple(size.width, size.height);
+    }
 
-    class ProjectionConvertor {
-    private:
-        ProjectionPtr inProj;
-        ProjectionPtr outProj;
-        cv::Mat mapX;
-        cv::Mat mapY;
+    // `callback(stage, image)` is called with each stage as it's converted
+    static cv::Mat progressive_convert(ProgressiveConvertor& convertor, cv::Mat src, int interpolation, object callback) {
+        ProgressiveConvertor::StageCallback onStage;
+        if (!callback.is_none()) {
+            onStage = [&callback](int stage, const cv::Mat& image) {
+                callback(stage, image);
+            };
+        }
+        return convertor.convert(src, interpolation, onStage);
+    }
 
-    public:
-        ProjectionConvertor(ProjectionPtr _inProj, ProjectionPtr _outProj) : 
-            inProj(_inProj),
-            outProj(_outProj) {}
+    static tuple tiled_source_size(const TiledSource& source, int level) {
+        cv::Size size = source.getSize(level);
+        return make_tuple(size.width, size.height);
+    }
 
-        cv::Mat get_map_x() const { return mapX; }
-        cv::Mat get_map_y() const { return mapY; }
+    static void write_tiled_source(const std::string& path, cv::Mat image, int tileSize) {
+        TiledSource::write(path, image, tileSize);
+    }
 
-        void convert() {
-            int width = outProj->getWidth();
-            int height = outProj->getHeight();
+    static list multi_target_convert(MultiTargetConvertor& convertor, cv::Mat src) {
+        std::vector<cv::Mat> outputs = convertor.convert(src);
+        list result;
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            result.append(outputs[i]);
+        }
+        return result;
+    }
 
-            mapX = cv::Mat(height, width, CV_32FC1);
-            mapY = cv::Mat(height, width, CV_32FC1);
+    static void set_ray_field_cache_capacity(size_t capacity) {
+        getRayFieldCache().setCapacity(capacity);
+    }
 
-            for (int x = 0; x < width; ++x) {
-                for (int y = 0; y < height; ++y) {
-                    Ray r;
-                    outProj->toRay(static_cast<double>(x), static_cast<double>(y), r);
-                    // std::cout << "ray(x,y,z) = " << r.x << "," << r.y << "," << r.z << std::endl;
+    static size_t ray_field_cache_bytes() {
+        return getRayFieldCache().getBytes();
+    }
 
-                    TexCoords t;
-                    inProj->toTexCoords(r, t);
-                    // std::cout << "tex(u,v) = " << t.u << "," << t.v << std::endl;
+    static void clear_ray_field_cache() {
+        getRayFieldCache().clear();
+    }
 
-                    mapX.at<float>(y,x) = static_cast<float>(t.u);
-                    mapY.at<float>(y,x) = static_cast<float>(t.v);
-                }
-            }
-        }
-    };
+    static cv::Mat to_image_depth(cv::Mat image, ImageDepth depth) {
+        return toImageDepth(image, depth);
+    }
 
+    static int reduced_decode_scale(ProjectionPtr inProj, ProjectionPtr outProj, int maxScale) {
+        return getReducedDecodeScale(*inProj, *outProj, maxScale);
+    }
 
 #if (PY_VERSION_HEX >= 0x03000000)
     static void *init_ar() {
@@ -345,14 +221,138 @@ namespace libprojector {
 
         //expose module-level functions
         class_<SphericalProjection>("SphericalProjection", init<int, int>());
-        class_<CubemapProjection>("CubemapProjection", init<int, int>());
+        class_<BandedSphericalProjection>("BandedSphericalProjection", init<int>());
+        enum_<CubemapLayout>("CubemapLayout")
+            .value("strip", CubemapLayoutStrip)
+            .value("grid_3x2", CubemapLayout3x2)
+            .value("horizontal_cross", CubemapLayoutHorizontalCross)
+            .value("vertical_cross", CubemapLayoutVerticalCross);
+        class_<CubemapProjection>("CubemapProjection", init<int, int, optional<CubemapLayout, bool> >());
+        class_<EquiAngularCubemapProjection, bases<CubemapProjection> >("EquiAngularCubemapProjection",
+                                                                        init<int, int, optional<CubemapLayout, bool> >());
+        class_<OctahedralProjection>("OctahedralProjection", init<int, optional<int> >());
+        enum_<FisheyeModel>("FisheyeModel")
+            .value("equidistant", FisheyeModelEquidistant)
+            .value("equisolid", FisheyeModelEquisolid);
+        class_<FisheyeProjection>("FisheyeProjection", no_init)
+            .def("__init__", make_constructor(&make_fisheye, default_call_policies(),
+                                              (arg("width"), arg("height"), arg("model"), arg("fov"),
+                                               arg("center_x"), arg("center_y"), arg("radius"), arg("feather") = 0.0)))
+            .def("set_rotation", &fisheye_set_rotation);
+        class_<DualFisheyeProjection>("DualFisheyeProjection", init<FisheyeProjection, FisheyeProjection>())
+            .def("__init__", make_constructor(&make_dual_fisheye, default_call_policies(),
+                                              (arg("width"), arg("height"), arg("model"), arg("fov"), arg("feather"))))
+            .def("get_lens", &DualFisheyeProjection::getLens, return_value_policy<copy_const_reference>())
+            .def("set_lens", &DualFisheyeProjection::setLens);
         class_<ProjectionConvertor>("ProjectionConvertor", init<ProjectionPtr, ProjectionPtr>())
             .def("convert", &ProjectionConvertor::convert)
+            .def("update", &ProjectionConvertor::update)
+            .def("set_rotation", &ProjectionConvertor::set_rotation)
+            .def("set_rotation_quaternion", &ProjectionConvertor::set_rotation_quaternion)
+            .def("set_rotation_matrix", &ProjectionConvertor::set_rotation_matrix)
+            .def("convert_image", &ProjectionConvertor::convert_image)
+            .def("convert_yuv", &ProjectionConvertor::convert_yuv)
+            .def("convert_stereo", &ProjectionConvertor::convert_stereo)
+            .def("region", &convertor_region)
+            .def("convert_region", &ProjectionConvertor::convert_region)
+            .def("convert_sides", &convert_sides)
+            .def("convert_tiled", &ProjectionConvertor::convert_tiled)
             .def("get_map_x", &ProjectionConvertor::get_map_x)
             .def("get_map_y", &ProjectionConvertor::get_map_y);
 
+        class_<ProgressiveConvertor>("ProgressiveConvertor", init<ProjectionPtr, ProjectionPtr, optional<int, int> >())
+            .def("set_rotation", &ProgressiveConvertor::set_rotation)
+            .def("stage_count", &ProgressiveConvertor::getStageCount)
+            .def("stage_size", &progressive_stage_size)
+            .def("stage_decode_scale", &ProgressiveConvertor::getStageDecodeScale)
+            .def("convert_stage", &ProgressiveConvertor::convertStage)
+            .def("convert_stereo_stage", &ProgressiveConvertor::convertStereoStage)
+            .def("convert_image", &progressive_convert);
+
+        class_<MultiTargetConvertor, boost::noncopyable>("MultiTargetConvertor", init<ProjectionPtr, optional<int> >())
+            .def("add_target", &MultiTargetConvertor::addTarget)
+            .def("set_rotation", &MultiTargetConvertor::set_rotation)
+            .def("decode_scale", &MultiTargetConvertor::getDecodeScale)
+            .def("convert", &multi_target_convert)
+            .def("__len__", &MultiTargetConvertor::size);
+
+        class_<CubemapPyramid, boost::noncopyable>("CubemapPyramid", init<ProjectionPtr, ProjectionPtr, optional<int, int> >())
+            .def("set_rotation", &CubemapPyramid::set_rotation)
+            .def("set_quality", &CubemapPyramid::setQuality)
+            .def("set_format", &CubemapPyramid::setFormat)
+            .def("level_count", &CubemapPyramid::getLevelCount)
+            .def("level_size", &CubemapPyramid::getLevelSize)
+            .def("write", &CubemapPyramid::write);
+
+        class_<TiledSource, boost::noncopyable>("TiledSource", init<std::string, size_t>())
+            .def("level_count", &TiledSource::getLevelCount)
+            .def("size", &tiled_source_size)
+            .def("tile_size", &TiledSource::getTileSize)
+            .def("resident_bytes", &TiledSource::getResidentBytes)
+            .def("peak_bytes", &TiledSource::getPeakBytes);
+
         implicitly_convertible<boost::shared_ptr<SphericalProjection>, ProjectionPtr>();
+        implicitly_convertible<boost::shared_ptr<BandedSphericalProjection>, ProjectionPtr>();
         implicitly_convertible<boost::shared_ptr<CubemapProjection>, ProjectionPtr>();
+        implicitly_convertible<boost::shared_ptr<EquiAngularCubemapProjection>, ProjectionPtr>();
+        implicitly_convertible<boost::shared_ptr<OctahedralProjection>, ProjectionPtr>();
+        implicitly_convertible<boost::shared_ptr<FisheyeProjection>, ProjectionPtr>();
+        implicitly_convertible<boost::shared_ptr<DualFisheyeProjection>, ProjectionPtr>();
+
+        enum_<ProjectionType>("ProjectionType")
+            .value("spherical", ProjectionTypeSpherical)
+            .value("cubemap", ProjectionTypeCubemap)
+            .value("equi_angular_cubemap", ProjectionTypeEquiAngularCubemap)
+            .value("banded_spherical", ProjectionTypeBandedSpherical)
+            .value("octahedral", ProjectionTypeOctahedral)
+            .value("fisheye", ProjectionTypeFisheye)
+            .value("dual_fisheye", ProjectionTypeDualFisheye)
+            .value("region", ProjectionTypeRegion)
+            .value("scaled", ProjectionTypeScaled);
+        enum_<YUVFormat>("YUVFormat")
+            .value("i420", YUVFormatI420)
+            .value("nv12", YUVFormatNV12);
+        enum_<ImageDepth>("ImageDepth")
+            .value("uint8", ImageDepth8U)
+            .value("uint16", ImageDepth16U)
+            .value("float16", ImageDepthHalf)
+            .value("float32", ImageDepthFloat);
+        enum_<StereoLayout>("StereoLayout")
+            .value("mono", StereoLayoutMono)
+            .value("top_bottom", StereoLayoutTopBottom)
+            .value("side_by_side", StereoLayoutSideBySide);
+        class_<ProjectionSpec>("ProjectionSpec", init<ProjectionType, int, optional<CubemapLayout, StereoLayout> >())
+            .def("set_lens", &ProjectionSpec::setLens)
+            .def_readwrite("gutters", &ProjectionSpec::gutters);
+        class_<BatchConvertor, boost::noncopyable>("BatchConvertor", init<ProjectionSpec, ProjectionSpec, int, int>())
+            .def(init<ProjectionSpec, ProjectionSpec, int, BatchConvertor&>())
+            .def("add_job", &BatchConvertor::addJob)
+            .def("set_rotation", &batch_set_rotation)
+            .def("set_interpolation", &BatchConvertor::setInterpolation)
+            .def("set_quality", &BatchConvertor::setQuality)
+            .def("set_depth", &BatchConvertor::setDepth)
+            .def("set_map_cache_capacity", &BatchConvertor::setMapCacheCapacity)
+            .def("map_cache_bytes", &BatchConvertor::getMapCacheBytes)
+            .def("run", &batch_run)
+            .def("convert_image", &batch_convert_image)
+            .def("__len__", &BatchConvertor::size);
+
+        scope().attr("INTER_MIPMAP") = static_cast<int>(INTER_NATIVE_MIPMAP);
+        scope().attr("INTER_BICUBIC") = static_cast<int>(INTER_NATIVE_BICUBIC);
+        scope().attr("INTER_LANCZOS3") = static_cast<int>(INTER_NATIVE_LANCZOS3);
+
+        def("reduced_decode_scale", &reduced_decode_scale);
+        def("decode_flags", &getDecodeFlags);
+        def("to_image_depth", &to_image_depth);
+        def("probe_image_size", &probe_image_size);
+        def("image_size", &image_size);
+        def("read_images", &read_images);
+        def("read_cubemap", &read_cubemap);
+        def("write_images", &write_images);
+        def("write_tiled_source", &write_tiled_source);
+        def("set_ray_field_cache_capacity", &set_ray_field_cache_capacity);
+        def("ray_field_cache_bytes", &ray_field_cache_bytes);
+        def("clear_ray_field_cache", &clear_ray_field_cache);
     }
 
 } //end namespace libprojector
@@ -0,0 +1,118 @@
+#include <libprojector/ray_field.hpp>
+#include <libprojector/tiling.hpp>
+
+namespace libprojector {
+
+    namespace {
+
+        class RayFieldBuilder: public cv::ParallelLoopBody {
+        private:
+            const Projection& proj;
+            const TileGrid& grid;
+            cv::Mat& rays;
+
+        public:
+            RayFieldBuilder(const Projection& _proj, const TileGrid& _grid, cv::Mat& _rays) :
+                proj(_proj),
+                grid(_grid),
+                rays(_rays) {}
+
+            void operator()(const cv::Range& range) const {
+                for (int i = range.start; i < range.end; ++i) {
+                    const cv::Rect& tile = grid[i];
+                    for (int y = tile.y; y < tile.y + tile.height; ++y) {
+                        cv::Vec2f* row = rays.ptr<cv::Vec2f>(y);
+                        for (int x = tile.x; x < tile.x + tile.width; ++x) {
+                            Ray r;
+                            proj.toRay(static_cast<double>(x), static_cast<double>(y), r);
+                            row[x] = encodeRay(r);
+                        }
+                    }
+                }
+            }
+        };
+
+        // default capacity of the shared cache, e.g. 16 fields of 2048x2048
+        const size_t DEFAULT_CAPACITY = 512 << 20;
+
+    } // end anonymous namespace
+
+    RayField::RayField(const Projection& proj) {
+        rays.create(proj.getHeight(), proj.getWidth(), CV_32FC2);
+        TileGrid grid(rays.cols, rays.rows, TileGrid::tileSizeFor(getCacheSize(1), 2 * sizeof(float)));
+        RayFieldBuilder builder(proj, grid, rays);
+        cv::parallel_for_(cv::Range(0, grid.size()), builder);
+    }
+
+    RayFieldPtr RayFieldCache::find(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<std::string, Entry>::iterator entry = entries.find(key);
+        if (entry == entries.end()) {
+            return RayFieldPtr();
+        }
+        recentKeys.splice(recentKeys.begin(), recentKeys, entry->second.recent);
+        return entry->second.field;
+    }
+
+    RayFieldPtr RayFieldCache::get(const ProjectionPtr& proj) {
+        if (proj->getType() == ProjectionTypeRegion) {
+            const RegionProjection* region = static_cast<const RegionProjection*>(proj.get());
+            RayFieldPtr base = find(region->getBase()->getKey());
+            if (base) {
+                return RayFieldPtr(new RayField(base->getRays()(region->getRegion())));
+            }
+            return RayFieldPtr(new RayField(*proj));
+        }
+
+        std::string key = proj->getKey();
+        RayFieldPtr field = find(key);
+        if (field) {
+            return field;
+        }
+
+        field.reset(new RayField(*proj));
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entries.find(key) == entries.end() && field->getBytes() <= capacity) {
+            recentKeys.push_front(key);
+            Entry& entry = entries[key];
+            entry.field = field;
+            entry.recent = recentKeys.begin();
+            bytes += field->getBytes();
+            evict();
+        }
+        return field;
+    }
+
+    void RayFieldCache::evict() {
+        while (bytes > capacity && !recentKeys.empty()) {
+            std::map<std::string, Entry>::iterator oldest = entries.find(recentKeys.back());
+            bytes -= oldest->second.field->getBytes();
+            entries.erase(oldest);
+            recentKeys.pop_back();
+        }
+    }
+
+    void RayFieldCache::setCapacity(size_t _capacity) {
+        std::lock_guard<std::mutex> lock(mutex);
+        capacity = _capacity;
+        evict();
+    }
+
+    size_t RayFieldCache::getBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return bytes;
+    }
+
+    void RayFieldCache::clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        recentKeys.clear();
+        bytes = 0;
+    }
+
+    RayFieldCache& getRayFieldCache() {
+        static RayFieldCache cache(DEFAULT_CAPACITY);
+        return cache;
+    }
+
+} // end namespace libprojector
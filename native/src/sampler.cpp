@@ -0,0 +1,487 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <libprojector/half.hpp>
+#include <libprojector/sampler.hpp>
+
+namespace libprojector {
+
+    namespace {
+
+        inline int wrap(int i, int size) {
+            i %= size;
+            return i < 0 ? i + size : i;
+        }
+
+        // the samplers interpolate in float whatever the storage
+        inline float load(uchar value) { return value; }
+        inline float load(ushort value) { return value; }
+        inline float load(float value) { return value; }
+
+#if CV_SIMD128
+        // 4 samples loaded as float, see accumulateSpan
+        inline cv::v_float32x4 loadFloat4(const uchar* p) {
+            return cv::v_cvt_f32(cv::v_reinterpret_as_s32(cv::v_load_expand_q(p)));
+        }
+
+        inline cv::v_float32x4 loadFloat4(const ushort* p) {
+            return cv::v_cvt_f32(cv::v_reinterpret_as_s32(cv::v_load_expand(p)));
+        }
+
+        inline cv::v_float32x4 loadFloat4(const float* p) {
+            return cv::v_load(p);
+        }
+#endif
+
+        // acc[i] += weight * values[i] for i in [0, count), 4 at a time with
+        // the universal intrinsics of OpenCV where the target has them
+        template<typename T>
+        inline void accumulateSpan(float* acc, const T* values, float weight, int count) {
+            int i = 0;
+#if CV_SIMD128
+            cv::v_float32x4 w = cv::v_setall_f32(weight);
+            for (; i + 4 <= count; i += 4) {
+                cv::v_store(acc + i, cv::v_fma(w, loadFloat4(values + i), cv::v_load(acc + i)));
+            }
+#endif
+            for (; i < count; ++i) {
+                acc[i] += weight * load(values[i]);
+            }
+        }
+
+        template<typename T>
+        inline T store(float value) {
+            return cv::saturate_cast<T>(value);
+        }
+
+        // derivative along a row or a column, see computeLodMap
+        inline float derivative(float before, float value, float after, bool hasBefore, bool hasAfter, float wrapWidth) {
+            float best = 0;
+            bool found = false;
+            float candidates[2] = {value - before, after - value};
+            bool available[2] = {hasBefore, hasAfter};
+            for (int i = 0; i < 2; ++i) {
+                if (!available[i]) {
+                    continue;
+                }
+                float d = candidates[i];
+                if (wrapWidth > 0 && fabsf(d) > wrapWidth / 2) {
+                    d -= (d > 0 ? wrapWidth : -wrapWidth);
+                }
+                if (!found || fabsf(d) < fabsf(best)) {
+                    best = d;
+                    found = true;
+                }
+            }
+            return best;
+        }
+
+        template<typename T>
+        inline void sampleBilinear(const cv::Mat& image, float u, float v, int channels, float* out) {
+            float fu = floorf(u);
+            float fv = floorf(v);
+            float ax = u - fu;
+            float ay = v - fv;
+            int x0 = wrap(static_cast<int>(fu), image.cols);
+            int x1 = wrap(x0 + 1, image.cols);
+            int y0 = wrap(static_cast<int>(fv), image.rows);
+            int y1 = wrap(y0 + 1, image.rows);
+
+            const T* row0 = image.ptr<T>(y0);
+            const T* row1 = image.ptr<T>(y1);
+            for (int c = 0; c < channels; ++c) {
+                float top00 = load(row0[x0 * channels + c]);
+                float top = top00 + ax * (load(row0[x1 * channels + c]) - top00);
+                float bottom0 = load(row1[x0 * channels + c]);
+                float bottom = bottom0 + ax * (load(row1[x1 * channels + c]) - bottom0);
+                out[c] = top + ay * (bottom - top);
+            }
+        }
+
+        template<typename T>
+        class MipmapRemap: public cv::ParallelLoopBody {
+        private:
+            const MipPyramid& pyramid;
+            cv::Mat& dst;
+            const cv::Mat& mapX;
+            const cv::Mat& mapY;
+            const cv::Mat& lod;
+            const TileGrid& grid;
+            std::vector<float> scaleX;
+            std::vector<float> scaleY;
+
+            // coordinates of the level 0 pixel (u,v) in `level`
+            inline void sampleLevel(int level, float u, float v, int channels, float* out) const {
+                float lu = (u + 0.5f) * scaleX[level] - 0.5f;
+                float lv = (v + 0.5f) * scaleY[level] - 0.5f;
+                sampleBilinear<T>(pyramid[level], lu, lv, channels, out);
+            }
+
+        public:
+            MipmapRemap(const MipPyramid& _pyramid, cv::Mat& _dst, const cv::Mat& _mapX, const cv::Mat& _mapY,
+                        const cv::Mat& _lod, const TileGrid& _grid) :
+                pyramid(_pyramid),
+                dst(_dst),
+                mapX(_mapX),
+                mapY(_mapY),
+                lod(_lod),
+                grid(_grid) {
+                for (int level = 0; level < pyramid.size(); ++level) {
+                    scaleX.push_back(static_cast<float>(pyramid[level].cols) / pyramid[0].cols);
+                    scaleY.push_back(static_cast<float>(pyramid[level].rows) / pyramid[0].rows);
+                }
+            }
+
+            void operator()(const cv::Range& range) const {
+                const int channels = dst.channels();
+                const int maxLevel = pyramid.size() - 1;
+                std::vector<float> a(channels), b(channels);
+
+                for (int i = range.start; i < range.end; ++i) {
+                    const cv::Rect& tile = grid[i];
+                    for (int y = tile.y; y < tile.y + tile.height; ++y) {
+                        const float* rowX = mapX.ptr<float>(y);
+                        const float* rowY = mapY.ptr<float>(y);
+                        const float* rowLod = lod.ptr<float>(y);
+                        T* out = dst.ptr<T>(y);
+
+                        for (int x = tile.x; x < tile.x + tile.width; ++x) {
+                            float l = std::min(rowLod[x], static_cast<float>(maxLevel));
+                            int level = static_cast<int>(l);
+                            float t = l - level;
+
+                            sampleLevel(level, rowX[x], rowY[x], channels, &a[0]);
+                            if (t > 0 && level < maxLevel) {
+                                sampleLevel(level + 1, rowX[x], rowY[x], channels, &b[0]);
+                                for (int c = 0; c < channels; ++c) {
+                                    a[c] += t * (b[c] - a[c]);
+                                }
+                            }
+                            for (int c = 0; c < channels; ++c) {
+                                out[x * channels + c] = store<T>(a[c]);
+                            }
+                        }
+                    }
+                }
+            }
+        };
+
+        double cubicWeight(double x) {
+            // same kernel as cv::INTER_CUBIC
+            const double a = -0.75;
+            x = fabs(x);
+            if (x < 1) {
+                return ((a + 2) * x - (a + 3)) * x * x + 1;
+            }
+            if (x < 2) {
+                return ((a * x - 5 * a) * x + 8 * a) * x - 4 * a;
+            }
+            return 0;
+        }
+
+        double lanczos3Weight(double x) {
+            x = fabs(x);
+            if (x < 1e-8) {
+                return 1;
+            }
+            if (x >= 3) {
+                return 0;
+            }
+            double px = M_PI * x;
+            return 3 * sin(px) * sin(px / 3) / (px * px);
+        }
+
+        /**
+         Kernel sampling of the tiles, the weights of a pixel being two rows of
+         the table. The vertical pass comes first: away from the wrap, the taps
+         of a source row are contiguous, and the weighted sum of the rows runs
+         over all their samples at once (see accumulateSpan). The horizontal
+         pass then sums the columns per channel, the channel count being a
+         template parameter for the usual layouts (0 meaning any) so that it's
+         unrolled.
+         */
+        template<typename T, int CN>
+        class KernelRemap: public cv::ParallelLoopBody {
+        private:
+            const cv::Mat& src;
+            cv::Mat& dst;
+            const cv::Mat& coords;
+            const cv::Mat& positions;
+            const KernelTable& table;
+            const TileGrid& grid;
+
+        public:
+            KernelRemap(const cv::Mat& _src, cv::Mat& _dst, const cv::Mat& _coords, const cv::Mat& _positions,
+                        const KernelTable& _table, const TileGrid& _grid) :
+                src(_src),
+                dst(_dst),
+                coords(_coords),
+                positions(_positions),
+                table(_table),
+                grid(_grid) {}
+
+            void operator()(const cv::Range& range) const {
+                const int channels = CN > 0 ? CN : src.channels();
+                const int taps = table.getTaps();
+                const int offset = taps / 2 - 1;
+                const int width = src.cols;
+                const int height = src.rows;
+                const int span = taps * channels;
+
+                std::vector<int> columns(taps);
+                // weighted sums of the rows, for each tap column and channel
+                std::vector<float> columnAcc(span);
+
+                for (int i = range.start; i < range.end; ++i) {
+                    const cv::Rect& tile = grid[i];
+                    for (int y = tile.y; y < tile.y + tile.height; ++y) {
+                        const int* rowCoords = coords.ptr<int>(y);
+                        const ushort* rowPositions = positions.ptr<ushort>(y);
+                        T* out = dst.ptr<T>(y);
+
+                        for (int x = tile.x; x < tile.x + tile.width; ++x) {
+                            int sx = rowCoords[2 * x] - offset;
+                            int sy = rowCoords[2 * x + 1] - offset;
+                            const float* wx = table.getWeights(rowPositions[x] % INTER_NATIVE_TAB_SIZE);
+                            const float* wy = table.getWeights(rowPositions[x] / INTER_NATIVE_TAB_SIZE);
+
+                            std::fill(columnAcc.begin(), columnAcc.end(), 0.0f);
+                            if (sx >= 0 && sx + taps <= width) {
+                                for (int j = 0; j < taps; ++j) {
+                                    const T* row = src.ptr<T>(wrap(sy + j, height)) + sx * channels;
+                                    accumulateSpan(&columnAcc[0], row, wy[j], span);
+                                }
+                            } else {
+                                for (int k = 0; k < taps; ++k) {
+                                    columns[k] = wrap(sx + k, width) * channels;
+                                }
+                                for (int j = 0; j < taps; ++j) {
+                                    const T* row = src.ptr<T>(wrap(sy + j, height));
+                                    for (int k = 0; k < taps; ++k) {
+                                        accumulateSpan(&columnAcc[k * channels], row + columns[k], wy[j], channels);
+                                    }
+                                }
+                            }
+
+                            T* pixel = out + x * channels;
+                            for (int c = 0; c < channels; ++c) {
+                                float acc = 0;
+                                for (int k = 0; k < taps; ++k) {
+                                    acc += wx[k] * columnAcc[k * channels + c];
+                                }
+                                pixel[c] = store<T>(acc);
+                            }
+                        }
+                    }
+                }
+            }
+        };
+
+        template<typename T>
+        void remapKernelDepth(const cv::Mat& src, cv::Mat& dst, const cv::Mat& coords, const cv::Mat& positions,
+                              const KernelTable& table, const TileGrid& grid) {
+            cv::Range range(0, grid.size());
+            switch (src.channels()) {
+                case 1:
+                    cv::parallel_for_(range, KernelRemap<T, 1>(src, dst, coords, positions, table, grid));
+                    break;
+                case 3:
+                    cv::parallel_for_(range, KernelRemap<T, 3>(src, dst, coords, positions, table, grid));
+                    break;
+                case 4:
+                    cv::parallel_for_(range, KernelRemap<T, 4>(src, dst, coords, positions, table, grid));
+                    break;
+                default:
+                    cv::parallel_for_(range, KernelRemap<T, 0>(src, dst, coords, positions, table, grid));
+                    break;
+            }
+        }
+
+    } // end anonymous namespace
+
+    KernelTable::KernelTable(int interpolation) {
+        taps = (interpolation == INTER_NATIVE_LANCZOS3) ? 6 : 4;
+        weights.resize(INTER_NATIVE_TAB_SIZE * taps);
+
+        for (int position = 0; position < INTER_NATIVE_TAB_SIZE; ++position) {
+            double t = static_cast<double>(position) / INTER_NATIVE_TAB_SIZE;
+            double w[6];
+            double sum = 0;
+            for (int k = 0; k < taps; ++k) {
+                // distance between the sample and the pixel k
+                double d = t - (k - (taps / 2 - 1));
+                w[k] = (taps == 6) ? lanczos3Weight(d) : cubicWeight(d);
+                sum += w[k];
+            }
+            for (int k = 0; k < taps; ++k) {
+                weights[position * taps + k] = static_cast<float>(w[k] / sum);
+            }
+        }
+    }
+
+    const KernelTable& KernelTable::get(int interpolation) {
+        static const KernelTable bicubic(INTER_NATIVE_BICUBIC);
+        static const KernelTable lanczos3(INTER_NATIVE_LANCZOS3);
+        switch (interpolation) {
+            case INTER_NATIVE_BICUBIC:
+                return bicubic;
+            case INTER_NATIVE_LANCZOS3:
+                return lanczos3;
+        }
+        throw std::invalid_argument("not a kernel interpolation");
+    }
+
+    void computeFixedMaps(const cv::Mat& mapX, const cv::Mat& mapY, cv::Mat& coords, cv::Mat& positions) {
+        coords.create(mapX.rows, mapX.cols, CV_32SC2);
+        positions.create(mapX.rows, mapX.cols, CV_16UC1);
+
+        for (int y = 0; y < mapX.rows; ++y) {
+            const float* rowX = mapX.ptr<float>(y);
+            const float* rowY = mapY.ptr<float>(y);
+            int* rowCoords = coords.ptr<int>(y);
+            ushort* rowPositions = positions.ptr<ushort>(y);
+
+            for (int x = 0; x < mapX.cols; ++x) {
+                int u = cvRound(rowX[x] * INTER_NATIVE_TAB_SIZE);
+                int v = cvRound(rowY[x] * INTER_NATIVE_TAB_SIZE);
+                // floor division, for the negative coordinates wrapped later
+                int ix = u >= 0 ? u / INTER_NATIVE_TAB_SIZE : -((-u + INTER_NATIVE_TAB_SIZE - 1) / INTER_NATIVE_TAB_SIZE);
+                int iy = v >= 0 ? v / INTER_NATIVE_TAB_SIZE : -((-v + INTER_NATIVE_TAB_SIZE - 1) / INTER_NATIVE_TAB_SIZE);
+
+                rowCoords[2 * x] = ix;
+                rowCoords[2 * x + 1] = iy;
+                rowPositions[x] = static_cast<ushort>((v - iy * INTER_NATIVE_TAB_SIZE) * INTER_NATIVE_TAB_SIZE +
+                                                      (u - ix * INTER_NATIVE_TAB_SIZE));
+            }
+        }
+    }
+
+    void remapKernel(const cv::Mat& src, cv::Mat& dst, const cv::Mat& coords, const cv::Mat& positions,
+                     int interpolation, const TileGrid& grid) {
+        const KernelTable& table = KernelTable::get(interpolation);
+        switch (src.depth()) {
+            case CV_8U:
+                remapKernelDepth<uchar>(src, dst, coords, positions, table, grid);
+                break;
+            case CV_16U:
+                remapKernelDepth<ushort>(src, dst, coords, positions, table, grid);
+                break;
+            case CV_32F:
+                remapKernelDepth<float>(src, dst, coords, positions, table, grid);
+                break;
+            case DEPTH_HALF: {
+                // sampled in float, through float copies of the source and of the output
+                cv::Mat values, remapped(dst.rows, dst.cols, CV_MAKETYPE(CV_32F, src.channels()));
+                convertFromHalf(src, values);
+                remapKernelDepth<float>(values, remapped, coords, positions, table, grid);
+                convertToHalf(remapped, dst);
+                break;
+            }
+            default:
+                throw std::invalid_argument("the kernel sampling supports 8 bits, 16 bits, half and float images only");
+        }
+    }
+
+    int toCvInterpolation(int interpolation) {
+        switch (interpolation) {
+            case INTER_NATIVE_MIPMAP:
+                return cv::INTER_LINEAR;
+            case INTER_NATIVE_BICUBIC:
+                return cv::INTER_CUBIC;
+            case INTER_NATIVE_LANCZOS3:
+                return cv::INTER_LANCZOS4;
+            default:
+                return interpolation;
+        }
+    }
+
+    cv::Mat computeLodMap(const cv::Mat& mapX, const cv::Mat& mapY, float wrapWidth) {
+        cv::Mat lod(mapX.rows, mapX.cols, CV_32FC1);
+        const int width = mapX.cols;
+        const int height = mapX.rows;
+
+        for (int y = 0; y < height; ++y) {
+            const float* rowX = mapX.ptr<float>(y);
+            const float* rowY = mapY.ptr<float>(y);
+            const float* prevX = mapX.ptr<float>(std::max(y - 1, 0));
+            const float* prevY = mapY.ptr<float>(std::max(y - 1, 0));
+            const float* nextX = mapX.ptr<float>(std::min(y + 1, height - 1));
+            const float* nextY = mapY.ptr<float>(std::min(y + 1, height - 1));
+            float* out = lod.ptr<float>(y);
+
+            for (int x = 0; x < width; ++x) {
+                bool hasLeft = x > 0, hasRight = x + 1 < width;
+                bool hasUp = y > 0, hasDown = y + 1 < height;
+                int left = hasLeft ? x - 1 : x, right = hasRight ? x + 1 : x;
+
+                float dudx = derivative(rowX[left], rowX[x], rowX[right], hasLeft, hasRight, wrapWidth);
+                float dvdx = derivative(rowY[left], rowY[x], rowY[right], hasLeft, hasRight, 0);
+                float dudy = derivative(prevX[x], rowX[x], nextX[x], hasUp, hasDown, wrapWidth);
+                float dvdy = derivative(prevY[x], rowY[x], nextY[x], hasUp, hasDown, 0);
+
+                float footprint = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+                // log2(sqrt(footprint)), no minification below one pixel
+                out[x] = footprint > 1 ? 0.5f * log2f(footprint) : 0;
+            }
+        }
+        return lod;
+    }
+
+    MipPyramid::MipPyramid(const cv::Mat& src, int maxLevels) {
+        levels.push_back(src);
+        while (static_cast<int>(levels.size()) < maxLevels) {
+            const cv::Mat& last = levels.back();
+            if (last.cols == 1 && last.rows == 1) {
+                break;
+            }
+            cv::Mat next;
+            cv::Size size(std::max(1, (last.cols + 1) / 2), std::max(1, (last.rows + 1) / 2));
+            // the levels of the half float images are kept in half but filtered in float
+            resizeImage(last, next, size, cv::INTER_AREA);
+            levels.push_back(next);
+        }
+    }
+
+    MipPyramid MipPyramid::convertTo(int depth) const {
+        MipPyramid converted;
+        converted.levels.resize(levels.size());
+        for (size_t i = 0; i < levels.size(); ++i) {
+            levels[i].convertTo(converted.levels[i], depth);
+        }
+        return converted;
+    }
+
+    void remapMipmap(const MipPyramid& pyramid, cv::Mat& dst,
+                     const cv::Mat& mapX, const cv::Mat& mapY, const cv::Mat& lod, const TileGrid& grid) {
+        switch (dst.depth()) {
+            case CV_8U: {
+                MipmapRemap<uchar> body(pyramid, dst, mapX, mapY, lod, grid);
+                cv::parallel_for_(cv::Range(0, grid.size()), body);
+                break;
+            }
+            case CV_16U: {
+                MipmapRemap<ushort> body(pyramid, dst, mapX, mapY, lod, grid);
+                cv::parallel_for_(cv::Range(0, grid.size()), body);
+                break;
+            }
+            case CV_32F: {
+                MipmapRemap<float> body(pyramid, dst, mapX, mapY, lod, grid);
+                cv::parallel_for_(cv::Range(0, grid.size()), body);
+                break;
+            }
+            case DEPTH_HALF: {
+                // sampled in float, through float copies of the levels and of the output
+                cv::Mat values(dst.rows, dst.cols, CV_MAKETYPE(CV_32F, dst.channels()));
+                remapMipmap(pyramid.convertTo(CV_32F), values, mapX, mapY, lod, grid);
+                convertToHalf(values, dst);
+                break;
+            }
+            default:
+                throw std::invalid_argument("the mipmap sampling supports 8 bits, 16 bits, half and float images only");
+        }
+    }
+
+} // end namespace libprojector
@@ -0,0 +1,49 @@
+#include <stdexcept>
+
+#include <libprojector/stereo.hpp>
+
+namespace libprojector {
+
+    int getStereoEyeWidth(int imageWidth, StereoLayout layout) {
+        return (layout == StereoLayoutSideBySide) ? imageWidth / 2 : imageWidth;
+    }
+
+    cv::Size getStereoImageSize(const cv::Size& eyeSize, StereoLayout layout) {
+        switch (layout) {
+            case StereoLayoutMono:
+                return eyeSize;
+            case StereoLayoutTopBottom:
+                return cv::Size(eyeSize.width, 2 * eyeSize.height);
+            case StereoLayoutSideBySide:
+                return cv::Size(2 * eyeSize.width, eyeSize.height);
+        }
+        throw std::invalid_argument("unknown stereo layout");
+    }
+
+    std::vector<cv::Mat> getStereoEyes(const cv::Mat& image, StereoLayout layout) {
+        std::vector<cv::Mat> eyes;
+        switch (layout) {
+            case StereoLayoutMono:
+                eyes.push_back(image);
+                break;
+            case StereoLayoutTopBottom:
+                if (image.rows % 2 != 0) {
+                    throw std::invalid_argument("a top/bottom stereo image must have an even height");
+                }
+                eyes.push_back(image.rowRange(0, image.rows / 2));
+                eyes.push_back(image.rowRange(image.rows / 2, image.rows));
+                break;
+            case StereoLayoutSideBySide:
+                if (image.cols % 2 != 0) {
+                    throw std::invalid_argument("a side-by-side stereo image must have an even width");
+                }
+                eyes.push_back(image.colRange(0, image.cols / 2));
+                eyes.push_back(image.colRange(image.cols / 2, image.cols));
+                break;
+            default:
+                throw std::invalid_argument("unknown stereo layout");
+        }
+        return eyes;
+    }
+
+} // end namespace libprojector
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+
+#include <libprojector/thread_pool.hpp>
+
+namespace libprojector {
+
+    namespace {
+        // pool and queue of the worker running on the current thread
+        thread_local const ThreadPool* currentPool = NULL;
+        thread_local int currentWorker = -1;
+    }
+
+    ThreadPool::ThreadPool(int count) :
+        queued(0),
+        pending(0),
+        nextWorker(0),
+        stopping(false) {
+        if (count <= 0) {
+            count = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        for (int i = 0; i < count; ++i) {
+            workers.push_back(boost::shared_ptr<Worker>(new Worker()));
+        }
+        for (int i = 0; i < count; ++i) {
+            threads.push_back(std::thread(&ThreadPool::run, this, i));
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+    }
+
+    void ThreadPool::submit(const Task& task) {
+        int index = currentWorker;
+        {
+            // counted before being pushed: a worker may steal and finish the
+            // task before this thread gets the mutex back, and wait() must
+            // not see the pool idle in between
+            std::lock_guard<std::mutex> lock(mutex);
+            if (currentPool != this) {
+                index = static_cast<int>(nextWorker++ % workers.size());
+            }
+            ++queued;
+            ++pending;
+        }
+        {
+            std::lock_guard<std::mutex> lock(workers[index]->mutex);
+            workers[index]->tasks.push_back(task);
+        }
+        wakeUp.notify_one();
+    }
+
+    void ThreadPool::wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return pending == 0; });
+    }
+
+    void ThreadPool::forEach(size_t count, const std::function<void(size_t)>& function) {
+        if (currentPool == this || count <= 1) {
+            for (size_t i = 0; i < count; ++i) {
+                function(i);
+            }
+            return;
+        }
+
+        std::mutex doneMutex;
+        std::condition_variable doneCondition;
+        size_t remaining = count;
+        std::exception_ptr error;
+
+        for (size_t i = 0; i < count; ++i) {
+            submit([&, i] {
+                std::exception_ptr taskError;
+                try {
+                    function(i);
+                } catch (...) {
+                    taskError = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock(doneMutex);
+                if (taskError && !error) {
+                    error = taskError;
+                }
+                if (--remaining == 0) {
+                    doneCondition.notify_all();
+                }
+            });
+        }
+
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&] { return remaining == 0; });
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    bool ThreadPool::pop(int index, Task& task) {
+        Worker& worker = *workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) {
+            return false;
+        }
+        task = worker.tasks.back();
+        worker.tasks.pop_back();
+        return true;
+    }
+
+    bool ThreadPool::steal(int index, Task& task) {
+        int count = static_cast<int>(workers.size());
+        for (int i = 1; i < count; ++i) {
+            Worker& victim = *workers[(index + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::run(int index) {
+        currentPool = this;
+        currentWorker = index;
+
+        while (true) {
+            Task task;
+            if (pop(index, task) || steal(index, task)) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    --queued;
+                }
+
+                try {
+                    task();
+                } catch (const std::exception& e) {
+                    // tasks are expected to report their own errors
+                    std::cerr << "libprojector: uncaught exception in a task: " << e.what() << std::endl;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) {
+                    idle.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0) {
+                return;
+            }
+        }
+    }
+
+} // end namespace libprojector
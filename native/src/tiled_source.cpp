@@ -0,0 +1,455 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <libprojector/sampler.hpp>
+#include <libprojector/tiled_source.hpp>
+#include <libprojector/tiling.hpp>
+
+namespace libprojector {
+
+    namespace {
+
+        const char MAGIC[8] = {'P', 'J', 'T', 'I', 'L', 'E', 'S', '1'};
+        const size_t HEADER_SIZE = 4096;
+
+        struct Header {
+            char magic[8];
+            int32_t width;
+            int32_t height;
+            int32_t type;
+            int32_t tileSize;
+            int32_t levels;
+        };
+
+        bool readHeader(std::istream& file, Header& header) {
+            if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+                return false;
+            }
+            return std::equal(MAGIC, MAGIC + 8, header.magic) && header.width > 0 && header.height > 0 &&
+                header.tileSize > 0 && header.levels > 0;
+        }
+
+        // pixels past the samples read by the widest OpenCV interpolation (lanczos4)
+        const int FOOTPRINT_MARGIN = 4;
+
+        // sides of the source footprints read at once, split beyond (e.g.
+        // next to the poles), below the limit of cv::remap
+        const int MAX_FOOTPRINT = 8192;
+
+        // copy of a source footprint, released with it
+        struct FootprintCopy {
+            TiledSource& source;
+            cv::Mat patch;
+
+            explicit FootprintCopy(TiledSource& _source) : source(_source) {}
+
+            ~FootprintCopy() {
+                source.releaseCopy(patch);
+            }
+        };
+
+    } // end anonymous namespace
+
+    std::vector<TiledSource::Level> TiledSource::getLevels(const cv::Size& size, int levelCount, int tileSize, size_t tileBytes) {
+        std::vector<Level> levels;
+        size_t offset = HEADER_SIZE;
+        cv::Size levelSize = size;
+        for (int i = 0; i < levelCount; ++i) {
+            Level level;
+            level.size = levelSize;
+            level.columns = (levelSize.width + tileSize - 1) / tileSize;
+            level.rows = (levelSize.height + tileSize - 1) / tileSize;
+            level.offset = offset;
+            levels.push_back(level);
+
+            offset += static_cast<size_t>(level.columns) * level.rows * tileBytes;
+            levelSize = cv::Size((levelSize.width + 1) / 2, (levelSize.height + 1) / 2);
+        }
+        return levels;
+    }
+
+    void TiledSource::write(const std::string& path, const cv::Mat& image, int tileSize) {
+        if (image.empty() || (image.depth() != CV_8U && image.depth() != CV_16U && image.depth() != CV_32F)) {
+            throw std::invalid_argument("a tiled source is made of an 8 or 16 bits, or float image");
+        }
+        if (tileSize <= 0 || tileSize % 64 != 0) {
+            throw std::invalid_argument("the tile size must be a multiple of 64");
+        }
+
+        // down to the level fitting in a tile
+        int levelCount = 1;
+        for (cv::Size size = image.size(); std::max(size.width, size.height) > tileSize; ++levelCount) {
+            size = cv::Size((size.width + 1) / 2, (size.height + 1) / 2);
+        }
+
+        std::ofstream file(path.c_str(), std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("unable to write '" + path + "'");
+        }
+        Header header;
+        std::copy(MAGIC, MAGIC + 8, header.magic);
+        header.width = image.cols;
+        header.height = image.rows;
+        header.type = image.type();
+        header.tileSize = tileSize;
+        header.levels = levelCount;
+        std::vector<char> headerBytes(HEADER_SIZE, 0);
+        std::memcpy(&headerBytes[0], &header, sizeof(header));
+        file.write(&headerBytes[0], headerBytes.size());
+
+        cv::Mat tile(tileSize, tileSize, image.type());
+        cv::Mat levelImage = image;
+        std::vector<Level> levels = getLevels(image.size(), levelCount, tileSize, tile.total() * tile.elemSize());
+        for (int i = 0; i < levelCount; ++i) {
+            if (i > 0) {
+                cv::Mat reduced;
+                cv::resize(levelImage, reduced, levels[i].size, 0, 0, cv::INTER_AREA);
+                levelImage = reduced;
+            }
+            for (int row = 0; row < levels[i].rows; ++row) {
+                for (int column = 0; column < levels[i].columns; ++column) {
+                    cv::Rect rect = cv::Rect(column * tileSize, row * tileSize, tileSize, tileSize) &
+                        cv::Rect(0, 0, levelImage.cols, levelImage.rows);
+                    tile.setTo(cv::Scalar::all(0));
+                    levelImage(rect).copyTo(tile(cv::Rect(0, 0, rect.width, rect.height)));
+                    file.write(reinterpret_cast<const char*>(tile.data), tile.total() * tile.elemSize());
+                }
+            }
+        }
+        if (!file) {
+            throw std::runtime_error("unable to write '" + path + "'");
+        }
+    }
+
+    bool TiledSource::probe(const std::string& path, cv::Size& size) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        Header header;
+        if (!file || !readHeader(file, header)) {
+            return false;
+        }
+        size = cv::Size(header.width, header.height);
+        return true;
+    }
+
+#ifndef _WIN32
+    TiledSource::TiledSource(const std::string& path, size_t _memoryBudget) :
+        memoryBudget(_memoryBudget),
+        data(NULL),
+        dataSize(0),
+        copyBytes(0),
+        peakBytes(0) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        Header header;
+        if (!file || !readHeader(file, header)) {
+            throw std::runtime_error("'" + path + "' isn't a tiled source");
+        }
+        imageType = header.type;
+        tileSize = header.tileSize;
+        tileBytes = static_cast<size_t>(tileSize) * tileSize * CV_ELEM_SIZE(imageType);
+        levels = getLevels(cv::Size(header.width, header.height), header.levels, tileSize, tileBytes);
+        const Level& last = levels.back();
+        size_t expectedSize = last.offset + static_cast<size_t>(last.columns) * last.rows * tileBytes;
+
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < expectedSize) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("'" + path + "' is truncated");
+        }
+        dataSize = expectedSize;
+        void* mapping = mmap(NULL, dataSize, PROT_READ, MAP_SHARED, fd, 0);
+        // the mapping keeps the file open
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("unable to map '" + path + "'");
+        }
+        data = static_cast<unsigned char*>(mapping);
+        // no read ahead, the tiles read being spread over the file
+        madvise(data, dataSize, MADV_RANDOM);
+    }
+
+    TiledSource::~TiledSource() {
+        if (data != NULL) {
+            munmap(data, dataSize);
+        }
+    }
+
+    void TiledSource::acquire(const std::vector<size_t>& tiles) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            std::map<size_t, Resident>::iterator resident = residentTiles.find(tiles[i]);
+            if (resident != residentTiles.end()) {
+                recentTiles.splice(recentTiles.begin(), recentTiles, resident->second.position);
+                ++resident->second.reads;
+                continue;
+            }
+            madvise(data + tiles[i], tileBytes, MADV_WILLNEED);
+            recentTiles.push_front(tiles[i]);
+            Resident added = {recentTiles.begin(), 1};
+            residentTiles[tiles[i]] = added;
+        }
+        evict();
+        updatePeak();
+    }
+
+    void TiledSource::release(const std::vector<size_t>& tiles) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            --residentTiles[tiles[i]].reads;
+        }
+        // the tiles kept past the budget by other reads (see getMaxReadTiles)
+        evict();
+    }
+
+    void TiledSource::evict() {
+        // the other half of the budget is for the copies
+        std::list<size_t>::iterator tile = recentTiles.end();
+        while (recentTiles.size() * tileBytes > memoryBudget / 2 && tile != recentTiles.begin()) {
+            --tile;
+            std::map<size_t, Resident>::iterator resident = residentTiles.find(*tile);
+            if (resident->second.reads > 0) {
+                continue;
+            }
+            madvise(data + *tile, tileBytes, MADV_DONTNEED);
+            residentTiles.erase(resident);
+            tile = recentTiles.erase(tile);
+        }
+    }
+#else
+    TiledSource::TiledSource(const std::string& path, size_t _memoryBudget) :
+        memoryBudget(_memoryBudget),
+        data(NULL),
+        dataSize(0),
+        copyBytes(0),
+        peakBytes(0) {
+        throw std::runtime_error("the tiled sources need a POSIX system");
+    }
+
+    TiledSource::~TiledSource() {}
+
+    void TiledSource::acquire(const std::vector<size_t>& tiles) {}
+
+    void TiledSource::release(const std::vector<size_t>& tiles) {}
+
+    void TiledSource::evict() {}
+#endif
+
+    size_t TiledSource::getMaxReadTiles() const {
+        size_t threads = static_cast<size_t>(std::max(cv::getNumThreads(), 1));
+        return std::max(memoryBudget / 2 / tileBytes / threads, static_cast<size_t>(1));
+    }
+
+    size_t TiledSource::getMaxCopyBytes() const {
+        size_t threads = static_cast<size_t>(std::max(cv::getNumThreads(), 1));
+        return memoryBudget / 2 / threads;
+    }
+
+    void TiledSource::updatePeak() {
+        peakBytes = std::max(peakBytes, recentTiles.size() * tileBytes + copyBytes);
+    }
+
+    size_t TiledSource::getResidentBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return recentTiles.size() * tileBytes + copyBytes;
+    }
+
+    size_t TiledSource::getPeakBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return peakBytes;
+    }
+
+    void TiledSource::releaseCopy(cv::Mat& copy) {
+        std::lock_guard<std::mutex> lock(mutex);
+        copyBytes -= copy.total() * copy.elemSize();
+        copy.release();
+    }
+
+    const unsigned char* TiledSource::getTile(int level, int column, int row) const {
+        const Level& l = levels[level];
+        return data + l.offset + (static_cast<size_t>(row) * l.columns + column) * tileBytes;
+    }
+
+    void TiledSource::read(int level, const cv::Rect& rect, cv::Mat& dst) {
+        const Level& l = levels.at(level);
+        const int width = l.size.width;
+        const size_t pixelBytes = CV_ELEM_SIZE(imageType);
+        // a new copy, counted until released
+        dst = cv::Mat(rect.height, rect.width, imageType);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            copyBytes += dst.total() * pixelBytes;
+            updatePeak();
+        }
+
+        // columns of the rectangle, split at the edges of the tiles and of the level
+        struct Segment {
+            int dstX;
+            int srcX;
+            int width;
+        };
+        std::vector<Segment> segments;
+        for (int x = 0; x < rect.width;) {
+            Segment segment;
+            segment.dstX = x;
+            segment.srcX = ((rect.x + x) % width + width) % width;
+            segment.width = std::min(std::min(rect.width - x, tileSize - segment.srcX % tileSize), width - segment.srcX);
+            segments.push_back(segment);
+            x += segment.width;
+        }
+
+        // row of tiles by row of tiles, and a few segments (tiles) at a time
+        // within the budget
+        const size_t maxTiles = getMaxReadTiles();
+        for (int y = 0; y < rect.height;) {
+            int tileRow = std::min(std::max(rect.y + y, 0), l.size.height - 1) / tileSize;
+            int end = y + 1;
+            while (end < rect.height && std::min(std::max(rect.y + end, 0), l.size.height - 1) / tileSize == tileRow) {
+                ++end;
+            }
+
+            for (size_t first = 0; first < segments.size(); first += maxTiles) {
+                size_t last = std::min(first + maxTiles, segments.size());
+                std::vector<size_t> tiles;
+                for (size_t i = first; i < last; ++i) {
+                    tiles.push_back(getTile(level, segments[i].srcX / tileSize, tileRow) - data);
+                }
+                std::sort(tiles.begin(), tiles.end());
+                tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+                acquire(tiles);
+
+                for (int dstY = y; dstY < end; ++dstY) {
+                    int srcY = std::min(std::max(rect.y + dstY, 0), l.size.height - 1);
+                    unsigned char* row = dst.ptr<unsigned char>(dstY);
+                    for (size_t i = first; i < last; ++i) {
+                        const Segment& segment = segments[i];
+                        const unsigned char* tile = getTile(level, segment.srcX / tileSize, tileRow);
+                        const unsigned char* src = tile + (static_cast<size_t>(srcY % tileSize) * tileSize + segment.srcX % tileSize) * pixelBytes;
+                        std::memcpy(row + segment.dstX * pixelBytes, src, segment.width * pixelBytes);
+                    }
+                }
+                release(tiles);
+            }
+            y = end;
+        }
+    }
+
+    namespace {
+
+        class TiledSourceRemap: public cv::ParallelLoopBody {
+        private:
+            TiledSource& source;
+            int level;
+            const cv::Mat& mapX;
+            const cv::Mat& mapY;
+            cv::Mat dst;
+            const TileGrid& grid;
+            int interpolation;
+
+            void remapFootprint(const cv::Rect& tile) const {
+                cv::Mat tileX = mapX(tile);
+                cv::Mat tileY = mapY(tile);
+                double minX, maxX, minY, maxY;
+                cv::minMaxLoc(tileX, &minX, &maxX);
+                cv::minMaxLoc(tileY, &minY, &maxY);
+
+                // the tiles across the wrap of the source read it in one piece
+                float width = static_cast<float>(source.getSize(level).width);
+                float wrap = 0;
+                if (maxX - minX > width / 2) {
+                    wrap = width;
+                    minX = width;
+                    maxX = 0;
+                    for (int y = 0; y < tileX.rows; ++y) {
+                        const float* row = tileX.ptr<float>(y);
+                        for (int x = 0; x < tileX.cols; ++x) {
+                            float u = row[x] < width / 2 ? row[x] + wrap : row[x];
+                            minX = std::min(minX, static_cast<double>(u));
+                            maxX = std::max(maxX, static_cast<double>(u));
+                        }
+                    }
+                }
+
+                cv::Rect footprint(static_cast<int>(floor(minX)) - FOOTPRINT_MARGIN,
+                                   static_cast<int>(floor(minY)) - FOOTPRINT_MARGIN,
+                                   static_cast<int>(ceil(maxX) - floor(minX)) + 2 * FOOTPRINT_MARGIN + 1,
+                                   static_cast<int>(ceil(maxY) - floor(minY)) + 2 * FOOTPRINT_MARGIN + 1);
+                size_t footprintBytes = static_cast<size_t>(footprint.area()) * CV_ELEM_SIZE(source.type());
+                if ((footprint.width > MAX_FOOTPRINT || footprint.height > MAX_FOOTPRINT ||
+                     footprintBytes > source.getMaxCopyBytes()) && tile.area() > 1) {
+                    // split along the longest side
+                    cv::Rect first = tile, second = tile;
+                    if (tile.width >= tile.height) {
+                        first.width = tile.width / 2;
+                        second.x += first.width;
+                        second.width -= first.width;
+                    } else {
+                        first.height = tile.height / 2;
+                        second.y += first.height;
+                        second.height -= first.height;
+                    }
+                    remapFootprint(first);
+                    remapFootprint(second);
+                    return;
+                }
+
+                FootprintCopy copy(source);
+                source.read(level, footprint, copy.patch);
+                cv::Mat patchX(tile.height, tile.width, CV_32FC1);
+                cv::Mat patchY(tile.height, tile.width, CV_32FC1);
+                for (int y = 0; y < tile.height; ++y) {
+                    const float* rowX = tileX.ptr<float>(y);
+                    const float* rowY = tileY.ptr<float>(y);
+                    float* localX = patchX.ptr<float>(y);
+                    float* localY = patchY.ptr<float>(y);
+                    for (int x = 0; x < tile.width; ++x) {
+                        float u = (wrap != 0 && rowX[x] < width / 2) ? rowX[x] + wrap : rowX[x];
+                        localX[x] = u - footprint.x;
+                        localY[x] = rowY[x] - footprint.y;
+                    }
+                }
+                cv::Mat dstTile = dst(tile);
+                cv::remap(copy.patch, dstTile, patchX, patchY, interpolation, cv::BORDER_REPLICATE);
+            }
+
+        public:
+            TiledSourceRemap(TiledSource& _source, int _level, const cv::Mat& _mapX, const cv::Mat& _mapY,
+                             cv::Mat _dst, const TileGrid& _grid, int _interpolation) :
+                source(_source),
+                level(_level),
+                mapX(_mapX),
+                mapY(_mapY),
+                dst(_dst),
+                grid(_grid),
+                interpolation(_interpolation) {}
+
+            void operator()(const cv::Range& range) const {
+                for (int i = range.start; i < range.end; ++i) {
+                    remapFootprint(grid[i]);
+                }
+            }
+        };
+
+    } // end anonymous namespace
+
+    void remapTiledSource(TiledSource& source, int level, const cv::Mat& mapX, const cv::Mat& mapY,
+                          int interpolation, cv::Mat& dst) {
+        dst.create(mapX.rows, mapX.cols, source.type());
+        size_t bytesPerPixel = 2 * sizeof(float) + 2 * CV_ELEM_SIZE(source.type());
+        TileGrid grid(mapX.cols, mapX.rows, TileGrid::tileSizeFor(getCacheSize(2), bytesPerPixel));
+        TiledSourceRemap remap(source, level, mapX, mapY, dst, grid, toCvInterpolation(interpolation));
+        cv::parallel_for_(cv::Range(0, grid.size()), remap);
+    }
+
+} // end namespace libprojector
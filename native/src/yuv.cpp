@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <libprojector/yuv.hpp>
+
+namespace libprojector {
+
+    cv::Size getYUVFrameSize(const cv::Mat& frame) {
+        if (frame.type() != CV_8UC1 || frame.rows % 3 != 0 || frame.cols % 2 != 0) {
+            throw std::invalid_argument("a YUV 4:2:0 frame must be a single-channel 8 bits image of height * 3/2 rows");
+        }
+        cv::Size size(frame.cols, frame.rows * 2 / 3);
+        if (size.height % 2 != 0) {
+            throw std::invalid_argument("a YUV 4:2:0 frame must have an even height");
+        }
+        return size;
+    }
+
+    cv::Mat createYUVFrame(const cv::Size& size) {
+        if (size.width % 2 != 0 || size.height % 2 != 0) {
+            throw std::invalid_argument("a YUV 4:2:0 frame must have even dimensions");
+        }
+        return cv::Mat(size.height * 3 / 2, size.width, CV_8UC1);
+    }
+
+    YUVPlanes getYUVPlanes(const cv::Mat& frame, YUVFormat format) {
+        cv::Size size = getYUVFrameSize(frame);
+        if (!frame.isContinuous()) {
+            throw std::invalid_argument("a YUV 4:2:0 frame must be continuous");
+        }
+
+        YUVPlanes planes;
+        planes.luma = frame.rowRange(0, size.height);
+
+        uchar* chroma = const_cast<uchar*>(frame.ptr<uchar>(size.height));
+        int chromaWidth = size.width / 2;
+        int chromaHeight = size.height / 2;
+        switch (format) {
+            case YUVFormatI420: {
+                size_t planeSize = static_cast<size_t>(chromaWidth) * chromaHeight;
+                planes.chroma.push_back(cv::Mat(chromaHeight, chromaWidth, CV_8UC1, chroma));
+                planes.chroma.push_back(cv::Mat(chromaHeight, chromaWidth, CV_8UC1, chroma + planeSize));
+                break;
+            }
+            case YUVFormatNV12:
+                planes.chroma.push_back(cv::Mat(chromaHeight, chromaWidth, CV_8UC2, chroma));
+                break;
+            default:
+                throw std::invalid_argument("unknown YUV format");
+        }
+        return planes;
+    }
+
+    void computeChromaMaps(const cv::Mat& mapX, const cv::Mat& mapY, float wrapWidth,
+                           cv::Mat& chromaMapX, cv::Mat& chromaMapY) {
+        int width = (mapX.cols + 1) / 2;
+        int height = (mapX.rows + 1) / 2;
+        chromaMapX.create(height, width, CV_32FC1);
+        chromaMapY.create(height, width, CV_32FC1);
+
+        const float halfWrap = wrapWidth / 2;
+        for (int y = 0; y < height; ++y) {
+            const int y0 = 2 * y;
+            const int y1 = std::min(y0 + 1, mapX.rows - 1);
+            float* rowX = chromaMapX.ptr<float>(y);
+            float* rowY = chromaMapY.ptr<float>(y);
+
+            for (int x = 0; x < width; ++x) {
+                const int x0 = 2 * x;
+                const int x1 = std::min(x0 + 1, mapX.cols - 1);
+                const float ref = mapX.at<float>(y0, x0);
+
+                // the 4 positions are unwrapped around the first one
+                float u = 0;
+                const float us[3] = {mapX.at<float>(y0, x1), mapX.at<float>(y1, x0), mapX.at<float>(y1, x1)};
+                for (int i = 0; i < 3; ++i) {
+                    float d = us[i] - ref;
+                    if (wrapWidth > 0 && std::fabs(d) > halfWrap) {
+                        d -= (d > 0) ? wrapWidth : -wrapWidth;
+                    }
+                    u += d;
+                }
+                u = ref + u / 4;
+                float v = (mapY.at<float>(y0, x0) + mapY.at<float>(y0, x1) +
+                           mapY.at<float>(y1, x0) + mapY.at<float>(y1, x1)) / 4;
+
+                // the chroma pixel i covers the luma pixels 2i and 2i + 1
+                u = (u - 0.5f) / 2;
+                if (wrapWidth > 0 && (u < 0 || u >= halfWrap)) {
+                    u -= halfWrap * std::floor(u / halfWrap);
+                }
+                rowX[x] = u;
+                rowY[x] = (v - 0.5f) / 2;
+            }
+        }
+    }
+
+} // end namespace libprojector
@@ -0,0 +1,87 @@
+import os
+
+import cv2
+import libprojector
+
+from .image_io import enable_exr
+
+IMAGE_EXTENSIONS = ('.jpg', '.jpeg', '.png', '.tif', '.tiff', '.bmp', '.webp', '.exr', '.hdr')
+
+
+def list_jobs(source, output_dir):
+    """
+     List the (input, output) pairs of a batch
+
+     `source` is either a directory, whose images are all converted into
+     `output_dir` with the same file names, or a manifest: a text file with
+     one job per line, as `input_path [output_path]` (outputs default to
+     `output_dir` too). Empty lines and lines starting with '#' are ignored.
+    """
+    jobs = []
+    if os.path.isdir(source):
+        for name in sorted(os.listdir(source)):
+            if os.path.splitext(name)[1].lower() in IMAGE_EXTENSIONS:
+                jobs.append((os.path.join(source, name), os.path.join(output_dir, name)))
+        return jobs
+
+    base_dir = os.path.dirname(os.path.abspath(source))
+    with open(source) as manifest:
+        for line in manifest:
+            line = line.strip()
+            if not line or line.startswith('#'):
+                continue
+            parts = line.split(None, 1)
+            input_path = os.path.join(base_dir, parts[0])
+            if len(parts) > 1:
+                output_path = parts[1].strip()
+            else:
+                output_path = os.path.join(output_dir, os.path.basename(parts[0]))
+            jobs.append((input_path, output_path))
+    return jobs
+
+
+class BatchProcessor(object):
+    """
+     Convert a list of images within this process, the native side sharing
+     one thread pool and one map per geometry between all of them.
+
+     A processor made with `shared` (another processor) runs on the thread
+     pool and the maps of that one, with its own settings.
+
+     The outputs are written as the single conversions write them, the
+     sides of a mono strip cubemap apart (see output_paths).
+    """
+
+    def __init__(self, in_proj_class, in_proj_options, out_proj_class, out_proj_options,
+                 output_width, threads=0, quality=-1, interpolation=cv2.INTER_LINEAR,
+                 depth=libprojector.ImageDepth.uint8, shared=None):
+        self.out_proj_class = out_proj_class
+        self.out_proj_options = out_proj_options
+        self.batch = libprojector.BatchConvertor(
+            in_proj_class.get_spec(in_proj_options),
+            out_proj_class.get_spec(out_proj_options),
+            output_width,
+            threads if shared is None else shared.batch
+        )
+        self.batch.set_quality(quality)
+        self.batch.set_interpolation(interpolation)
+        self.batch.set_depth(depth)
+
+    def output_paths(self, output):
+        """Files written for the output path of a job"""
+        return self.out_proj_class.output_paths(output, self.out_proj_options)
+
+    def run(self, jobs, rotation=None, callback=None):
+        """Run the jobs, `callback(input, output, success, error)` is called as each one finishes"""
+        enable_exr([path for job in jobs for path in job])
+        for input_path, output_path in jobs:
+            output_dir = os.path.dirname(output_path)
+            if output_dir and not os.path.isdir(output_dir):
+                os.makedirs(output_dir)
+            self.batch.add_job(input_path, output_path)
+        self.batch.set_rotation(*(rotation or (0, 0, 0)))
+        self.batch.run(callback)
+
+    def convert_image(self, image, rotation=None):
+        """Convert a decoded image on the calling thread, other threads converting meanwhile"""
+        return self.batch.convert_image(image, *(rotation or (0, 0, 0)))
@@ -2,63 +2,319 @@ import time
 
 import click
 import cv2
-from PIL import Image
 
-from .processors import generate_cubemap, split_cubemap, ConvertProjectionProcessor
-from .projections import PROJECTION_CLASSES, PROJECTION_CUBEMAP, PROJECTION_EQUIRECTANGULAR
+import libprojector
 
+from .batch import BatchProcessor, list_jobs
+from .daemon import CONVERSION_DEFAULTS, ConversionDaemon
+from .image_io import (enable_exr, image_size, is_tiled_source, write_output, write_tiled_source,
+                       TILED_SOURCE_EXTENSION)
+from .processors import ConvertProjectionProcessor, DEPTHS, INTERPOLATIONS, TILED_MEMORY_BUDGET
+from .work_queue import WorkQueue, default_worker_id, run_worker
+from .projections import (CUBEMAP_LAYOUTS, CUBEMAP_PROJECTIONS, FISHEYE_PROJECTIONS, LENS_MODELS, PROJECTION_CLASSES,
+                          PROJECTION_OCTAHEDRAL, SPHERICAL_PROJECTIONS, STEREO_LAYOUTS, proj_options)
 
-@click.command()
-@click.option('--in-projection', type=str)
-@click.option('--out-projection', type=str)
+
+class DefaultCommandGroup(click.Group):
+    """Group running `convert` when no command is named, a single conversion keeping its usual command line"""
+
+    def parse_args(self, ctx, args):
+        if args and args[0] not in self.commands and args[0] not in ctx.help_option_names:
+            args = ['convert'] + list(args)
+        return super(DefaultCommandGroup, self).parse_args(ctx, args)
+
+
+@click.group(cls=DefaultCommandGroup)
+def main():
+    """Convert panoramas between projections (the `convert` command by default)"""
+
+
+# options of the projections and of the sampling, shared by the conversion commands
+PROJECTION_OPTIONS = [
+    click.option('--in-projection', type=str),
+    click.option('--out-projection', type=str),
+    click.option('--output-width', type=int, default=4096),
+    click.option('--cubemap-border-padding', type=int, default=0,
+                 help="Padding of each side of a cubemap input, or around an octahedral input, skipped when sampling"),
+    click.option('--cubemap-gutters', type=int, default=0,
+                 help="Gutters around each side of a cubemap output, or around an octahedral output, "
+                      "rendered from the neighbouring sides (or across the folds)"),
+    click.option('--cubemap-layout', type=click.Choice(sorted(CUBEMAP_LAYOUTS)), default='strip',
+                 help="Layout of the cubemap images, the strip output being split into 6 images"),
+    click.option('--stereo', type=click.Choice(sorted(STEREO_LAYOUTS)), default='mono',
+                 help="Placement of the eyes of stereo images, top/bottom or side by side, "
+                      "for the input and the output"),
+    click.option('--lens-model', type=click.Choice(sorted(LENS_MODELS)), default='equidistant',
+                 help="Lens model of the fisheye projections"),
+    click.option('--fov', type=float, default=None,
+                 help="Field of view of the fisheye lenses, in degrees (180, 190 for dual fisheye)"),
+    click.option('--feather', type=float, default=None,
+                 help="Width of the blending of the dual fisheye lenses where they overlap, in degrees (5 by default)"),
+    click.option('--yaw', type=float, default=0.0, help="Rotation around the vertical axis, in degrees"),
+    click.option('--pitch', type=float, default=0.0, help="Rotation tilting the view up, in degrees"),
+    click.option('--roll', type=float, default=0.0, help="Rotation around the viewing axis, in degrees"),
+    click.option('--depth', type=click.Choice(sorted(DEPTHS)), default='8',
+                 help="Storage of the images: 8 or 16 bits integers, half or float for HDR (e.g. EXR) images"),
+]
+
+# options of the encoding and of the sampling, which the queue workers choose
+OUTPUT_OPTIONS = [
+    click.option('--interpolation', type=click.Choice(sorted(INTERPOLATIONS)), default='linear',
+                 help="Sampling of the input, mipmap avoids aliasing when downscaling, "
+                      "bicubic and lanczos3 reuse their weights across the images of a batch"),
+    click.option('--quality', type=int, default=-1,
+                 help="Encoding quality of the outputs in [0,100] (jpeg and webp only)"),
+]
+
+
+def with_options(options):
+    def decorator(f):
+        for option in reversed(options):
+            f = option(f)
+        return f
+    return decorator
+
+
+@main.command()
+@with_options(PROJECTION_OPTIONS + OUTPUT_OPTIONS)
 @click.option('--output', type=click.Path(), default='output.jpg')
-@click.option('--output-width', type=int, default=4096)
-@click.option('--cubemap-border-padding', type=int, default=0, help="Padding for each side of the cubemap (only for the cubemap projection)")
+@click.option('--memory-budget', type=int, default=TILED_MEMORY_BUDGET >> 20,
+              help="Memory of the source tiles kept while converting a tiled source ({}), in MB".format(
+                  TILED_SOURCE_EXTENSION))
+@click.argument('in_images', nargs=-1, type=click.Path(exists=True))
+def convert(output, memory_budget, interpolation, quality, in_images, **settings):
+    """Convert an image (or the 6 sides of a cubemap)"""
+    enable_exr(list(in_images) + [output])
+    conversion = make_conversion(in_images, settings)
+    if conversion is None:
+        return
+    input_image_path, in_proj, out_proj, out_proj_options = conversion
+
+    click.echo("--> Converting projections...")
+    processor = ConvertProjectionProcessor(input_image_path, depth=DEPTHS[settings['depth']],
+                                           memory_budget=memory_budget << 20)
+    out = processor.run(in_proj, out_proj, rotation=rotation(settings), interpolation=INTERPOLATIONS[interpolation])
+    click.echo("    done")
+
+    # the 6 faces of a strip cubemap are written apart, as the batches and the daemon do
+    output_paths = PROJECTION_CLASSES[settings['out_projection']].output_paths(output, out_proj_options)
+    write_output(output_paths, out, quality)
+    if len(output_paths) > 1:
+        for output_face_filename in output_paths:
+            click.echo(click.style("Face saved at '{}'".format(output_face_filename), fg='green'))
+    else:
+        click.echo(click.style("Done! Conversion saved at '{}'".format(output), fg='green'))
+
+
+@main.command()
+@with_options(PROJECTION_OPTIONS + OUTPUT_OPTIONS)
+@click.option('--output', type=click.Path(), default='output.jpg',
+              help="Name of the directory of the pyramids, its extension giving the format of the tiles")
+@click.option('--tile-size', type=int, default=256, help="Side of the tiles")
 @click.argument('in_images', nargs=-1, type=click.Path(exists=True))
-def main(in_projection, out_projection, output, output_width, cubemap_border_padding, in_images):
+def pyramid(output, tile_size, interpolation, quality, in_images, **settings):
+    """Write the sides of a mono cubemap output as Deep Zoom tile pyramids"""
+    if settings['out_projection'] not in CUBEMAP_PROJECTIONS or settings['stereo'] != 'mono':
+        click.echo(click.style("The pyramids are made of the sides of a mono cubemap output", fg='red'))
+        return
+    if any(is_tiled_source(path) for path in in_images):
+        click.echo(click.style("The pyramids are converted from decoded images, not tiled sources", fg='red'))
+        return
+    enable_exr(list(in_images) + [output])
+    conversion = make_conversion(in_images, settings)
+    if conversion is None:
+        return
+    input_image_path, in_proj, out_proj, _ = conversion
+
+    click.echo("--> Converting projections...")
+    processor = ConvertProjectionProcessor(input_image_path, depth=DEPTHS[settings['depth']])
+    output_name, output_ext = output.rsplit('.', 1)
+    processor.run_pyramid(in_proj, out_proj, output_name, rotation=rotation(settings),
+                          interpolation=INTERPOLATIONS[interpolation], tile_size=tile_size, tile_format=output_ext,
+                          quality=quality)
+    click.echo(click.style("Done! Pyramids saved into '{}'".format(output_name), fg='green'))
+
+
+@main.command()
+@with_options(PROJECTION_OPTIONS + OUTPUT_OPTIONS)
+@click.option('--output-dir', type=click.Path(), default='output', help="Output directory of the images")
+@click.option('--jobs', type=int, default=0, help="Number of threads (defaults to one per core)")
+@click.argument('source', type=click.Path(exists=True))
+def batch(output_dir, jobs, interpolation, quality, source, **settings):
+    """Convert a directory (or a manifest) of images within this process"""
+    config = queue_config(settings)
+    processor = make_batch_processor(config, jobs, quality, interpolation)
+    if processor is None:
+        return
+
+    batch_jobs = list_jobs(source, output_dir)
+    click.echo(click.style("batch: {} images".format(len(batch_jobs)), fg='blue'))
+
+    progress = {'done': 0, 'failed': 0}
+
+    def report(input_path, output_path, success, error):
+        progress['done'] += 1
+        prefix = "[{}/{}]".format(progress['done'], len(batch_jobs))
+        if success:
+            click.echo("{} {} -> {}".format(prefix, input_path, ', '.join(processor.output_paths(output_path))))
+        else:
+            progress['failed'] += 1
+            click.echo(click.style("{} {} failed: {}".format(prefix, input_path, error), fg='red'))
+
+    start = time.time()
+    processor.run(batch_jobs, rotation=config['rotation'], callback=report)
+
+    color = 'green' if progress['failed'] == 0 else 'yellow'
+    click.echo(click.style("Done! {} converted, {} failed in {:.1f}s".format(
+        progress['done'] - progress['failed'], progress['failed'], time.time() - start), fg=color))
+
+
+@main.command()
+@with_options(PROJECTION_OPTIONS)
+@click.option('--output-dir', type=click.Path(), default='output', help="Output directory of the images")
+@click.argument('queue_dir', type=click.Path())
+@click.argument('source', type=click.Path(exists=True))
+def enqueue(output_dir, queue_dir, source, **settings):
+    """Add a directory (or a manifest) of images to a shared queue, for its workers to convert"""
+    added = WorkQueue(queue_dir).enqueue(list_jobs(source, output_dir), queue_config(settings))
+    click.echo(click.style("{} jobs added to '{}'".format(added, queue_dir), fg='green'))
+
+
+@main.command()
+@with_options(OUTPUT_OPTIONS)
+@click.option('--jobs', type=int, default=0, help="Number of threads (defaults to one per core)")
+@click.option('--worker-id', type=str, default=None, help="Name of the worker (defaults to host-pid)")
+@click.option('--lease', type=float, default=300,
+              help="Seconds without heartbeat before the jobs of a worker are reclaimed")
+@click.option('--chunk', type=int, default=16, help="Number of jobs claimed at once")
+@click.argument('queue_dir', type=click.Path(exists=True))
+def worker(jobs, worker_id, lease, chunk, interpolation, quality, queue_dir):
+    """Convert the jobs of a shared queue, with the settings it was filled with"""
+    queue = WorkQueue(queue_dir)
+    config = dict(CONVERSION_DEFAULTS, **queue.config())
+    processor = make_batch_processor(config, jobs, quality, interpolation)
+    if processor is None:
+        return
+
+    worker_id = worker_id or default_worker_id()
+    click.echo(click.style("worker '{}' on queue '{}'".format(worker_id, queue_dir), fg='blue'))
+
+    def report(input_path, output_path, success, error):
+        if success:
+            click.echo("{} -> {}".format(input_path, ', '.join(processor.output_paths(output_path))))
+        else:
+            click.echo(click.style("{} failed: {}".format(input_path, error), fg='red'))
+
+    converted, failed = run_worker(queue, processor, worker_id, lease=lease, chunk=chunk,
+                                   rotation=config['rotation'], callback=report)
+    click.echo(click.style("Done! {} converted, {} failed, queue status: {}".format(
+        converted, failed, queue.status()), fg='green'))
+
+
+@main.command()
+@click.option('--jobs', type=int, default=0, help="Number of threads (defaults to one per core)")
+@click.argument('socket_path', type=click.Path())
+def serve(jobs, socket_path):
+    """Run a conversion daemon listening on a Unix socket (see `projector --connect`)"""
+    click.echo(click.style("daemon listening on '{}'".format(socket_path), fg='blue'))
+    ConversionDaemon(socket_path, jobs).serve_forever()
+
+
+@click.command()
+@click.option('--tile-size', type=int, default=256, help="Side of the tiles, a multiple of 64")
+@click.option('--depth', type=click.Choice(sorted(DEPTHS)), default='8',
+              help="Depth the tiles are stored at (half is stored as float)")
+@click.argument('in_image', type=click.Path(exists=True))
+@click.argument('output', type=click.Path(), required=False)
+def make_tiles(tile_size, depth, in_image, output):
+    """Convert a (very large) master image into a tiled source, once, for the conversions to read it by tiles"""
+    output = output or in_image.rsplit('.', 1)[0] + TILED_SOURCE_EXTENSION
+    enable_exr([in_image])
+    flags = libprojector.decode_flags(DEPTHS[depth], 1)
+    image = cv2.imread(in_image, flags)
+    if image is None:
+        click.echo(click.style("unable to read '{}'".format(in_image), fg='red'))
+        return
+    if DEPTHS[depth] == libprojector.ImageDepth.float16:
+        depth = 'float'
+    write_tiled_source(output, libprojector.to_image_depth(image, DEPTHS[depth]), tile_size)
+    click.echo(click.style("Done! Tiled source saved at '{}'".format(output), fg='green'))
+
+
+def rotation(settings):
+    return settings['yaw'], settings['pitch'], settings['roll']
+
+
+def lens_options(lens_model, fov, feather):
+    """Options of the fisheye projections, their defaults depending on the projection"""
+    options = {'lens_model': lens_model}
+    if fov is not None:
+        options['fov'] = fov
+    if feather is not None:
+        options['feather'] = feather
+    return options
+
+
+def make_conversion(in_images, settings):
+    """(input image path, input projection, output projection, output options) of a conversion, None if invalid"""
+    in_projection = settings['in_projection']
+    out_projection = settings['out_projection']
+    stereo = settings['stereo']
+    lens = lens_options(settings['lens_model'], settings['fov'], settings['feather'])
     click.echo(click.style("input images: #{}".format(len(in_images)), fg='blue'))
     click.echo(click.style("input proj: {}".format(in_projection), fg='blue'))
     click.echo(click.style("output proj: {}".format(out_projection), fg='blue'))
 
     input_image_path = None
-    input_image = None
+    input_width = None
 
-    in_proj_options = {}
-    out_proj_options = {}
+    in_proj_options = {'stereo': stereo}
+    out_proj_options = {'stereo': stereo}
 
-    if in_projection == PROJECTION_CUBEMAP:
-        in_proj_options['border_padding'] = cubemap_border_padding
+    if in_projection in CUBEMAP_PROJECTIONS:
+        in_proj_options['border_padding'] = settings['cubemap_border_padding']
 
         # validate input images
-        if len(in_images) != 6:
-            click.echo(click.style("You need to supply 6 images for the cubemap projection", fg='red'))
-            return
-
-        # merge the 6 faces into one map
-        click.echo("--> Merging cubemap images...")
-        merged_image = generate_cubemap(in_images)
-        click.echo("    done")
-
-        # TODO use a tmp file instead
-        merged_image.save('cubemap.jpg')
-
-        input_image_path = 'cubemap.jpg'
-        input_image = merged_image
-    elif in_projection == PROJECTION_EQUIRECTANGULAR:
+        if len(in_images) == 6 and stereo == 'mono':
+            # only the header is read here, the processor decodes the 6 faces
+            # in parallel straight into one strip
+            input_image_path = list(in_images)
+            input_width = 6 * image_size(in_images[0])[0]
+        elif len(in_images) == 1:
+            # a single image of the whole layout, sampled as is
+            in_proj_options['layout'] = settings['cubemap_layout']
+            input_image_path = in_images[0]
+            input_width = image_size(input_image_path)[0]
+        else:
+            click.echo(click.style("You need to supply 6 images, or 1 with --cubemap-layout (or --stereo), "
+                                   "for the cubemap projection", fg='red'))
+            return None
+    elif in_projection in SPHERICAL_PROJECTIONS + FISHEYE_PROJECTIONS:
 
         # validate input images
         if len(in_images) != 1:
-            click.echo(click.style("You need to supply 1 image for the equirectangular projection", fg='red'))
-            return
+            click.echo(click.style("You need to supply 1 image for the {} projection".format(in_projection), fg='red'))
+            return None
+        if in_projection == PROJECTION_OCTAHEDRAL:
+            in_proj_options['border_padding'] = settings['cubemap_border_padding']
+        elif in_projection in FISHEYE_PROJECTIONS:
+            in_proj_options.update(lens)
 
+        # only the header is read here, the image is decoded once by the processor
         input_image_path = in_images[0]
-        input_image = Image.open(input_image_path)
+        input_width = image_size(input_image_path)[0]
     else:
         raise ValueError("input projection '{}' not fully implemented yet".format(in_projection))
 
-    if out_projection == PROJECTION_CUBEMAP:
-        out_proj_options['border_padding'] = cubemap_border_padding
-    elif out_projection == PROJECTION_EQUIRECTANGULAR:
+    if out_projection in CUBEMAP_PROJECTIONS:
+        out_proj_options['border_padding'] = settings['cubemap_gutters']
+        out_proj_options['gutters'] = True
+        out_proj_options['layout'] = settings['cubemap_layout']
+    elif out_projection == PROJECTION_OCTAHEDRAL:
+        out_proj_options['border_padding'] = settings['cubemap_gutters']
+    elif out_projection in FISHEYE_PROJECTIONS:
+        out_proj_options.update(lens)
+    elif out_projection in SPHERICAL_PROJECTIONS:
         pass
     else:
         raise ValueError("output projection '{}' not fully implemented yet".format(out_projection))
@@ -66,33 +322,43 @@ def main(in_projection, out_projection, output, output_width, cubemap_border_pad
     click.echo(click.style("Input proj options: {}".format(in_proj_options), fg='blue'))
     click.echo(click.style("Output proj options: {}".format(out_proj_options), fg='blue'))
 
-    if in_projection not in PROJECTION_CLASSES:
-        click.echo(click.style("Unknown input projection '{}'".format(in_projection), fg='red'))
-        return
-    in_proj = PROJECTION_CLASSES[in_projection](input_image.size[0], in_proj_options)
+    in_proj = PROJECTION_CLASSES[in_projection](input_width, in_proj_options)
+    out_proj = PROJECTION_CLASSES[out_projection](settings['output_width'], out_proj_options)
+    return input_image_path, in_proj, out_proj, out_proj_options
 
-    if out_projection not in PROJECTION_CLASSES:
-        click.echo(click.style("Unknown output projection '{}'".format(out_projection), fg='red'))
-        return
-    out_proj = PROJECTION_CLASSES[out_projection](output_width, out_proj_options)
 
-    click.echo("--> Converting projections...")
-    processor = ConvertProjectionProcessor(input_image_path)
-    out = processor.run(in_proj, out_proj)
-    click.echo("    done")
-        
-    if out_projection == PROJECTION_EQUIRECTANGULAR:
-        cv2.imwrite(output, out)
-        click.echo(click.style("Done! Conversion saved at '{}'".format(output), fg='green'))
-    elif out_projection == PROJECTION_CUBEMAP:
-        cube_images = split_cubemap(out)
-        output_name, output_ext = output.rsplit('.', 1)
-        for (face_suffix, img) in cube_images.items():
-            output_face_filename = "{}{}.{}".format(output_name, face_suffix, output_ext)
-            cv2.imwrite(output_face_filename, img)
-            click.echo(click.style("Face saved at '{}'".format(output_face_filename), fg='green'))
-    else:
-        raise ValueError("output projection '{}' not fully implemented yet".format(out_projection))
+def queue_config(settings):
+    """Settings of the batches, as stored in the config of a queue"""
+    return {
+        'in_projection': settings['in_projection'],
+        'out_projection': settings['out_projection'],
+        'output_width': settings['output_width'],
+        'cubemap_border_padding': settings['cubemap_border_padding'],
+        'cubemap_gutters': settings['cubemap_gutters'],
+        'cubemap_layout': settings['cubemap_layout'],
+        'stereo': settings['stereo'],
+        'lens': lens_options(settings['lens_model'], settings['fov'], settings['feather']),
+        'rotation': list(rotation(settings)),
+        'depth': settings['depth'],
+    }
+
+
+def make_batch_processor(config, jobs, quality, interpolation):
+    """Processor of the settings of a queue config (see queue_config), None if invalid"""
+    for projection in (config['in_projection'], config['out_projection']):
+        if projection not in PROJECTION_CLASSES:
+            click.echo(click.style("Unknown projection '{}'".format(projection), fg='red'))
+            return None
+
+    # the batch inputs are single images, i.e. whole layouts for the cubemaps
+    in_proj_options, out_proj_options = proj_options(config['cubemap_border_padding'], config['cubemap_gutters'],
+                                                     config['cubemap_layout'], config['stereo'], config['lens'])
+    return BatchProcessor(
+        PROJECTION_CLASSES[config['in_projection']], in_proj_options,
+        PROJECTION_CLASSES[config['out_projection']], out_proj_options,
+        config['output_width'], jobs, quality, INTERPOLATIONS[interpolation], DEPTHS[config['depth']]
+    )
+
 
 if __name__ == "__main__":
     main()
@@ -0,0 +1,192 @@
+"""
+ Thin client of the conversion daemon (see daemon.py).
+
+ Only the standard library is imported (numpy on demand, for the shared
+ memory buffers), so that a conversion request costs a connection rather
+ than the start of the native engine.
+"""
+import argparse
+import json
+import os
+import socket
+import sys
+
+DEFAULT_SOCKET = '/tmp/projector.sock'
+
+
+class Connection(object):
+    """Connection to the daemon, for several requests in a row"""
+
+    def __init__(self, socket_path, timeout=None):
+        self.socket_path = socket_path
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._socket.settimeout(timeout)
+        try:
+            self._socket.connect(socket_path)
+        except Exception:
+            self._socket.close()
+            raise
+        self._replies = self._socket.makefile('rb')
+
+    def request(self, message):
+        """Send one request (a dict) and return the reply of the daemon"""
+        self._socket.sendall((json.dumps(message) + '\n').encode('utf-8'))
+        reply = self._replies.readline()
+        if not reply:
+            raise IOError("no reply from the daemon on '{}'".format(self.socket_path))
+        return json.loads(reply.decode('utf-8'))
+
+    def close(self):
+        self._replies.close()
+        self._socket.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc_info):
+        self.close()
+
+
+def send_request(socket_path, message, timeout=None):
+    """Send one request (a dict) to the daemon and return its reply"""
+    with Connection(socket_path, timeout) as connection:
+        return connection.request(message)
+
+
+def attach_shared_memory(name):
+    """
+     Open the shared memory segment `name` of another process, which stays
+     in charge of unlinking it: before Python 3.13 the resource tracker of
+     this process would otherwise unlink it (with a warning) at exit.
+    """
+    from multiprocessing import resource_tracker, shared_memory
+
+    if sys.version_info >= (3, 13):
+        return shared_memory.SharedMemory(name=name, track=False)
+    segment = shared_memory.SharedMemory(name=name)
+    resource_tracker.unregister(segment._name, 'shared_memory')
+    return segment
+
+
+def convert_array(socket_path, image, config, output=None):
+    """
+     Convert a decoded image (numpy array) through shared memory, without
+     encoding it. `config` holds the conversion settings (see
+     ConversionDaemon). The output is returned as an array, or written to
+     the `output` path by the daemon (and None returned).
+    """
+    import numpy as np
+    from multiprocessing import shared_memory
+
+    with Connection(socket_path) as connection:
+        source = shared_memory.SharedMemory(create=True, size=image.nbytes)
+        try:
+            np.ndarray(image.shape, image.dtype, buffer=source.buf)[...] = image
+            message = dict(config, input={'shm': source.name, 'shape': list(image.shape), 'dtype': str(image.dtype)},
+                           output=output if output is not None else {'shm': True})
+            reply = connection.request(message)
+        finally:
+            source.close()
+            source.unlink()
+
+        if not reply['ok']:
+            raise RuntimeError(reply['error'])
+        if output is not None:
+            return None
+
+        # the daemon unlinks its output once released, or once the connection is lost
+        result = attach_shared_memory(reply['shm'])
+        try:
+            return np.ndarray(reply['shape'], reply['dtype'], buffer=result.buf).copy()
+        finally:
+            result.close()
+            connection.request({'command': 'release', 'shm': reply['shm']})
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description="Send a conversion to a running projector daemon")
+    parser.add_argument('--socket', default=DEFAULT_SOCKET, help="Unix socket of the daemon")
+    parser.add_argument('--in-projection')
+    parser.add_argument('--out-projection')
+    parser.add_argument('--output', default='output.jpg')
+    parser.add_argument('--output-width', type=int, default=4096)
+    parser.add_argument('--cubemap-border-padding', type=int, default=0)
+    parser.add_argument('--cubemap-gutters', type=int, default=0)
+    parser.add_argument('--cubemap-layout', default='strip')
+    parser.add_argument('--stereo', default='mono')
+    parser.add_argument('--lens-model', default='equidistant')
+    parser.add_argument('--fov', type=float, default=None)
+    parser.add_argument('--feather', type=float, default=None)
+    parser.add_argument('--yaw', type=float, default=0.0)
+    parser.add_argument('--pitch', type=float, default=0.0)
+    parser.add_argument('--roll', type=float, default=0.0)
+    parser.add_argument('--interpolation', default='linear')
+    parser.add_argument('--depth', default='8')
+    parser.add_argument('--quality', type=int, default=-1)
+    parser.add_argument('--ping', action='store_true', help="Only check that the daemon runs")
+    parser.add_argument('--shutdown', action='store_true', help="Stop the daemon")
+    parser.add_argument('in_image', nargs='?')
+    args = parser.parse_args(argv)
+
+    if args.ping or args.shutdown:
+        reply = send_request(args.socket, {'command': 'ping' if args.ping else 'shutdown'})
+    elif args.in_image is None:
+        parser.error("an input image is needed")
+    else:
+        lens = {'lens_model': args.lens_model}
+        if args.fov is not None:
+            lens['fov'] = args.fov
+        if args.feather is not None:
+            lens['feather'] = args.feather
+        reply = send_request(args.socket, make_request(
+            args.in_projection, args.out_projection, args.output_width, args.cubemap_border_padding,
+            args.cubemap_gutters, args.cubemap_layout, args.stereo, lens, (args.yaw, args.pitch, args.roll), args.depth,
+            args.interpolation, args.quality, args.in_image, args.output))
+
+    if not reply['ok']:
+        sys.stderr.write("{}\n".format(reply['error']))
+        return 1
+    for path in reply.get('outputs', []):
+        sys.stdout.write("{}\n".format(path))
+    return 0
+
+
+def make_request(in_projection, out_projection, output_width, cubemap_border_padding, cubemap_gutters, cubemap_layout,
+                 stereo, lens, rotation, depth, interpolation, quality, input_path, output_path):
+    """Conversion request of an image file, the settings being the ones of the queue config"""
+    # the daemon doesn't run in the directory of the client
+    return {
+        'in_projection': in_projection,
+        'out_projection': out_projection,
+        'output_width': output_width,
+        'cubemap_border_padding': cubemap_border_padding,
+        'cubemap_gutters': cubemap_gutters,
+        'cubemap_layout': cubemap_layout,
+        'stereo': stereo,
+        'lens': lens,
+        'rotation': list(rotation),
+        'depth': depth,
+        'interpolation': interpolation,
+        'quality': quality,
+        'input': os.path.abspath(input_path),
+        'output': os.path.abspath(output_path),
+    }
+
+
+def run(argv=None):
+    """
+     Entry point of `projector`: the conversions sent to a daemon with
+     --connect are parsed here, without the imports of the native engine
+     (the options other than the ones of a request are refused), the other
+     modes going to projector.cli.
+    """
+    argv = sys.argv[1:] if argv is None else list(argv)
+    if not any(arg == '--connect' or arg.startswith('--connect=') for arg in argv):
+        from .cli import main as cli_main
+        return cli_main(args=argv)
+    return main(['--socket' + arg[len('--connect'):] if arg == '--connect' or arg.startswith('--connect=') else arg
+                 for arg in argv])
+
+
+if __name__ == "__main__":
+    sys.exit(main())
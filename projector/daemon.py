@@ -0,0 +1,222 @@
+import json
+import os
+import socket
+import socketserver
+import threading
+from collections import OrderedDict
+
+import numpy as np
+
+from .batch import BatchProcessor
+from .client import attach_shared_memory
+from .image_io import enable_exr, write_output
+from .processors import DEPTHS, INTERPOLATIONS
+from .projections import PROJECTION_CLASSES, proj_options
+
+# settings of the requests, the ones of the queue config with their defaults
+CONVERSION_DEFAULTS = {
+    'cubemap_border_padding': 0,
+    'cubemap_gutters': 0,
+    'cubemap_layout': 'strip',
+    'stereo': 'mono',
+    'lens': {},
+    'rotation': [0, 0, 0],
+    'depth': '8',
+    'interpolation': 'linear',
+    'quality': -1,
+}
+
+
+class ConversionDaemon(object):
+    """
+     Long running conversion service on a Unix socket, keeping the native
+     engine, its thread pool and the maps built warm between the requests.
+
+     The requests and the replies are JSON objects, one per line, several
+     requests being possible on a connection. A conversion request holds
+     the settings of the queue config (in_projection, out_projection,
+     output_width, rotation...), the `interpolation` and `quality`, with:
+
+      - `input`: an image path (a whole layout for a cubemap input), or a
+        decoded image in shared memory {"shm": name, "shape", "dtype"}
+      - `output`: an image path (the sides of a mono strip cubemap being
+        written apart, suffixed as the cli does), or {"shm": true} for a
+        decoded image in shared memory from a shared memory input
+
+     The replies are {"ok": true, "outputs": [paths written]}, or {"ok": true,
+     "shm": name, "shape", "dtype"}, or {"ok": false, "error": message}.
+     {"command": "ping"} and {"command": "shutdown"} are the other requests,
+     with {"command": "release", "shm": name} once a shared memory output is
+     read: the daemon unlinks it then, or when the connection is lost.
+
+     The processors of the last `cache_size` settings are kept, all running
+     on the thread pool and the maps of the first one. The requests of image
+     paths with the same settings are converted one at a time, the shared
+     memory ones concurrently.
+    """
+
+    def __init__(self, socket_path, jobs=0, cache_size=16):
+        self.socket_path = socket_path
+        self.jobs = jobs
+        self.cache_size = cache_size
+        self._lock = threading.Lock()
+        self._processors = OrderedDict()
+        self._shared = None
+        self._server = None
+        self._stopping = False
+
+    def serve_forever(self):
+        if os.path.exists(self.socket_path):
+            self._check_stale_socket()
+        daemon = self
+
+        class Handler(socketserver.StreamRequestHandler):
+            def handle(self):
+                # the shared memory outputs not released yet
+                segments = {}
+                try:
+                    for line in self.rfile:
+                        try:
+                            request = json.loads(line.decode('utf-8'))
+                        except ValueError as e:
+                            reply = {'ok': False, 'error': "malformed request: {}".format(e)}
+                        else:
+                            reply = daemon.handle(request, segments)
+                        self.wfile.write((json.dumps(reply) + '\n').encode('utf-8'))
+                        self.wfile.flush()
+                        if daemon._stopping:
+                            # once replied, the process ending with the serving thread
+                            # (this one being another one)
+                            daemon._server.shutdown()
+                            return
+                finally:
+                    for segment in segments.values():
+                        segment.close()
+                        segment.unlink()
+
+        self._server = socketserver.ThreadingUnixStreamServer(self.socket_path, Handler)
+        self._server.daemon_threads = True
+        # local to the user running the daemon
+        os.chmod(self.socket_path, 0o600)
+        try:
+            self._server.serve_forever()
+        finally:
+            self._server.server_close()
+            os.unlink(self.socket_path)
+
+    def _check_stale_socket(self):
+        """Remove the socket left by a daemon that is gone, refusing to take over a running one"""
+        probe = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            probe.connect(self.socket_path)
+        except ConnectionRefusedError:
+            os.unlink(self.socket_path)
+        except FileNotFoundError:
+            pass
+        else:
+            raise RuntimeError("a daemon already listens on '{}'".format(self.socket_path))
+        finally:
+            probe.close()
+
+    def handle(self, request, segments=None):
+        """Reply to a request, `segments` being the shared memory outputs of its connection by name"""
+        if not isinstance(request, dict):
+            return {'ok': False, 'error': "malformed request: not a JSON object"}
+        if segments is None:
+            segments = {}
+        command = request.get('command', 'convert')
+        try:
+            if command == 'ping':
+                return {'ok': True}
+            if command == 'shutdown':
+                self._stopping = True
+                return {'ok': True}
+            if command == 'release':
+                segment = segments.pop(request.get('shm'), None)
+                if segment is None:
+                    return {'ok': False, 'error': "unknown shared memory output '{}'".format(request.get('shm'))}
+                segment.close()
+                segment.unlink()
+                return {'ok': True}
+            if command == 'convert':
+                return self._convert(dict(CONVERSION_DEFAULTS, **request), segments)
+            return {'ok': False, 'error': "unknown command '{}'".format(command)}
+        except Exception as e:
+            return {'ok': False, 'error': str(e)}
+
+    def _processor(self, config):
+        """(lock, processor) of the settings of `config`, the LRU keeping the last `cache_size` ones"""
+        settings = ('in_projection', 'out_projection', 'output_width', 'cubemap_border_padding', 'cubemap_gutters',
+                    'cubemap_layout', 'stereo', 'lens', 'depth', 'interpolation', 'quality')
+        key = json.dumps([config[name] for name in settings], sort_keys=True)
+        with self._lock:
+            if key in self._processors:
+                self._processors[key] = self._processors.pop(key)
+                return self._processors[key]
+
+            in_options, out_options = proj_options(config['cubemap_border_padding'], config['cubemap_gutters'],
+                                                   config['cubemap_layout'], config['stereo'], config['lens'])
+            processor = BatchProcessor(
+                PROJECTION_CLASSES[config['in_projection']], in_options,
+                PROJECTION_CLASSES[config['out_projection']], out_options,
+                config['output_width'], self.jobs, config['quality'], INTERPOLATIONS[config['interpolation']],
+                DEPTHS[config['depth']], shared=self._shared
+            )
+            # the first one owns the pool and the maps, kept even once out of the LRU
+            if self._shared is None:
+                self._shared = processor
+            self._processors[key] = (threading.Lock(), processor)
+            while len(self._processors) > self.cache_size:
+                self._processors.popitem(last=False)
+            return self._processors[key]
+
+    def _convert(self, config, segments):
+        for projection in (config['in_projection'], config['out_projection']):
+            if projection not in PROJECTION_CLASSES:
+                raise ValueError("unknown projection '{}'".format(projection))
+        if isinstance(config['input'], dict):
+            return self._convert_shared(config, segments)
+        if not isinstance(config['output'], str):
+            raise ValueError("the image path inputs are converted into image paths")
+
+        lock, processor = self._processor(config)
+        outputs = processor.output_paths(config['output'])
+        results = []
+
+        def report(input_path, output_path, success, error):
+            results.append((success, error))
+
+        with lock:
+            processor.run([(config['input'], config['output'])], rotation=config['rotation'], callback=report)
+        success, error = results[0]
+        if not success:
+            return {'ok': False, 'error': error}
+        return {'ok': True, 'outputs': outputs}
+
+    def _convert_shared(self, config, segments):
+        from multiprocessing import shared_memory
+
+        source = config['input']
+        _, processor = self._processor(config)
+        # opened without the resource tracker, the client unlinking its input
+        segment = attach_shared_memory(source['shm'])
+        try:
+            image = np.ndarray(tuple(source['shape']), source['dtype'], buffer=segment.buf)
+            # without the GIL: the other requests go on meanwhile
+            out = processor.convert_image(image, config['rotation'])
+            # the view must go before the segment can be closed
+            del image
+        finally:
+            segment.close()
+
+        if isinstance(config['output'], str):
+            outputs = processor.output_paths(config['output'])
+            enable_exr(outputs)
+            write_output(outputs, out, config['quality'])
+            return {'ok': True, 'outputs': outputs}
+
+        # kept open until the client releases it (see Handler)
+        result = shared_memory.SharedMemory(create=True, size=out.nbytes)
+        np.ndarray(out.shape, out.dtype, buffer=result.buf)[...] = out
+        segments[result.name] = result
+        return {'ok': True, 'shm': result.name, 'shape': list(out.shape), 'dtype': str(out.dtype)}
@@ -0,0 +1,62 @@
+import os
+
+import cv2
+import numpy as np
+
+import libprojector
+
+
+def enable_exr(paths):
+    """
+     OpenCV only reads and writes the EXR images when asked to, which is done
+     for the conversions of local EXR files: before their first image, as
+     OpenCV reads the setting once.
+    """
+    if any(path.lower().endswith('.exr') for path in paths):
+        os.environ.setdefault('OPENCV_IO_ENABLE_OPENEXR', '1')
+
+
+def probe_image_size(path):
+    """(width, height) read from the image header only, or None for the formats not supported (jpeg/png are)"""
+    return libprojector.probe_image_size(path)
+
+
+def image_size(path):
+    """(width, height) of an image, from its header when possible"""
+    return libprojector.image_size(path)
+
+
+def read_images(paths, flags=cv2.IMREAD_COLOR):
+    """Decode the images in parallel"""
+    return libprojector.read_images(list(paths), flags)
+
+
+def read_cubemap(paths, flags=cv2.IMREAD_COLOR):
+    """Decode the 6 faces (+x, -x, +y, -y, +z, -z) in parallel, straight into a 6:1 cubemap"""
+    return libprojector.read_cubemap(list(paths), flags)
+
+
+def write_images(paths, images, quality=-1):
+    """Encode the images in parallel, `quality` in [0,100] for jpeg and webp (negative for the default)"""
+    libprojector.write_images(list(paths), list(images), quality)
+
+
+def write_output(paths, image, quality=-1):
+    """
+     Encode an output to its paths (see BaseProj.output_paths): the image,
+     or the sides of a strip cubemap in parallel
+    """
+    write_images(paths, np.hsplit(image, len(paths)) if len(paths) > 1 else [image], quality)
+
+
+# extension of the tiled sources (see write_tiled_source)
+TILED_SOURCE_EXTENSION = '.ptiles'
+
+
+def is_tiled_source(path):
+    return isinstance(path, str) and path.lower().endswith(TILED_SOURCE_EXTENSION)
+
+
+def write_tiled_source(path, image, tile_size=256):
+    """Store a (very large) image in tiles with its pyramid, to be converted without decoding it whole"""
+    libprojector.write_tiled_source(path, image, tile_size)
@@ -1,11 +1,12 @@
 import cv2
 import numpy as np
-from PIL import Image
 
 import libprojector
 
+from .image_io import is_tiled_source
 
-def generate_cubemap(images):
+
+def generate_cubemap(images, depth=libprojector.ImageDepth.uint8):
     """
      Compose a cubemap associated with the following cubemap layout
 
@@ -14,41 +15,13 @@ def generate_cubemap(images):
      |  side  |  side  |  side  |  side  |  side  |  side  |
       -------- -------- -------- -------- -------- --------
 
+     The sides are decoded at `depth` (one of DEPTHS), e.g. to keep 16 bits
+     or HDR sides as they are.
     """
-    merged_image = None
-    side_size = 0
-    x_offset, y_offset = (0, 0)
-    for idx, img_path in enumerate(images):
-        img = Image.open(img_path)
-        if merged_image is None:
-            side_size = img.size[0]
-            cubemap_size = (side_size*6, side_size*1)
-            merged_image = Image.new(img.mode, cubemap_size)
-
-        if idx == 0:
-            # front side (+x)
-            x_offset, y_offset = (0*side_size, 0*side_size)
-        elif idx == 1:
-            # back side (-x)
-            x_offset, y_offset = (1*side_size, 0*side_size)
-        elif idx == 2:
-            # left side (+y)
-            x_offset, y_offset = (2*side_size, 0*side_size)
-        elif idx == 3:
-            # right side (-y)
-            x_offset, y_offset = (3*side_size, 0*side_size)
-        elif idx == 4:
-            # top side (+z)
-            x_offset, y_offset = (4*side_size, 0*side_size)
-        elif idx == 5:
-            # bottom side (-z)
-            x_offset, y_offset = (5*side_size, 0*side_size)
-        else:
-            raise ValueError("Unknown side index")
-
-        merged_image.paste(img, (x_offset, y_offset))
-
-    return merged_image
+    if len(images) != 6:
+        raise ValueError("A cubemap needs 6 sides")
+    cubemap = libprojector.read_cubemap(list(images), libprojector.decode_flags(depth, 1))
+    return libprojector.to_image_depth(cubemap, depth)
 
 
 def split_cubemap(map_image):
@@ -88,28 +61,221 @@ def split_cubemap(map_image):
     return splitted_images
 
 
+INTERPOLATIONS = {
+    'nearest': cv2.INTER_NEAREST,
+    'linear': cv2.INTER_LINEAR,
+    'cubic': cv2.INTER_CUBIC,
+    'lanczos': cv2.INTER_LANCZOS4,
+    # footprint-aware trilinear sampling of a mip pyramid, for downscaling
+    'mipmap': libprojector.INTER_MIPMAP,
+    # native separable kernels with weight tables cached with the maps
+    'bicubic': libprojector.INTER_BICUBIC,
+    'lanczos3': libprojector.INTER_LANCZOS3,
+}
+
+# storage of the images along the conversion, the samplers interpolating in
+# float whatever the storage; float16 halves the memory of HDR images
+DEPTHS = {
+    '8': libprojector.ImageDepth.uint8,
+    '16': libprojector.ImageDepth.uint16,
+    'half': libprojector.ImageDepth.float16,
+    'float': libprojector.ImageDepth.float32,
+}
+
+
+# memory of the source tiles kept by default while converting a tiled source
+TILED_MEMORY_BUDGET = 256 << 20
+
+
+def projection_key(proj):
+    """Key of a projection for the native objects kept, equal for the projections built alike"""
+    return proj.__class__, proj.image_width, dict(proj.options)
+
+
 class ConvertProjectionProcessor(object):
 
-    def __init__(self, input_image_path):
-        self.image = cv2.imread(input_image_path)
-        image_size = (self.image.shape[1], self.image.shape[0])
-        self._setup(image_size)
+    def __init__(self, input_image_path=None, image=None, depth=libprojector.ImageDepth.uint8,
+                 memory_budget=TILED_MEMORY_BUDGET):
+        """
+         The input is either an already decoded `image`, or decoded lazily
+         from `input_image_path`, which is a list of the 6 faces for a cubemap.
+         Decoding lazily lets the decode happen at a reduced scale when the
+         output is smaller than the input (8 bits only).
+
+         The decoded input is stored at `depth`, one of the DEPTHS values.
+
+         A tiled source path (see write_tiled_source) is never decoded whole:
+         each conversion reads the source tiles it samples only, keeping at
+         most `memory_budget` bytes of them. It keeps the depth it was
+         written with.
+        """
+        self.input_image_path = input_image_path
+        self.image = image
+        self.depth = depth
+        self.memory_budget = memory_budget
+        self._tiled_source = None
+        self._setup(None if image is None else (image.shape[1], image.shape[0]))
 
     def _setup(self, image_size):
-        pass
-
-    def run(self, input_proj, output_proj):
-        """Generate the preview"""
-        resized_image = self.image
-
-        # build the remaping maps
-        P = libprojector.ProjectionConvertor(
-            input_proj.get_projection(),
-            output_proj.get_projection()
-        )
-        P.convert()
-        map_x = P.get_map_x()
-        map_y = P.get_map_y()
-
-        out = cv2.remap(resized_image, map_x, map_y, cv2.INTER_LINEAR, None, cv2.BORDER_WRAP)
-        return out
+        self._convertor = None
+        self._convertor_projs = None
+        self._progressive = None
+        self._progressive_projs = None
+        self._multi_target = None
+        self._multi_target_projs = None
+        self._decoded = {}
+
+    def _decode(self, scale):
+        """Input decoded at `scale`, the decodes of every scale being kept for the next conversions (e.g. stages)"""
+        if scale not in self._decoded:
+            flags = libprojector.decode_flags(self.depth, scale)
+            if isinstance(self.input_image_path, (list, tuple)):
+                image = libprojector.read_cubemap(list(self.input_image_path), flags)
+            else:
+                image = cv2.imread(self.input_image_path, flags)
+                if image is None:
+                    raise IOError("unable to read '{}'".format(self.input_image_path))
+            # one decode per reduced scale at most (1, 2, 4 or 8), a third
+            # of the full decode for the reduced ones together
+            self._decoded[scale] = libprojector.to_image_depth(image, self.depth)
+        return self._decoded[scale]
+
+    def _get_input(self, input_proj, output_proj):
+        """Input image, decoded at the smallest scale still dense enough for the output, and its projection"""
+        if self.image is not None:
+            return self.image, input_proj
+
+        scale = 1
+        if self.depth == libprojector.ImageDepth.uint8:
+            scale = libprojector.reduced_decode_scale(input_proj.get_projection(), output_proj.get_projection(), 8)
+        image = self._decode(scale)
+        if image.shape[1] != input_proj.image_width:
+            input_proj = input_proj.scaled(image.shape[1])
+        return image, input_proj
+
+    def _get_convertor(self, input_proj, output_proj):
+        # keep the convertor (and its maps) around, so that a change of
+        # rotation only can reuse the maps already computed
+        projs = (projection_key(input_proj), projection_key(output_proj))
+        if self._convertor is None or self._convertor_projs != projs:
+            self._convertor = libprojector.ProjectionConvertor(
+                input_proj.get_projection(),
+                output_proj.get_projection()
+            )
+            self._convertor_projs = projs
+        return self._convertor
+
+    def run(self, input_proj, output_proj, rotation=None, interpolation=cv2.INTER_LINEAR):
+        """Generate the preview
+
+        `rotation` is an optional (yaw, pitch, roll) tuple in degrees, and
+        `interpolation` one of the INTERPOLATIONS values
+        """
+        if self.image is None and is_tiled_source(self.input_image_path):
+            return self._run_tiled(input_proj, output_proj, rotation, interpolation)
+
+        resized_image, input_proj = self._get_input(input_proj, output_proj)
+
+        # the native side either builds (or updates) the remaping maps, or
+        # uses a remap-free path when the conversion allows it
+        P = self._get_convertor(input_proj, output_proj)
+        P.set_rotation(*(rotation or (0, 0, 0)))
+        if input_proj.stereo == output_proj.stereo == libprojector.StereoLayout.mono:
+            return P.convert_image(resized_image, interpolation)
+        # both eyes go through the maps of one
+        return P.convert_stereo(resized_image, input_proj.stereo, output_proj.stereo, interpolation)
+
+    def _run_tiled(self, input_proj, output_proj, rotation, interpolation):
+        if input_proj.stereo != libprojector.StereoLayout.mono or output_proj.stereo != libprojector.StereoLayout.mono:
+            raise ValueError("the tiled sources are mono only")
+        if self._tiled_source is None:
+            self._tiled_source = libprojector.TiledSource(self.input_image_path, self.memory_budget)
+        P = self._get_convertor(input_proj, output_proj)
+        P.set_rotation(*(rotation or (0, 0, 0)))
+        return P.convert_tiled(self._tiled_source, interpolation)
+
+    def run_targets(self, input_proj, targets, rotation=None):
+        """Generate several outputs from one decode of the input
+
+        `targets` is a list of (output projection, interpolation) pairs, and
+        the outputs are returned in the same order. The input is decoded once,
+        at the reduced scale still dense enough for every target (8 bits
+        only), and the targets are converted together (see
+        libprojector.MultiTargetConvertor), keeping their maps for the next runs.
+        The input and the targets are mono only.
+        """
+        mono = libprojector.StereoLayout.mono
+        if input_proj.stereo != mono or any(output_proj.stereo != mono for (output_proj, _) in targets):
+            raise ValueError("the multi-target conversions are mono only")
+        projs = (projection_key(input_proj),
+                 [(projection_key(output_proj), interpolation) for (output_proj, interpolation) in targets])
+        if self._multi_target is None or self._multi_target_projs != projs:
+            self._multi_target = libprojector.MultiTargetConvertor(input_proj.get_projection())
+            for (output_proj, interpolation) in targets:
+                self._multi_target.add_target(output_proj.get_projection(), interpolation)
+            self._multi_target_projs = projs
+
+        P = self._multi_target
+        P.set_rotation(*(rotation or (0, 0, 0)))
+        if self.image is not None:
+            image = self.image
+        elif self.depth == libprojector.ImageDepth.uint8:
+            image = self._decode(P.decode_scale(8))
+        else:
+            image = self._decode(1)
+        return P.convert(image)
+
+    def run_pyramid(self, input_proj, output_proj, directory, rotation=None, interpolation=cv2.INTER_LINEAR,
+                    tile_size=256, tile_format='jpg', quality=-1):
+        """Write the sides of a cubemap output as Deep Zoom tile pyramids into `directory`
+
+        Only the finest level is converted, tile by tile, the coarser ones
+        being downsampled from it (see libprojector.CubemapPyramid).
+        """
+        image, input_proj = self._get_input(input_proj, output_proj)
+        pyramid = libprojector.CubemapPyramid(input_proj.get_projection(), output_proj.get_projection(), tile_size)
+        pyramid.set_rotation(*(rotation or (0, 0, 0)))
+        pyramid.set_format(tile_format)
+        pyramid.set_quality(quality)
+        pyramid.write(image, directory, interpolation)
+
+    def run_progressive(self, input_proj, output_proj, rotation=None, interpolation=cv2.INTER_LINEAR,
+                        preview_width=512):
+        """Generate the preview in stages of increasing resolution
+
+        Yields the output of each stage, from a first one at most
+        `preview_width` wide up to the full output, converted from the full
+        decode. Each preview stage decodes the input at the reduced scale it
+        needs (8 bits only), the decodes and the maps of the stages being
+        kept for the next runs.
+        The stereo images go through the maps of one eye, as with `run`.
+
+        A tiled source gives the full output only, its conversion reading the
+        tiles it needs already.
+        """
+        if self.image is None and is_tiled_source(self.input_image_path):
+            yield self._run_tiled(input_proj, output_proj, rotation, interpolation)
+            return
+
+        projs = (projection_key(input_proj), projection_key(output_proj), preview_width)
+        if self._progressive is None or self._progressive_projs != projs:
+            self._progressive = libprojector.ProgressiveConvertor(
+                input_proj.get_projection(),
+                output_proj.get_projection(),
+                preview_width
+            )
+            self._progressive_projs = projs
+
+        P = self._progressive
+        P.set_rotation(*(rotation or (0, 0, 0)))
+        for stage in range(P.stage_count()):
+            if self.image is not None:
+                image = self.image
+            elif self.depth == libprojector.ImageDepth.uint8:
+                image = self._decode(P.stage_decode_scale(stage))
+            else:
+                image = self._decode(1)
+            if input_proj.stereo == output_proj.stereo == libprojector.StereoLayout.mono:
+                yield P.convert_stage(image, stage, interpolation)
+            else:
+                yield P.convert_stereo_stage(image, stage, input_proj.stereo, output_proj.stereo, interpolation)
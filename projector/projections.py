@@ -1,36 +1,240 @@
+import os
+
 import libprojector
 
 PROJECTION_EQUIRECTANGULAR = 'equirectangular'
 PROJECTION_CUBEMAP = 'cubemap'
+PROJECTION_EAC = 'eac'
+PROJECTION_BANDED = 'banded'
+PROJECTION_OCTAHEDRAL = 'octahedral'
+PROJECTION_FISHEYE = 'fisheye'
+PROJECTION_DUAL_FISHEYE = 'dual-fisheye'
+
+# placements of the eyes of the stereo images, and the number of eyes per row
+STEREO_LAYOUTS = {
+    'mono': (libprojector.StereoLayout.mono, 1),
+    'tb': (libprojector.StereoLayout.top_bottom, 1),
+    'sbs': (libprojector.StereoLayout.side_by_side, 2),
+}
+
+# lens models of the fisheye projections
+LENS_MODELS = {
+    'equidistant': libprojector.FisheyeModel.equidistant,
+    'equisolid': libprojector.FisheyeModel.equisolid,
+}
+
+# suffixes of the cubemap sides written apart, in the order of the strip
+CUBEMAP_SIDES = ('+x', '-x', '+y', '-y', '+z', '-z')
+
+# layouts of the cubemap sides, and the number of sides per row of each
+CUBEMAP_LAYOUTS = {
+    'strip': (libprojector.CubemapLayout.strip, 6),
+    '3x2': (libprojector.CubemapLayout.grid_3x2, 3),
+    'hcross': (libprojector.CubemapLayout.horizontal_cross, 4),
+    'vcross': (libprojector.CubemapLayout.vertical_cross, 3),
+}
 
 
 class BaseProj(object):
-    
+    """
+     Projection of an image `image_width` wide. The `stereo` option (one of
+     STEREO_LAYOUTS, mono by default) holds the placement of the eyes, the
+     native projection being the one of an eye.
+    """
+
     def __init__(self, image_width, options):
         self.image_width = image_width
         self.options = options
 
+    @property
+    def stereo(self):
+        return STEREO_LAYOUTS[self.options.get('stereo', 'mono')][0]
+
+    @property
+    def eye_width(self):
+        return self.image_width / STEREO_LAYOUTS[self.options.get('stereo', 'mono')][1]
+
     def get_projection(self):
         raise NotImplementedError
 
+    def scaled(self, image_width):
+        """Same projection for the image resized to `image_width`"""
+        factor = float(image_width) / self.image_width
+        options = dict(self.options)
+        if 'border_padding' in options:
+            options['border_padding'] = int(round(options['border_padding'] * factor))
+        return self.__class__(image_width, options)
+
+    @classmethod
+    def get_spec(cls, options):
+        """Native description of the projection, sized later on from each image"""
+        raise NotImplementedError
+
+    @classmethod
+    def output_paths(cls, output, options):
+        """Files an output of the projection is written to (see image_io.write_output)"""
+        return [output]
+
 
 class EquirectangularProj(BaseProj):
     
     def get_projection(self):
-        width = int(self.image_width)
-        height = int(self.image_width / 2)
+        width = int(self.eye_width)
+        height = int(self.eye_width / 2)
         return libprojector.SphericalProjection(width, height)
 
+    @classmethod
+    def get_spec(cls, options):
+        stereo, _ = STEREO_LAYOUTS[options.get('stereo', 'mono')]
+        return libprojector.ProjectionSpec(libprojector.ProjectionType.spherical, 0, libprojector.CubemapLayout.strip,
+                                           stereo)
+
+
+class BandedEquirectangularProj(BaseProj):
+    """Equirectangular projection with narrower rows towards the poles, `image_width` being the width of the equator"""
+
+    def get_projection(self):
+        return libprojector.BandedSphericalProjection(int(self.eye_width))
+
+    @classmethod
+    def get_spec(cls, options):
+        stereo, _ = STEREO_LAYOUTS[options.get('stereo', 'mono')]
+        return libprojector.ProjectionSpec(libprojector.ProjectionType.banded_spherical, 0,
+                                           libprojector.CubemapLayout.strip, stereo)
+
+
+class OctahedralProj(BaseProj):
+    """Square octahedral map, options: `border_padding` (gutters around the map)"""
+
+    def get_projection(self):
+        return libprojector.OctahedralProjection(int(self.eye_width), self.options.get('border_padding', 0))
+
+    @classmethod
+    def get_spec(cls, options):
+        stereo, _ = STEREO_LAYOUTS[options.get('stereo', 'mono')]
+        return libprojector.ProjectionSpec(libprojector.ProjectionType.octahedral, options.get('border_padding', 0),
+                                           libprojector.CubemapLayout.strip, stereo)
+
+
+class FisheyeProj(BaseProj):
+    """
+     Square image of a fisheye lens looking forward, its image circle fitting
+     the image. Options: `lens_model` (one of LENS_MODELS, equidistant by
+     default) and `fov` (field of view in degrees, 180 by default).
+
+     Other calibrations (center, radius, rotation) go through
+     libprojector.FisheyeProjection directly.
+    """
+
+    native_type = libprojector.ProjectionType.fisheye
+    default_fov = 180.0
+    default_feather = 0.0
+
+    @classmethod
+    def get_lens(cls, options):
+        """(model, fov, feather) of the lenses, the angles being in degrees"""
+        return (LENS_MODELS[options.get('lens_model', 'equidistant')],
+                float(options.get('fov', cls.default_fov)),
+                float(options.get('feather', cls.default_feather)))
+
+    def get_projection(self):
+        model, fov, feather = self.get_lens(self.options)
+        width = int(self.eye_width)
+        center = (width - 1) / 2.0
+        return libprojector.FisheyeProjection(width, width, model, fov, center, center, width / 2.0, feather)
+
+    @classmethod
+    def get_spec(cls, options):
+        stereo, _ = STEREO_LAYOUTS[options.get('stereo', 'mono')]
+        spec = libprojector.ProjectionSpec(cls.native_type, 0, libprojector.CubemapLayout.strip, stereo)
+        spec.set_lens(*cls.get_lens(options))
+        return spec
+
+
+class DualFisheyeProj(FisheyeProj):
+    """
+     2:1 frame of a camera with two fisheye lenses, the front one on the
+     left. Same options as FisheyeProj, plus `feather` (in degrees, 5 by
+     default): the width of the blending where both lenses see the rays.
+    """
+
+    native_type = libprojector.ProjectionType.dual_fisheye
+    default_fov = 190.0
+    default_feather = 5.0
+
+    def get_projection(self):
+        model, fov, feather = self.get_lens(self.options)
+        width = int(self.eye_width)
+        return libprojector.DualFisheyeProjection(width, width // 2, model, fov, feather)
+
 
 class CubemapProj(BaseProj):
-    
+    """
+     Options: `border_padding`, `gutters` (the padding of an output rendered
+     from the neighbouring sides, False by default) and `layout` (one of
+     CUBEMAP_LAYOUTS, strip by default)
+    """
+
+    native_class = libprojector.CubemapProjection
+    native_type = libprojector.ProjectionType.cubemap
+
     def get_projection(self):
-        side_width = int(self.image_width / 6)
+        layout, columns = CUBEMAP_LAYOUTS[self.options.get('layout', 'strip')]
+        side_width = int(self.eye_width / columns)
         border_padding = self.options.get('border_padding', 0)
-        return libprojector.CubemapProjection(side_width, border_padding)
+        return self.native_class(side_width, border_padding, layout, self.options.get('gutters', False))
+
+    @classmethod
+    def get_spec(cls, options):
+        layout, _ = CUBEMAP_LAYOUTS[options.get('layout', 'strip')]
+        stereo, _ = STEREO_LAYOUTS[options.get('stereo', 'mono')]
+        border_padding = options.get('border_padding', 0)
+        spec = libprojector.ProjectionSpec(cls.native_type, border_padding, layout, stereo)
+        spec.gutters = options.get('gutters', False)
+        return spec
+
+    @classmethod
+    def output_paths(cls, output, options):
+        """The sides of a mono strip, suffixed with their name (`output+x.jpg`...), or the whole layout"""
+        if options.get('layout', 'strip') != 'strip' or options.get('stereo', 'mono') != 'mono':
+            return [output]
+        name, ext = os.path.splitext(output)
+        return [name + side + ext for side in CUBEMAP_SIDES]
+
+
+class EquiAngularCubemapProj(CubemapProj):
+    """Cubemap with the same angle per pixel along the sides, same options"""
+
+    native_class = libprojector.EquiAngularCubemapProjection
+    native_type = libprojector.ProjectionType.equi_angular_cubemap
 
 
 PROJECTION_CLASSES = dict((
     (PROJECTION_EQUIRECTANGULAR, EquirectangularProj),
     (PROJECTION_CUBEMAP, CubemapProj),
+    (PROJECTION_EAC, EquiAngularCubemapProj),
+    (PROJECTION_BANDED, BandedEquirectangularProj),
+    (PROJECTION_OCTAHEDRAL, OctahedralProj),
+    (PROJECTION_FISHEYE, FisheyeProj),
+    (PROJECTION_DUAL_FISHEYE, DualFisheyeProj),
 ))
+
+# projections of camera lenses, sharing the lens options
+FISHEYE_PROJECTIONS = (PROJECTION_FISHEYE, PROJECTION_DUAL_FISHEYE)
+
+# projections of the whole sphere in a single image
+SPHERICAL_PROJECTIONS = (PROJECTION_EQUIRECTANGULAR, PROJECTION_BANDED, PROJECTION_OCTAHEDRAL)
+
+# projections made of cubemap sides, sharing the cubemap options
+CUBEMAP_PROJECTIONS = (PROJECTION_CUBEMAP, PROJECTION_EAC)
+
+
+def proj_options(border_padding, gutters, layout, stereo, lens):
+    """
+     Options of the input and of the output projections of single images
+     (whole layouts for the cubemaps): the padding of the input is skipped,
+     the `gutters` of the output are rendered
+    """
+    in_options = dict(lens, border_padding=border_padding, layout=layout, stereo=stereo)
+    out_options = dict(lens, border_padding=gutters, gutters=True, layout=layout, stereo=stereo)
+    return in_options, out_options
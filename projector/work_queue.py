@@ -0,0 +1,225 @@
+import errno
+import hashlib
+import json
+import os
+import random
+import socket
+import threading
+import time
+
+QUEUE_CONFIG = 'config.json'
+
+
+class WorkQueue(object):
+    """
+     Queue of conversion jobs shared by several workers through a directory,
+     e.g. on a shared filesystem, without any queue service.
+
+      queue/
+        config.json               conversion settings shared by the workers
+        pending/<job>.json        jobs waiting for a worker
+        claimed/<worker>/<job>.json
+                                  jobs being converted by a worker
+        workers/<worker>          heartbeat of each worker (its mtime)
+        done/<job>.json           converted jobs (checkpoints)
+        failed/<job>.json         failed jobs, with the error
+
+     Jobs move between the states with atomic renames, so a job is only ever
+     claimed by one worker. When a worker stops sending heartbeats for longer
+     than the lease, its claimed jobs are put back in pending by the others.
+    """
+
+    def __init__(self, path):
+        self.path = path
+
+    def _dir(self, *parts):
+        return os.path.join(self.path, *parts)
+
+    def _ensure_dirs(self, *dirs):
+        for d in dirs:
+            try:
+                os.makedirs(d)
+            except OSError as e:
+                if e.errno != errno.EEXIST:
+                    raise
+
+    def _write_atomic(self, path, data):
+        tmp_path = "{}.{}.{}.tmp".format(path, socket.gethostname(), os.getpid())
+        with open(tmp_path, 'w') as f:
+            json.dump(data, f)
+        os.rename(tmp_path, path)
+
+    @staticmethod
+    def job_id(input_path, output_path):
+        return hashlib.sha1("{}\n{}".format(input_path, output_path).encode('utf-8')).hexdigest()
+
+    def enqueue(self, jobs, config):
+        """Add (input, output) jobs, skipping the ones already queued or done. Returns the number added."""
+        self._ensure_dirs(self._dir('pending'), self._dir('claimed'), self._dir('workers'),
+                          self._dir('done'), self._dir('failed'))
+        self._write_atomic(self._dir(QUEUE_CONFIG), config)
+
+        known = set()
+        for state in ('pending', 'done'):
+            known.update(os.listdir(self._dir(state)))
+        for worker in os.listdir(self._dir('claimed')):
+            known.update(os.listdir(self._dir('claimed', worker)))
+
+        added = 0
+        for input_path, output_path in jobs:
+            name = self.job_id(input_path, output_path) + '.json'
+            if name in known:
+                continue
+            self._write_atomic(self._dir('pending', name), {'input': input_path, 'output': output_path})
+            known.add(name)
+            added += 1
+        return added
+
+    def config(self):
+        with open(self._dir(QUEUE_CONFIG)) as f:
+            return json.load(f)
+
+    def status(self):
+        counts = {}
+        for state in ('pending', 'done', 'failed'):
+            counts[state] = len(os.listdir(self._dir(state)))
+        counts['claimed'] = sum(len(os.listdir(self._dir('claimed', w))) for w in os.listdir(self._dir('claimed')))
+        return counts
+
+    def heartbeat(self, worker_id):
+        path = self._dir('workers', worker_id)
+        with open(path, 'a'):
+            os.utime(path, None)
+
+    def recover(self, lease):
+        """Put back in pending the jobs of the workers without heartbeat for `lease` seconds"""
+        recovered = 0
+        now = time.time()
+        for worker in os.listdir(self._dir('claimed')):
+            heartbeat = self._dir('workers', worker)
+            try:
+                alive = now - os.path.getmtime(heartbeat) < lease
+            except OSError:
+                alive = False
+            if alive:
+                continue
+            claimed_dir = self._dir('claimed', worker)
+            for name in os.listdir(claimed_dir):
+                try:
+                    os.rename(os.path.join(claimed_dir, name), self._dir('pending', name))
+                    recovered += 1
+                except OSError:
+                    # recovered by another worker in the meantime
+                    pass
+        return recovered
+
+    def claim(self, worker_id, count):
+        """Claim up to `count` pending jobs, returns a list of (job name, input, output)"""
+        claimed_dir = self._dir('claimed', worker_id)
+        self._ensure_dirs(claimed_dir)
+
+        names = os.listdir(self._dir('pending'))
+        # start at a random place to limit the contention between workers
+        random.shuffle(names)
+
+        claimed = []
+        for name in names:
+            if len(claimed) >= count:
+                break
+            if not name.endswith('.json'):
+                continue
+            target = os.path.join(claimed_dir, name)
+            try:
+                os.rename(self._dir('pending', name), target)
+            except OSError:
+                # claimed by another worker
+                continue
+            with open(target) as f:
+                job = json.load(f)
+            claimed.append((name, job['input'], job['output']))
+        return claimed
+
+    def complete(self, worker_id, name):
+        """
+         Record a job as done. Returns False when the job was lost: it went
+         back to pending (another worker having taken this one for dead) and
+         is converted again elsewhere.
+        """
+        try:
+            os.rename(self._dir('claimed', worker_id, name), self._dir('done', name))
+        except OSError:
+            return False
+        return True
+
+    def fail(self, worker_id, name, error):
+        """Record a job as failed with its error, returns False when the job was lost (see complete)"""
+        failed_path = self._dir('failed', name)
+        try:
+            os.rename(self._dir('claimed', worker_id, name), failed_path)
+        except OSError:
+            return False
+        with open(failed_path) as f:
+            job = json.load(f)
+        job['error'] = error
+        self._write_atomic(failed_path, job)
+        return True
+
+
+class Heartbeat(object):
+    """Touch the worker heartbeat from a background thread while converting"""
+
+    def __init__(self, queue, worker_id, interval):
+        self.queue = queue
+        self.worker_id = worker_id
+        self.interval = interval
+        self._stop = threading.Event()
+        self._thread = threading.Thread(target=self._run)
+        self._thread.daemon = True
+
+    def _run(self):
+        while not self._stop.wait(self.interval):
+            self.queue.heartbeat(self.worker_id)
+
+    def __enter__(self):
+        self.queue.heartbeat(self.worker_id)
+        self._thread.start()
+        return self
+
+    def __exit__(self, *args):
+        self._stop.set()
+        self._thread.join()
+
+
+def default_worker_id():
+    return "{}-{}".format(socket.gethostname(), os.getpid())
+
+
+def run_worker(queue, processor, worker_id, lease=300, chunk=16, rotation=None, callback=None):
+    """
+     Claim and convert jobs until the queue is empty.
+
+     `processor` is a BatchProcessor, kept across the chunks so the maps are
+     only built once per geometry. Returns the (converted, failed) counts.
+    """
+    converted = [0, 0]
+    with Heartbeat(queue, worker_id, max(1.0, lease / 3.0)):
+        while True:
+            queue.recover(lease)
+            claimed = queue.claim(worker_id, chunk)
+            if not claimed:
+                break
+
+            names = dict(((input_path, output_path), name) for (name, input_path, output_path) in claimed)
+
+            def report(input_path, output_path, success, error):
+                name = names[(input_path, output_path)]
+                if success:
+                    if queue.complete(worker_id, name):
+                        converted[0] += 1
+                elif queue.fail(worker_id, name, error):
+                    converted[1] += 1
+                if callback is not None:
+                    callback(input_path, output_path, success, error)
+
+            processor.run([(i, o) for (_, i, o) in claimed], rotation=rotation, callback=report)
+    return tuple(converted)
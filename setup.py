@@ -7,7 +7,6 @@ from setuptools import setup
 requirements = [
     'click==6.7',
     'numpy==1.16.2',
-    'Pillow==5.4.1',
 ]
 
 test_requirements = [
@@ -28,7 +27,9 @@ setup(
                  'projector'},
     entry_points={
         'console_scripts': [
-            'projector=projector.cli:main'
+            'projector=projector.client:run',
+            'projector-tiles=projector.cli:make_tiles',
+            'projector-client=projector.client:main'
         ]
     },
     include_package_data=True,
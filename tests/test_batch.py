@@ -0,0 +1,105 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+"""
+test_batch
+----------------------------------
+
+Tests of the batch mode, whose jobs chain their tasks (decode, convert,
+encode) on the native thread pool.
+"""
+
+import os
+
+import cv2
+import numpy as np
+
+from click.testing import CliRunner
+
+from projector import cli
+from projector.batch import BatchProcessor, list_jobs
+from projector.projections import EquirectangularProj
+
+
+def make_images(directory, count, width=64):
+    paths = []
+    for i in range(count):
+        path = os.path.join(str(directory), 'in{:03d}.png'.format(i))
+        image = np.full((width // 2, width, 3), i % 256, np.uint8)
+        assert cv2.imwrite(path, image)
+        paths.append(path)
+    return paths
+
+
+def test_list_jobs_of_a_directory(tmpdir):
+    make_images(tmpdir, 3)
+    jobs = list_jobs(str(tmpdir), '/out')
+    assert [os.path.basename(output) for _, output in jobs] == ['in000.png', 'in001.png', 'in002.png']
+    assert all(output.startswith('/out') for _, output in jobs)
+
+
+def test_batch_runs_every_job_before_returning(tmpdir):
+    """Many small jobs on few threads: every task submits the next one from a worker"""
+    inputs = make_images(tmpdir.mkdir('in'), 64)
+    output_dir = str(tmpdir.mkdir('out'))
+    processor = BatchProcessor(EquirectangularProj, {}, EquirectangularProj, {}, 32, threads=3)
+
+    for round_index in range(10):
+        jobs = [(path, os.path.join(output_dir, '{}-{}'.format(round_index, os.path.basename(path))))
+                for path in inputs]
+        results = []
+        processor.run(jobs, callback=lambda i, o, success, error: results.append((o, success, error)))
+
+        assert len(results) == len(jobs)
+        assert all(success for _, success, _ in results), results
+        assert sorted(o for o, _, _ in results) == sorted(o for _, o in jobs)
+        for _, output_path in jobs:
+            assert os.path.isfile(output_path)
+
+
+def test_batch_reports_the_failures(tmpdir):
+    inputs = make_images(tmpdir, 2)
+    jobs = [(inputs[0], str(tmpdir.join('a.png'))), (str(tmpdir.join('missing.png')), str(tmpdir.join('b.png')))]
+    results = {}
+    processor = BatchProcessor(EquirectangularProj, {}, EquirectangularProj, {}, 32, threads=2)
+    processor.run(jobs, callback=lambda i, o, success, error: results.update({i: (success, error)}))
+
+    assert results[inputs[0]] == (True, '')
+    assert results[jobs[1][0]][0] is False
+
+
+def test_batch_map_cache_stays_within_its_capacity(tmpdir):
+    # inputs of several widths, each one building its own maps
+    jobs = []
+    for width in (64, 96, 128, 160):
+        path = make_images(tmpdir.mkdir(str(width)), 1, width)[0]
+        jobs.append((path, str(tmpdir.join('out{}.png'.format(width)))))
+    processor = BatchProcessor(EquirectangularProj, {}, EquirectangularProj, {}, 48, threads=2)
+    # the maps of one 48x24 output, x and y in float
+    one_map = 48 * 24 * 2 * 4
+    processor.batch.set_map_cache_capacity(2 * one_map)
+
+    processor.run(jobs, rotation=(0, 30, 0))
+    assert 0 < processor.batch.map_cache_bytes() <= 2 * one_map
+
+
+def test_batch_writes_the_outputs_of_the_single_conversions(tmpdir):
+    # a panorama with content, so that the sides differ
+    image = cv2.resize(np.random.RandomState(0).randint(0, 256, (8, 16, 3)).astype(np.uint8), (128, 64))
+    input_path = str(tmpdir.mkdir('in').join('pano.png'))
+    assert cv2.imwrite(input_path, image)
+    options = ['--in-projection=equirectangular', '--out-projection=cubemap', '--output-width=384']
+
+    runner = CliRunner()
+    single = runner.invoke(cli.main, options + ['--output', str(tmpdir.join('single.png')), input_path])
+    assert single.exit_code == 0, single.output
+    batch = runner.invoke(cli.main, ['batch'] + options + ['--output-dir', str(tmpdir), str(tmpdir.join('in'))])
+    assert batch.exit_code == 0, batch.output
+
+    # the 6 sides of the strip apart in both modes (denser than the input, decoded at full scale)
+    for side in ('+x', '-x', '+y', '-y', '+z', '-z'):
+        expected = cv2.imread(str(tmpdir.join('single{}.png'.format(side))))
+        assert expected.shape == (64, 64, 3)
+        face = cv2.imread(str(tmpdir.join('pano{}.png'.format(side))))
+        assert np.abs(face.astype(int) - expected).max() <= 2
+    assert not tmpdir.join('pano.png').exists()
@@ -0,0 +1,341 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+"""
+test_convertor
+----------------------------------
+
+Tests of the conversions of the native convertor against the remap of its
+own maps.
+"""
+
+import cv2
+import numpy as np
+import pytest
+
+import libprojector
+
+
+def smooth_image(height, width, seed=0):
+    """Low frequency content, so that sub-texel differences stay small"""
+    noise = np.random.RandomState(seed).randint(0, 256, (height // 8 + 1, width // 8 + 1, 3)).astype(np.uint8)
+    return cv2.resize(noise, (width, height), interpolation=cv2.INTER_CUBIC)
+
+
+def remapped(convertor, image, interpolation):
+    """Output of the remap path: the maps of the convertor, wrapping as it does"""
+    convertor.convert()
+    return cv2.remap(image, convertor.get_map_x(), convertor.get_map_y(), interpolation,
+                     borderMode=cv2.BORDER_WRAP)
+
+
+def side_edges(shape, side):
+    """First row and column of the sides, on the edges of the cube where either side may be sampled"""
+    ys, xs = np.mgrid[0:shape[0], 0:shape[1]]
+    return (xs % side == 0) | (ys % side == 0)
+
+
+@pytest.mark.parametrize('out_size,yaw,interpolation', [
+    ((256, 128), 90, cv2.INTER_LINEAR),
+    ((256, 128), -45, cv2.INTER_CUBIC),
+    ((512, 256), 90, cv2.INTER_LINEAR),
+    ((128, 64), 180, cv2.INTER_LINEAR),
+    ((384, 192), 0, cv2.INTER_NEAREST),
+])
+def test_spherical_fast_path_matches_the_remap(out_size, yaw, interpolation):
+    image = smooth_image(128, 256)
+    convertor = libprojector.ProjectionConvertor(libprojector.SphericalProjection(256, 128),
+                                                 libprojector.SphericalProjection(*out_size))
+    convertor.set_rotation(yaw, 0, 0)
+
+    fast = convertor.convert_image(image, interpolation)
+    expected = remapped(convertor, image, interpolation)
+    assert fast.shape == expected.shape
+    # the longitude of the rows at the poles is undefined in the maps
+    diff = np.abs(fast.astype(int) - expected)[1:-1]
+    assert diff.max() <= 2
+
+
+@pytest.mark.parametrize('in_side,out_side,rotation,interpolation', [
+    (64, 64, (90, 0, 0), cv2.INTER_LINEAR),
+    (64, 64, (0, 90, 0), cv2.INTER_LINEAR),
+    (64, 64, (180, 0, 90), cv2.INTER_CUBIC),
+    (64, 32, (0, 0, 180), cv2.INTER_LINEAR),
+    (32, 64, (270, 90, 0), cv2.INTER_LINEAR),
+])
+def test_cubemap_fast_path_matches_the_remap(in_side, out_side, rotation, interpolation):
+    image = smooth_image(in_side, 6 * in_side)
+    convertor = libprojector.ProjectionConvertor(libprojector.CubemapProjection(in_side, 0),
+                                                 libprojector.CubemapProjection(out_side, 0))
+    convertor.set_rotation(*rotation)
+
+    fast = convertor.convert_image(image, interpolation)
+    expected = remapped(convertor, image, interpolation)
+    assert fast.shape == expected.shape
+    inner = ~side_edges(fast.shape, out_side)
+    diff = np.abs(fast.astype(int) - expected)[inner]
+    assert diff.max() <= 2
+
+
+def test_mipmap_sides_share_the_pyramid_of_the_source():
+    image = smooth_image(256, 512)
+    convertor = libprojector.ProjectionConvertor(libprojector.SphericalProjection(512, 256),
+                                                 libprojector.CubemapProjection(64, 0))
+    whole = convertor.convert_image(image, libprojector.INTER_MIPMAP)
+    sides = convertor.convert_sides(image, [0, 3, 5], libprojector.INTER_MIPMAP)
+    for side, side_image in zip([0, 3, 5], sides):
+        assert np.array_equal(side_image, whole[:, side * 64:(side + 1) * 64])
+
+
+def test_mipmap_targets_sample_the_levels_of_the_source():
+    image = smooth_image(256, 512)
+    sphere = libprojector.SphericalProjection(512, 256)
+    cube = libprojector.CubemapProjection(64, 0)
+    multi = libprojector.MultiTargetConvertor(sphere, 2)
+    multi.add_target(cube, libprojector.INTER_MIPMAP)
+    # a target 4 times less dense, sampling a halving of the source
+    multi.add_target(libprojector.CubemapProjection(16, 0), libprojector.INTER_MIPMAP)
+    outputs = multi.convert(image)
+
+    single = libprojector.ProjectionConvertor(sphere, cube)
+    assert np.array_equal(outputs[0], single.convert_image(image, libprojector.INTER_MIPMAP))
+    assert outputs[1].shape == (16, 96, 3)
+
+
+@pytest.mark.parametrize('dtype,channels', [
+    (np.uint8, 1),
+    (np.uint8, 3),
+    (np.uint8, 4),
+    (np.uint16, 3),
+    (np.float32, 3),
+])
+def test_bicubic_kernel_matches_opencv(dtype, channels):
+    """The native bicubic kernel has the weights of the cubic interpolation of OpenCV"""
+    image = smooth_image(128, 256)
+    if channels == 1:
+        image = image[:, :, 0].copy()
+    elif channels == 4:
+        image = np.dstack((image, image[:, :, 0]))
+    image = image.astype(dtype)
+
+    convertor = libprojector.ProjectionConvertor(libprojector.SphericalProjection(256, 128),
+                                                 libprojector.CubemapProjection(48, 0))
+    # a rotation with no fast path, the samples falling between the texels
+    convertor.set_rotation(10.3, 20.1, 0)
+    native = convertor.convert_image(image, libprojector.INTER_BICUBIC)
+    expected = remapped(convertor, image, cv2.INTER_CUBIC)
+    assert native.dtype == image.dtype and native.shape == expected.shape
+    diff = np.abs(native.astype(np.float64) - expected)
+    assert diff.max() <= 2
+
+
+@pytest.mark.parametrize('interpolation', [
+    cv2.INTER_LINEAR,
+    libprojector.INTER_BICUBIC,
+    libprojector.INTER_MIPMAP,
+])
+def test_half_floats_are_sampled_as_floats(interpolation):
+    image = smooth_image(128, 256).astype(np.float32) / 255
+    convertor = libprojector.ProjectionConvertor(libprojector.SphericalProjection(256, 128),
+                                                 libprojector.CubemapProjection(48, 0))
+    convertor.set_rotation(10.3, 20.1, 0)
+    expected = convertor.convert_image(image, interpolation)
+    half = convertor.convert_image(image.astype(np.float16), interpolation)
+    assert half.dtype == np.float16
+    assert np.abs(half.astype(np.float32) - expected).max() < 1e-2
+
+
+def test_progressive_stages_refine_up_to_the_conversion():
+    image = smooth_image(512, 1024)
+    sphere = libprojector.SphericalProjection(1024, 512)
+    cube = libprojector.CubemapProjection(128, 0)
+    progressive = libprojector.ProgressiveConvertor(sphere, cube, 48, 4)
+    progressive.set_rotation(10, 20, 0)
+    assert progressive.stage_count() == 3
+
+    stages = [progressive.convert_stage(image, stage, cv2.INTER_LINEAR) for stage in range(3)]
+    convertor = libprojector.ProjectionConvertor(sphere, cube)
+    convertor.set_rotation(10, 20, 0)
+    final = convertor.convert_image(image, cv2.INTER_LINEAR)
+    assert np.array_equal(stages[-1], final)
+
+    # the maps of the middle stage are interpolated from the ones of the first
+    width, height = progressive.stage_size(1)
+    assert stages[1].shape == (height, width, 3)
+    downscaled = cv2.resize(final, (width, height), interpolation=cv2.INTER_AREA)
+    assert np.abs(stages[1].astype(int) - downscaled).mean() < 3
+
+
+def test_progressive_last_stage_samples_the_full_input():
+    # an output less dense than the input: the previews sample it downscaled
+    image = smooth_image(512, 1024)
+    sphere = libprojector.SphericalProjection(1024, 512)
+    cube = libprojector.CubemapProjection(64, 0)
+    assert libprojector.reduced_decode_scale(sphere, cube, 8) == 2
+    progressive = libprojector.ProgressiveConvertor(sphere, cube, 48, 4)
+    progressive.set_rotation(10, 20, 0)
+    assert progressive.stage_count() == 3
+    assert [progressive.stage_decode_scale(stage) for stage in range(3)] == [8, 8, 1]
+
+    stages = [progressive.convert_stage(image, stage, cv2.INTER_LINEAR) for stage in range(3)]
+    convertor = libprojector.ProjectionConvertor(sphere, cube)
+    convertor.set_rotation(10, 20, 0)
+    assert np.array_equal(stages[-1], convertor.convert_image(image, cv2.INTER_LINEAR))
+
+
+def test_progressive_stereo_stages_go_through_the_maps_of_one_eye():
+    eye = smooth_image(256, 512)
+    image = np.hstack((eye, eye[:, ::-1]))
+    sphere = libprojector.SphericalProjection(512, 256)
+    cube = libprojector.CubemapProjection(64, 0)
+    progressive = libprojector.ProgressiveConvertor(sphere, cube, 96, 4)
+    side_by_side = libprojector.StereoLayout.side_by_side
+    top_bottom = libprojector.StereoLayout.top_bottom
+
+    stages = [progressive.convert_stereo_stage(image, stage, side_by_side, top_bottom, cv2.INTER_LINEAR)
+              for stage in range(progressive.stage_count())]
+    for stage, output in enumerate(stages):
+        width, height = progressive.stage_size(stage)
+        assert output.shape == (2 * height, width, 3)
+    convertor = libprojector.ProjectionConvertor(sphere, cube)
+    assert np.array_equal(stages[-1], convertor.convert_stereo(image, side_by_side, top_bottom, cv2.INTER_LINEAR))
+
+
+def test_targets_are_sampled_tile_by_tile_as_single_conversions():
+    image = smooth_image(256, 512)
+    sphere = libprojector.SphericalProjection(512, 256)
+    targets = [(libprojector.CubemapProjection(96, 0, libprojector.CubemapLayout.horizontal_cross), cv2.INTER_LINEAR),
+               (libprojector.SphericalProjection(384, 192), libprojector.INTER_BICUBIC),
+               (libprojector.CubemapProjection(128, 0), libprojector.INTER_MIPMAP)]
+    # all the targets dense enough to sample the source itself
+    multi = libprojector.MultiTargetConvertor(sphere, 3)
+    for proj, interpolation in targets:
+        multi.add_target(proj, interpolation)
+    multi.set_rotation(15, 30, 0)
+    outputs = multi.convert(image)
+
+    for (proj, interpolation), output in zip(targets, outputs):
+        convertor = libprojector.ProjectionConvertor(sphere, proj)
+        convertor.set_rotation(15, 30, 0)
+        assert np.array_equal(output, convertor.convert_image(image, interpolation))
+
+
+def test_tiled_sources_stay_within_their_budget(tmpdir):
+    image = smooth_image(256, 512)
+    path = str(tmpdir.join('pano.ptiles'))
+    libprojector.write_tiled_source(path, image, 64)
+    # 2 tiles, while the footprints of the output tiles span more
+    budget = 2 * 64 * 64 * 3
+    source = libprojector.TiledSource(path, budget)
+    convertor = libprojector.ProjectionConvertor(libprojector.SphericalProjection(512, 256),
+                                                 libprojector.CubemapProjection(128, 0))
+    convertor.set_rotation(10, 20, 0)
+    tiled = convertor.convert_tiled(source, cv2.INTER_LINEAR)
+    assert source.resident_bytes() <= budget // 2
+    # the rows are clamped at the poles, where the remap wraps them
+    expected = remapped(convertor, image, cv2.INTER_LINEAR)
+    assert np.abs(tiled.astype(int) - expected).mean() < 0.5
+
+
+def test_pyramid_tiles_are_cut_from_the_conversion(tmpdir):
+    image = smooth_image(256, 512)
+    sphere = libprojector.SphericalProjection(512, 256)
+    cube = libprojector.CubemapProjection(64, 0)
+    pyramid = libprojector.CubemapPyramid(sphere, cube, 32, 2)
+    pyramid.set_rotation(10, 20, 0)
+    pyramid.set_format('png')
+    pyramid.write(image, str(tmpdir), cv2.INTER_LINEAR)
+
+    convertor = libprojector.ProjectionConvertor(sphere, cube)
+    convertor.set_rotation(10, 20, 0)
+    whole = convertor.convert_image(image, cv2.INTER_LINEAR)
+    level = pyramid.level_count() - 1
+    for side, name in enumerate(['+x', '-x', '+y', '-y', '+z', '-z']):
+        for column in range(2):
+            for row in range(2):
+                path = tmpdir.join('{}_files'.format(name), str(level), '{}_{}.png'.format(column, row))
+                tile = cv2.imread(str(path))
+                x, y = side * 64 + column * 32, row * 32
+                assert np.array_equal(tile, whole[y:y + 32, x:x + 32])
+
+
+def test_tiled_source_copies_count_in_the_budget(tmpdir):
+    image = smooth_image(1024, 2048)
+    path = str(tmpdir.join('pano.ptiles'))
+    libprojector.write_tiled_source(path, image, 64)
+    # far less than the footprints of the output tiles next to the poles,
+    # the full width of the source over many rows
+    budget = 64 * 64 * 64 * 3
+    source = libprojector.TiledSource(path, budget)
+    convertor = libprojector.ProjectionConvertor(libprojector.SphericalProjection(2048, 1024),
+                                                 libprojector.CubemapProjection(512, 0))
+    tiled = convertor.convert_tiled(source, cv2.INTER_LINEAR)
+    # the tiles and the copies held at once, at their largest
+    assert 0 < source.peak_bytes() <= budget
+    assert source.resident_bytes() <= budget // 2
+    expected = remapped(convertor, image, cv2.INTER_LINEAR)
+    assert np.abs(tiled.astype(int) - expected).mean() < 0.5
+
+
+def to_nv12(i420, height, width):
+    """NV12 frame of an I420 one: the U and V planes interleaved"""
+    luma = i420[:height]
+    chroma = i420[height:].reshape(2, height // 2, width // 2)
+    return np.vstack((luma, np.dstack(chroma).reshape(height // 2, width)))
+
+
+@pytest.mark.parametrize('format', [libprojector.YUVFormat.i420, libprojector.YUVFormat.nv12])
+def test_yuv_frames_are_converted_as_their_bgr_images(format):
+    image = smooth_image(128, 256)
+    i420 = cv2.cvtColor(image, cv2.COLOR_BGR2YUV_I420)
+    convertor = libprojector.ProjectionConvertor(libprojector.SphericalProjection(256, 128),
+                                                 libprojector.CubemapProjection(48, 0))
+    convertor.set_rotation(10, 20, 0)
+    if format == libprojector.YUVFormat.i420:
+        frame, to_bgr = i420, cv2.COLOR_YUV2BGR_I420
+    else:
+        frame, to_bgr = to_nv12(i420, 128, 256), cv2.COLOR_YUV2BGR_NV12
+
+    converted = convertor.convert_yuv(frame, format, cv2.INTER_LINEAR)
+    assert converted.shape == (72, 288)
+    # the luma plane at full resolution, as a gray image
+    assert np.array_equal(converted[:48], convertor.convert_image(i420[:128].copy(), cv2.INTER_LINEAR))
+    # the chroma from the half-size planes, within the rounding of the round trip
+    expected = convertor.convert_image(image, cv2.INTER_LINEAR)
+    assert np.abs(cv2.cvtColor(converted, to_bgr).astype(int) - expected).mean() < 2
+
+
+def test_yuv_frames_need_even_sizes():
+    convertor = libprojector.ProjectionConvertor(libprojector.SphericalProjection(256, 128),
+                                                 libprojector.CubemapProjection(48, 0))
+    with pytest.raises(ValueError):
+        convertor.convert_yuv(np.zeros((192, 255), np.uint8), libprojector.YUVFormat.i420, cv2.INTER_LINEAR)
+
+
+@pytest.mark.parametrize('roi,interpolation', [
+    ((0, 0, 96, 64), cv2.INTER_LINEAR),
+    ((100, 30, 57, 41), cv2.INTER_LINEAR),
+    ((200, 90, 56, 38), libprojector.INTER_BICUBIC),
+    ((0, 0, 256, 128), cv2.INTER_LINEAR),
+])
+def test_regions_are_crops_of_the_conversion(roi, interpolation):
+    image = smooth_image(128, 256)
+    convertor = libprojector.ProjectionConvertor(libprojector.SphericalProjection(256, 128),
+                                                 libprojector.SphericalProjection(256, 128))
+    # a pitch: no fast path, the maps of the regions being built
+    convertor.set_rotation(30, 25, 0)
+    x, y, width, height = roi
+    region = convertor.convert_region(image, x, y, width, height, interpolation)
+    whole = convertor.convert_image(image, interpolation)
+    assert np.array_equal(region, whole[y:y + height, x:x + width])
+    # the maps built by the whole conversion are cut
+    assert np.array_equal(convertor.region(x, y, width, height).convert_image(image, interpolation), region)
+
+
+def test_regions_stay_within_the_output():
+    convertor = libprojector.ProjectionConvertor(libprojector.SphericalProjection(256, 128),
+                                                 libprojector.CubemapProjection(48, 0))
+    image = smooth_image(128, 256)
+    for roi in ((250, 0, 48, 48), (0, 0, 0, 10), (-1, 0, 10, 10)):
+        with pytest.raises(ValueError):
+            convertor.convert_region(image, *(roi + (cv2.INTER_LINEAR,)))
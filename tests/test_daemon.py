@@ -0,0 +1,129 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+"""
+test_daemon
+----------------------------------
+
+Tests of the conversion daemon and of its client, on a Unix socket.
+"""
+
+import os
+import socket
+import subprocess
+import sys
+import time
+
+import cv2
+import numpy as np
+import pytest
+
+from projector.client import Connection, attach_shared_memory, convert_array, send_request
+from projector.daemon import ConversionDaemon
+
+CONFIG = {'in_projection': 'equirectangular', 'out_projection': 'cubemap', 'output_width': 96}
+
+
+@pytest.fixture
+def socket_path(tmpdir):
+    """Socket of a daemon of another process, as the clients and the daemon track their shared memory apart"""
+    path = str(tmpdir.join('d.sock'))
+    process = subprocess.Popen([sys.executable, '-c', 'from projector.daemon import ConversionDaemon; '
+                                'ConversionDaemon({!r}, 2).serve_forever()'.format(path)],
+                               cwd=os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+    while not os.path.exists(path):
+        assert process.poll() is None
+        time.sleep(0.01)
+    yield path
+    send_request(path, {'command': 'shutdown'})
+    assert process.wait() == 0
+
+
+def panorama():
+    return cv2.resize(np.random.RandomState(0).randint(0, 256, (8, 16, 3)).astype(np.uint8), (256, 128))
+
+
+def face_paths(tmpdir, name):
+    return [str(tmpdir.join('{}{}.png'.format(name, side))) for side in ('+x', '-x', '+y', '-y', '+z', '-z')]
+
+
+def test_image_paths_round_trip(socket_path, tmpdir):
+    input_path = str(tmpdir.join('pano.png'))
+    assert cv2.imwrite(input_path, panorama())
+    # the sides of a strip apart, as the cli writes them
+    reply = send_request(socket_path, dict(CONFIG, input=input_path, output=str(tmpdir.join('cube.png'))))
+    assert reply == {'ok': True, 'outputs': face_paths(tmpdir, 'cube')}
+    for path in reply['outputs']:
+        assert cv2.imread(path).shape == (16, 16, 3)
+
+    # the other layouts in one image
+    output_path = str(tmpdir.join('cross.png'))
+    reply = send_request(socket_path, dict(CONFIG, cubemap_layout='hcross', output_width=64, input=input_path,
+                                           output=output_path))
+    assert reply == {'ok': True, 'outputs': [output_path]}
+    assert cv2.imread(output_path).shape == (48, 64, 3)
+
+
+def test_shared_memory_inputs_write_the_sides_apart(socket_path, tmpdir):
+    assert convert_array(socket_path, panorama(), CONFIG, output=str(tmpdir.join('cube.png'))) is None
+    for path in face_paths(tmpdir, 'cube'):
+        assert cv2.imread(path).shape == (16, 16, 3)
+
+
+def test_shared_memory_round_trip(socket_path):
+    cube = convert_array(socket_path, panorama(), CONFIG)
+    assert cube.shape == (16, 96, 3)
+    # other settings, on the pool and the maps of the first ones
+    sphere = convert_array(socket_path, cube, {'in_projection': 'cubemap', 'out_projection': 'equirectangular',
+                                               'output_width': 64})
+    assert sphere.shape == (32, 64, 3)
+
+
+def test_shared_memory_outputs_are_unlinked_with_the_connection(socket_path):
+    from multiprocessing import shared_memory
+
+    image = panorama()
+    source = shared_memory.SharedMemory(create=True, size=image.nbytes)
+    try:
+        np.ndarray(image.shape, image.dtype, buffer=source.buf)[...] = image
+        with Connection(socket_path) as connection:
+            reply = connection.request(dict(CONFIG, input={'shm': source.name, 'shape': list(image.shape),
+                                                           'dtype': str(image.dtype)}, output={'shm': True}))
+            assert reply['ok']
+        # the client is gone without releasing the output
+        for _ in range(100):
+            try:
+                attach_shared_memory(reply['shm']).close()
+            except FileNotFoundError:
+                break
+            time.sleep(0.01)
+        else:
+            pytest.fail("the output of a lost connection is kept")
+    finally:
+        source.close()
+        source.unlink()
+
+
+def test_malformed_requests_get_an_error(socket_path):
+    with Connection(socket_path) as connection:
+        for message in (b'{"command": ', b'[1, 2]'):
+            connection._socket.sendall(message + b'\n')
+            reply = connection._replies.readline()
+            assert b'"ok": false' in reply and b'malformed request' in reply
+        # the connection goes on
+        assert connection.request({'command': 'ping'}) == {'ok': True}
+
+
+def test_stale_sockets_are_replaced(tmpdir):
+    socket_path = str(tmpdir.join('stale.sock'))
+    stale = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    stale.bind(socket_path)
+    stale.close()
+    ConversionDaemon(socket_path)._check_stale_socket()
+    assert not os.path.exists(socket_path)
+
+
+def test_running_daemons_are_not_replaced(socket_path):
+    with pytest.raises(RuntimeError):
+        ConversionDaemon(socket_path).serve_forever()
+    assert send_request(socket_path, {'command': 'ping'}) == {'ok': True}
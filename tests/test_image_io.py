@@ -0,0 +1,141 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+"""
+test_image_io
+----------------------------------
+
+Tests of the native image I/O layer against the decodes and encodes of
+OpenCV itself, and of the decoding of the inputs at a reduced scale.
+"""
+
+import os
+
+import cv2
+import numpy as np
+import pytest
+
+import libprojector
+
+from projector.image_io import image_size, probe_image_size, read_cubemap, read_images, write_images
+from projector.processors import ConvertProjectionProcessor
+from projector.projections import CubemapProj, EquirectangularProj
+
+
+def noise_image(height, width, seed=0):
+    return np.random.RandomState(seed).randint(0, 256, (height, width, 3)).astype(np.uint8)
+
+
+def test_read_images_decodes_as_opencv(tmpdir):
+    paths = []
+    for i, ext in enumerate(('png', 'jpg', 'bmp')):
+        path = str(tmpdir.join('in{}.{}'.format(i, ext)))
+        assert cv2.imwrite(path, noise_image(24 + i, 40, i))
+        paths.append(path)
+    images = read_images(paths)
+    assert len(images) == len(paths)
+    for path, image in zip(paths, images):
+        assert np.array_equal(image, cv2.imread(path))
+
+
+def test_read_images_fail_on_a_missing_image(tmpdir):
+    path = str(tmpdir.join('in.png'))
+    assert cv2.imwrite(path, noise_image(8, 8))
+    with pytest.raises(RuntimeError):
+        read_images([path, str(tmpdir.join('missing.png'))])
+
+
+def test_read_cubemap_decodes_the_sides_into_a_strip(tmpdir):
+    sides = [noise_image(16, 16, seed) for seed in range(6)]
+    paths = []
+    for i, side in enumerate(sides):
+        path = str(tmpdir.join('side{}.png'.format(i)))
+        assert cv2.imwrite(path, side)
+        paths.append(path)
+    assert np.array_equal(read_cubemap(paths), np.hstack(sides))
+
+
+def test_write_images_round_trip(tmpdir):
+    images = [noise_image(20, 30, seed) for seed in range(4)]
+    paths = [str(tmpdir.join('out{}.png'.format(i))) for i in range(len(images))]
+    write_images(paths, images)
+    for path, image in zip(paths, images):
+        assert np.array_equal(cv2.imread(path), image)
+
+
+def test_write_images_quality(tmpdir):
+    image = cv2.resize(noise_image(16, 32), (256, 128))
+    low, high = str(tmpdir.join('low.jpg')), str(tmpdir.join('high.jpg'))
+    write_images([low], [image], 10)
+    write_images([high], [image], 95)
+    assert os.path.getsize(low) < os.path.getsize(high)
+
+
+@pytest.mark.parametrize('ext,params', [
+    ('png', []),
+    ('jpg', []),
+    ('jpg', [cv2.IMWRITE_JPEG_PROGRESSIVE, 1]),
+])
+def test_image_sizes_are_probed_from_the_headers(tmpdir, ext, params):
+    path = str(tmpdir.join('in.' + ext))
+    assert cv2.imwrite(path, noise_image(37, 53), params)
+    assert probe_image_size(path) == (53, 37)
+    assert image_size(path) == (53, 37)
+
+
+def test_image_sizes_of_the_other_formats_are_decoded(tmpdir):
+    path = str(tmpdir.join('in.bmp'))
+    assert cv2.imwrite(path, noise_image(37, 53))
+    assert probe_image_size(path) is None
+    assert image_size(path) == (53, 37)
+    with pytest.raises(RuntimeError):
+        libprojector.image_size(str(tmpdir.join('missing.bmp')))
+
+
+@pytest.mark.parametrize('scale,flags', [
+    (1, cv2.IMREAD_COLOR),
+    (2, cv2.IMREAD_REDUCED_COLOR_2),
+    (4, cv2.IMREAD_REDUCED_COLOR_4),
+    (8, cv2.IMREAD_REDUCED_COLOR_8),
+])
+def test_decode_flags_of_the_reduced_scales(scale, flags):
+    assert libprojector.decode_flags(libprojector.ImageDepth.uint8, scale) == flags
+
+
+def test_reduced_decoding_is_for_8_bits_only():
+    assert libprojector.decode_flags(libprojector.ImageDepth.uint16, 1) == cv2.IMREAD_COLOR | cv2.IMREAD_ANYDEPTH
+    with pytest.raises(ValueError):
+        libprojector.decode_flags(libprojector.ImageDepth.uint16, 2)
+    with pytest.raises(ValueError):
+        libprojector.decode_flags(libprojector.ImageDepth.uint8, 3)
+
+
+@pytest.mark.parametrize('side,max_scale,scale', [
+    # pixels per radian: 652 for the sphere, about 1.06 times the side for the cubemaps
+    (1024, 8, 1),
+    (256, 8, 2),
+    (64, 8, 8),
+    (64, 4, 4),
+])
+def test_reduced_decode_scale_keeps_the_input_as_dense_as_the_output(side, max_scale, scale):
+    sphere = libprojector.SphericalProjection(4096, 2048)
+    cube = libprojector.CubemapProjection(side, 0)
+    assert libprojector.reduced_decode_scale(sphere, cube, max_scale) == scale
+
+
+def test_smaller_outputs_are_converted_from_a_reduced_decode(tmpdir):
+    noise = np.random.RandomState(0).randint(0, 256, (64, 128, 3)).astype(np.uint8)
+    image = cv2.resize(noise, (2048, 1024), interpolation=cv2.INTER_CUBIC)
+    path = str(tmpdir.join('pano.jpg'))
+    assert cv2.imwrite(path, image, [cv2.IMWRITE_JPEG_QUALITY, 95])
+
+    output_proj = CubemapProj(6 * 64, {})
+    processor = ConvertProjectionProcessor(path)
+    reduced = processor.run(EquirectangularProj(2048, {}), output_proj)
+    assert list(processor._decoded) == [4]
+    assert reduced.shape == (64, 384, 3)
+
+    # as converted from the whole decode, area downscaled by 4
+    downscaled = cv2.resize(cv2.imread(path), (512, 256), interpolation=cv2.INTER_AREA)
+    expected = ConvertProjectionProcessor(image=downscaled).run(EquirectangularProj(512, {}), output_proj)
+    assert np.abs(reduced.astype(int) - expected).mean() < 3
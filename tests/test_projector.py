@@ -5,37 +5,215 @@
 test_projector
 ----------------------------------
 
-Tests for `projector` module.
+Tests of the projections and of the rotations of the convertor.
 """
 
+import numpy as np
 import pytest
 
-from contextlib import contextmanager
 from click.testing import CliRunner
 
-from projector import projector
+import libprojector
+
 from projector import cli
+from projector.processors import ConvertProjectionProcessor
+from projector.projections import CubemapProj, EquirectangularProj
+
+
+def identity_maps(proj):
+    """Maps of `proj` onto itself: the texture coordinates of the rays of its pixels"""
+    convertor = libprojector.ProjectionConvertor(proj, proj)
+    convertor.convert()
+    return convertor.get_map_x(), convertor.get_map_y()
+
+
+def pixel_grid(shape):
+    ys, xs = np.mgrid[0:shape[0], 0:shape[1]].astype(np.float32)
+    return xs, ys
+
+
+def wrapped(delta, width):
+    """Distance along a wrapping axis"""
+    return np.abs((delta + width / 2.0) % width - width / 2.0)
+
+
+def test_spherical_round_trip():
+    map_x, map_y = identity_maps(libprojector.SphericalProjection(256, 128))
+    xs, ys = pixel_grid(map_x.shape)
+    # the longitude of the rows at the poles is undefined
+    rows = slice(1, -1)
+    assert wrapped(map_x - xs, 256)[rows].max() < 1e-3
+    assert np.abs(map_y - ys)[rows].max() < 1e-3
+
+
+@pytest.mark.parametrize('layout', [
+    libprojector.CubemapLayout.strip,
+    libprojector.CubemapLayout.grid_3x2,
+    libprojector.CubemapLayout.horizontal_cross,
+    libprojector.CubemapLayout.vertical_cross,
+])
+@pytest.mark.parametrize('projection_class', [
+    libprojector.CubemapProjection,
+    libprojector.EquiAngularCubemapProjection,
+])
+def test_cubemap_round_trip(projection_class, layout):
+    side = 32
+    map_x, map_y = identity_maps(projection_class(side, 0, layout))
+    xs, ys = pixel_grid(map_x.shape)
+    # the first row and column of a side are on the edges of the cube,
+    # shared with the next sides
+    inner = (xs % side != 0) & (ys % side != 0)
+    # the empty cells of the crosses have no ray
+    used = np.zeros(map_x.shape, bool)
+    for y in range(0, map_x.shape[0], side):
+        for x in range(0, map_x.shape[1], side):
+            center = (y + side // 2, x + side // 2)
+            if abs(map_x[center] - center[1]) < 1 and abs(map_y[center] - center[0]) < 1:
+                used[y:y + side, x:x + side] = True
+    assert used.sum() == 6 * side * side
+    mask = used & inner
+    assert np.abs(map_x - xs)[mask].max() < 1e-3
+    assert np.abs(map_y - ys)[mask].max() < 1e-3
+
+
+def test_cubemap_gutters_are_opt_in():
+    sphere = libprojector.SphericalProjection(256, 128)
+
+    def maps(cube):
+        convertor = libprojector.ProjectionConvertor(sphere, cube)
+        convertor.convert()
+        return convertor.get_map_x(), convertor.get_map_y()
+
+    # the padding of an output is covered by the content of its sides...
+    plain_x, plain_y = maps(libprojector.CubemapProjection(32, 0))
+    padded_x, padded_y = maps(libprojector.CubemapProjection(32, 4))
+    assert np.array_equal(plain_x, padded_x) and np.array_equal(plain_y, padded_y)
+
+    # ...unless rendered as gutters around them
+    inner_x, inner_y = maps(libprojector.CubemapProjection(24, 0))
+    gutters_x, gutters_y = maps(libprojector.CubemapProjection(32, 4, libprojector.CubemapLayout.strip, True))
+    assert wrapped(gutters_x[4:28, 4:28] - inner_x[:, :24], 256).max() < 1e-3
+    assert np.abs(gutters_y[4:28, 4:28] - inner_y[:, :24]).max() < 1e-3
+
+
+def test_banded_round_trip():
+    # 4 rows per 15 degrees band, the main band 96 wide, the 60 degrees
+    # bands 48 (and a gutter), the pole bands 24 (and a gutter)
+    map_x, map_y = identity_maps(libprojector.BandedSphericalProjection(96))
+    assert map_x.shape == (40, 96)
+    xs, ys = pixel_grid(map_x.shape)
+    main = slice(4, 36)
+    assert wrapped(map_x - xs, 96)[main].max() < 1e-3
+    assert np.abs(map_y - ys)[main].max() < 1e-3
+    # the longitude of the rows at the poles is undefined
+    for rows in (slice(0, 4), slice(36, 40)):
+        assert np.abs(map_x - xs)[rows, :48].max() < 1e-3
+        assert np.abs(map_x - xs)[rows, 49:73][1:-1].max() < 1e-3
+        # the gutters wrap around to the first column of the bands
+        assert wrapped(map_x[rows, 48], 48).max() < 1e-3
+        assert wrapped(map_x[rows, 73][1:-1] - 49, 24).max() < 1e-3
 
 
-@pytest.fixture
-def response():
-    """Sample pytest fixture.
-    See more at: http://doc.pytest.org/en/latest/fixture.html
-    """
-    # import requests
-    # return requests.get('https://github.com/audreyr/cookiecutter-pypackage')
+def test_octahedral_round_trip():
+    map_x, map_y = identity_maps(libprojector.OctahedralProjection(64))
+    xs, ys = pixel_grid(map_x.shape)
+    # the folded edges have two texels per ray
+    inner = (slice(1, -1), slice(1, -1))
+    assert np.abs(map_x - xs)[inner].max() < 1e-3
+    assert np.abs(map_y - ys)[inner].max() < 1e-3
+
+
+def test_fisheye_round_trip():
+    proj = libprojector.FisheyeProjection(64, 64, libprojector.FisheyeModel.equidistant, 180.0, 31.5, 31.5, 32.0)
+    map_x, map_y = identity_maps(proj)
+    xs, ys = pixel_grid(map_x.shape)
+    inside = np.hypot(xs - 31.5, ys - 31.5) < 31
+    assert np.abs(map_x - xs)[inside].max() < 1e-3
+    assert np.abs(map_y - ys)[inside].max() < 1e-3
+
+
+def test_rotation_round_trip():
+    """Converting there and back with opposite rotations leads back to the same pixels"""
+    sphere = libprojector.SphericalProjection(256, 128)
+    cube = libprojector.CubemapProjection(256, 0)
+
+    there = libprojector.ProjectionConvertor(sphere, cube)
+    there.set_rotation(0, 35, 0)
+    there.convert()
+    back = libprojector.ProjectionConvertor(cube, sphere)
+    back.set_rotation(0, -35, 0)
+    back.convert()
+
+    # sphere pixel -> cube texel -> sphere texel
+    cube_x, cube_y = back.get_map_x(), back.get_map_y()
+    sphere_map_x = there.get_map_x()
+    rows = np.clip(np.round(cube_y).astype(int), 0, sphere_map_x.shape[0] - 1)
+    columns = np.clip(np.round(cube_x).astype(int), 0, sphere_map_x.shape[1] - 1)
+    sphere_x = sphere_map_x[rows, columns]
+    xs, _ = pixel_grid(cube_x.shape)
+    # the nearest texels of a denser cube are within a pixel of the sphere,
+    # away from the poles where the longitudes get closer
+    assert wrapped(sphere_x - xs, 256)[16:-16].max() < 1.0
+
+
+def test_yaw_update_shifts_the_maps():
+    proj = libprojector.SphericalProjection(256, 128)
+    convertor = libprojector.ProjectionConvertor(proj, libprojector.CubemapProjection(32, 0))
+    convertor.set_rotation(10, 20, 0)
+    convertor.convert()
+    convertor.set_rotation(55, 20, 0)
+    # only the yaw changed: the cached maps are shifted
+    assert convertor.update()
+
+    fresh = libprojector.ProjectionConvertor(proj, libprojector.CubemapProjection(32, 0))
+    fresh.set_rotation(55, 20, 0)
+    fresh.convert()
+    assert wrapped(convertor.get_map_x() - fresh.get_map_x(), 256).max() < 1e-2
+    assert np.abs(convertor.get_map_y() - fresh.get_map_y()).max() < 1e-2
+
+    # the pitch changed: the maps are built again
+    convertor.set_rotation(55, 30, 0)
+    assert not convertor.update()
+
+
+def test_processors_keep_their_convertors_for_equal_projections():
+    image = np.zeros((64, 128, 3), np.uint8)
+    processor = ConvertProjectionProcessor(image=image)
+
+    def projs(width=96):
+        # built anew for each conversion, as the batches and the daemon do
+        return EquirectangularProj(128, {}), CubemapProj(width, {'border_padding': 0})
+
+    processor.run(*projs())
+    convertor = processor._convertor
+    processor.run(*projs(), rotation=(30, 0, 0))
+    assert processor._convertor is convertor
+    processor.run(*projs(120))
+    assert processor._convertor is not convertor
+
+    in_proj, out_proj = projs()
+    processor.run_targets(in_proj, [(out_proj, libprojector.INTER_BICUBIC)])
+    multi_target = processor._multi_target
+    in_proj, out_proj = projs()
+    processor.run_targets(in_proj, [(out_proj, libprojector.INTER_BICUBIC)])
+    assert processor._multi_target is multi_target
+
+    list(processor.run_progressive(*projs(), preview_width=24))
+    progressive = processor._progressive
+    list(processor.run_progressive(*projs(), preview_width=24))
+    assert processor._progressive is progressive
 
 
-def test_content(response):
-    """Sample pytest test function with the pytest fixture as an argument.
-    """
-    # from bs4 import BeautifulSoup
-    # assert 'GitHub' in BeautifulSoup(response.content).title.string
 def test_command_line_interface():
     runner = CliRunner()
-    result = runner.invoke(cli.main)
-    assert result.exit_code == 0
-    assert 'projector.cli.main' in result.output
     help_result = runner.invoke(cli.main, ['--help'])
     assert help_result.exit_code == 0
-    assert '--help  Show this message and exit.' in help_result.output
+    assert '--help' in help_result.output
+    for command in ('convert', 'batch', 'enqueue', 'worker', 'serve', 'pyramid'):
+        assert command in help_result.output
+
+    # the options of a mode are only taken by its command
+    result = runner.invoke(cli.main, ['convert', '--tile-size', '256'])
+    assert result.exit_code == 2 and 'No such option' in result.output
+    result = runner.invoke(cli.main, ['serve', '--in-projection', 'cubemap', 'sock'])
+    assert result.exit_code == 2
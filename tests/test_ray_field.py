@@ -0,0 +1,84 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+"""
+test_ray_field
+----------------------------------
+
+Tests of the cache of the rays of the outputs, shared by the convertors
+whatever their input.
+"""
+
+import numpy as np
+import pytest
+
+import libprojector
+
+# default capacity of the shared cache
+DEFAULT_CAPACITY = 512 << 20
+
+
+@pytest.fixture(autouse=True)
+def empty_cache():
+    libprojector.clear_ray_field_cache()
+    yield
+    libprojector.set_ray_field_cache_capacity(DEFAULT_CAPACITY)
+    libprojector.clear_ray_field_cache()
+
+
+def ray_field_bytes(width, height):
+    return width * height * 2 * 4
+
+
+def maps(in_proj, out_proj, rotation=(10, 20, 0)):
+    convertor = libprojector.ProjectionConvertor(in_proj, out_proj)
+    convertor.set_rotation(*rotation)
+    convertor.convert()
+    return convertor.get_map_x(), convertor.get_map_y()
+
+
+def test_outputs_share_their_rays_whatever_the_input():
+    cube = libprojector.CubemapProjection(48, 0)
+    maps(libprojector.SphericalProjection(256, 128), cube)
+    assert libprojector.ray_field_cache_bytes() == ray_field_bytes(288, 48)
+
+    # another input and rotation, on the rays cached
+    sphere = libprojector.SphericalProjection(512, 256)
+    cached_x, cached_y = maps(sphere, cube, (40, -10, 5))
+    assert libprojector.ray_field_cache_bytes() == ray_field_bytes(288, 48)
+
+    libprojector.clear_ray_field_cache()
+    fresh_x, fresh_y = maps(sphere, cube, (40, -10, 5))
+    assert np.array_equal(cached_x, fresh_x) and np.array_equal(cached_y, fresh_y)
+
+
+def test_regions_are_cut_from_the_rays_of_their_output():
+    sphere = libprojector.SphericalProjection(256, 128)
+    cube = libprojector.CubemapProjection(48, 0)
+    whole_x, whole_y = maps(sphere, cube)
+
+    convertor = libprojector.ProjectionConvertor(sphere, cube)
+    convertor.set_rotation(10, 20, 0)
+    region = convertor.region(60, 10, 50, 30)
+    region.convert()
+    # not cached on their own
+    assert libprojector.ray_field_cache_bytes() == ray_field_bytes(288, 48)
+    assert np.array_equal(region.get_map_x(), whole_x[10:40, 60:110])
+    assert np.array_equal(region.get_map_y(), whole_y[10:40, 60:110])
+
+
+def test_ray_fields_stay_within_the_capacity():
+    sphere = libprojector.SphericalProjection(256, 128)
+    libprojector.set_ray_field_cache_capacity(ray_field_bytes(288, 48))
+    maps(sphere, libprojector.CubemapProjection(48, 0))
+    # the least recently used field is dropped for the next one
+    maps(sphere, libprojector.CubemapProjection(40, 0))
+    assert libprojector.ray_field_cache_bytes() == ray_field_bytes(240, 40)
+
+    # a field bigger than the capacity isn't kept
+    x, _ = maps(sphere, libprojector.CubemapProjection(64, 0))
+    assert x.shape == (64, 384)
+    assert libprojector.ray_field_cache_bytes() == ray_field_bytes(240, 40)
+
+    libprojector.set_ray_field_cache_capacity(0)
+    assert libprojector.ray_field_cache_bytes() == 0
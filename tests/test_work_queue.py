@@ -0,0 +1,131 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+"""
+test_work_queue
+----------------------------------
+
+Tests of the shared-directory work queue.
+"""
+
+import json
+import os
+import time
+
+import pytest
+
+from projector.work_queue import WorkQueue, run_worker
+
+JOBS = [('/in/{}.jpg'.format(i), '/out/{}.jpg'.format(i)) for i in range(5)]
+
+
+@pytest.fixture
+def queue(tmpdir):
+    queue = WorkQueue(str(tmpdir))
+    assert queue.enqueue(JOBS, {'out_projection': 'cubemap'}) == len(JOBS)
+    return queue
+
+
+def expire(queue, worker_id, lease):
+    """Make the heartbeat of `worker_id` older than the lease"""
+    path = os.path.join(queue.path, 'workers', worker_id)
+    old = time.time() - 2 * lease
+    os.utime(path, (old, old))
+
+
+def test_enqueue_skips_the_known_jobs(queue):
+    assert queue.enqueue(JOBS + [('/in/new.jpg', '/out/new.jpg')], {}) == 1
+    assert queue.status() == {'pending': 6, 'claimed': 0, 'done': 0, 'failed': 0}
+    assert queue.config() == {}
+
+
+def test_claim_and_complete(queue):
+    claimed = queue.claim('a', 3)
+    assert len(claimed) == 3
+    assert set((i, o) for (_, i, o) in claimed) <= set(JOBS)
+    # a job is claimed once
+    others = queue.claim('b', 10)
+    assert len(others) == 2
+    assert not set(name for name, _, _ in claimed) & set(name for name, _, _ in others)
+
+    for name, _, _ in claimed:
+        assert queue.complete('a', name)
+    assert queue.fail('b', others[0][0], 'broken')
+    assert queue.status() == {'pending': 0, 'claimed': 1, 'done': 3, 'failed': 1}
+
+    # the done jobs aren't queued again, the failed one is retried
+    assert queue.enqueue(JOBS, {}) == 1
+
+
+def test_failed_jobs_keep_their_error(queue):
+    name, input_path, _ = queue.claim('a', 1)[0]
+    queue.fail('a', name, 'unable to read the image')
+    failed = queue._dir('failed', name)
+    with open(failed) as f:
+        job = json.load(f)
+    assert job['input'] == input_path
+    assert job['error'] == 'unable to read the image'
+
+
+def test_recover_the_jobs_of_dead_workers(queue):
+    queue.heartbeat('dead')
+    queue.heartbeat('alive')
+    queue.claim('dead', 2)
+    queue.claim('alive', 2)
+    expire(queue, 'dead', 10)
+
+    assert queue.recover(10) == 2
+    assert queue.status() == {'pending': 3, 'claimed': 2, 'done': 0, 'failed': 0}
+    assert queue.recover(10) == 0
+
+
+def test_jobs_recovered_by_another_worker_are_lost(queue):
+    queue.heartbeat('slow')
+    claimed = queue.claim('slow', 2)
+    expire(queue, 'slow', 10)
+    queue.recover(10)
+
+    # the slow worker finishes after its jobs went back to pending
+    assert not queue.complete('slow', claimed[0][0])
+    assert not queue.fail('slow', claimed[1][0], 'error')
+    assert queue.status() == {'pending': 5, 'claimed': 0, 'done': 0, 'failed': 0}
+
+
+class FakeProcessor(object):
+    """Stand-in for a BatchProcessor, failing the inputs in `failing`"""
+
+    def __init__(self, failing=(), on_run=None):
+        self.failing = failing
+        self.on_run = on_run
+        self.converted = []
+
+    def run(self, jobs, rotation=None, callback=None):
+        if self.on_run is not None:
+            self.on_run(jobs)
+        for input_path, output_path in jobs:
+            self.converted.append(input_path)
+            success = input_path not in self.failing
+            callback(input_path, output_path, success, '' if success else 'failed')
+
+
+def test_run_worker_empties_the_queue(queue):
+    processor = FakeProcessor(failing=('/in/3.jpg',))
+    assert run_worker(queue, processor, 'w', chunk=2) == (4, 1)
+    assert sorted(processor.converted) == sorted(i for i, _ in JOBS)
+    assert queue.status() == {'pending': 0, 'claimed': 0, 'done': 4, 'failed': 1}
+
+
+def test_run_worker_goes_on_after_losing_jobs(queue):
+    lost = []
+
+    def steal_first_chunk(jobs):
+        # another worker takes this one for dead while the chunk converts
+        if not lost:
+            lost.extend(jobs)
+            claimed_dir = queue._dir('claimed', 'w')
+            for name in os.listdir(claimed_dir):
+                os.rename(os.path.join(claimed_dir, name), queue._dir('done', name))
+
+    processor = FakeProcessor(on_run=steal_first_chunk)
+    assert run_worker(queue, processor, 'w', chunk=2) == (len(JOBS) - len(lost), 0)
+    assert queue.status() == {'pending': 0, 'claimed': 0, 'done': 5, 'failed': 0}